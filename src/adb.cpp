@@ -0,0 +1,345 @@
+#include "adb.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+///////////////////////////////////////////
+
+// The adb server speaks a simple protocol over a localhost socket. Requests
+// are a 4 hex digit length followed by the service name, and the server
+// answers "OKAY", or "FAIL" followed by a length prefixed message. Host
+// services like "host:devices-l" reply with a length prefixed string and
+// close. "host:transport:<serial>" instead hands the connection over to the
+// device, and the next request ("shell:<command>") streams the command's
+// output until it exits. Since each connection is used up by the service on
+// it, there's nothing to hand back to a pool; connecting to localhost is
+// cheap, it's the adb process startup we're avoiding.
+
+const int32_t adb_timeout_ms = 10000;
+
+int32_t           adb_server_port   ();
+platform_socket_t adb_server_connect();
+bool              adb_request       (platform_socket_t socket, const char *service);
+bool              adb_read_exact    (platform_socket_t socket, char *buffer, int32_t size);
+char             *adb_read_string   (platform_socket_t socket);
+bool              adb_process_stream(const char *const *args, adb_stream_t *out_stream);
+char             *adb_stream_read_all(adb_stream_t *ref_stream);
+void              adb_shell_command (const char *const *args, char *out_command, size_t command_size);
+
+///////////////////////////////////////////
+
+const char *adb_exe() {
+	static const char *exe = nullptr;
+	if (exe == nullptr) {
+		const char *env = getenv("LOGPANTHER_ADB");
+		exe = env != nullptr && env[0] != '\0' ? env : "adb";
+	}
+	return exe;
+}
+
+///////////////////////////////////////////
+
+char *adb_devices() {
+	TRACE_ZONE("adb_devices");
+
+	platform_socket_t socket = adb_server_connect();
+	if (socket != nullptr) {
+		char *result = adb_request(socket, "host:devices-l")
+			? adb_read_string(socket)
+			: nullptr;
+		platform_socket_close(socket);
+		return result;
+	}
+
+	const char *args[] = { adb_exe(), "devices", "-l", nullptr };
+	adb_stream_t stream;
+	if (!adb_process_stream(args, &stream)) return nullptr;
+	return adb_stream_read_all(&stream);
+}
+
+///////////////////////////////////////////
+
+bool adb_track_devices(adb_stream_t *out_stream) {
+	*out_stream = {};
+
+	platform_socket_t socket = adb_server_connect();
+	if (socket != nullptr) {
+		if (!adb_request(socket, "host:track-devices-l")) {
+			platform_socket_close(socket);
+			return false;
+		}
+		out_stream->socket = socket;
+		return true;
+	}
+
+	// The adb client prints the server's stream as is
+	const char *args[] = { adb_exe(), "track-devices", "-l", nullptr };
+	return adb_process_stream(args, out_stream);
+}
+
+///////////////////////////////////////////
+
+bool adb_shell(const char *opt_serial, const char *const *args, adb_stream_t *out_stream) {
+	TRACE_ZONE("adb_shell");
+	*out_stream = {};
+
+	char command[4096];
+	adb_shell_command(args, command, sizeof(command));
+
+	platform_socket_t socket = adb_server_connect();
+	if (socket != nullptr) {
+		char transport[128];
+		char service  [4096 + 8];
+		if (opt_serial == nullptr) snprintf(transport, sizeof(transport), "host:transport-any");
+		else                       snprintf(transport, sizeof(transport), "host:transport:%s", opt_serial);
+		snprintf(service, sizeof(service), "shell:%s", command);
+
+		if (!adb_request(socket, transport) || !adb_request(socket, service)) {
+			platform_socket_close(socket);
+			return false;
+		}
+		out_stream->socket = socket;
+		return true;
+	}
+
+	// adb shell passes a single argument through to the device untouched, so
+	// the command we've already quoted works here too.
+	const char *args_any   [] = { adb_exe(),                   "shell", command, nullptr };
+	const char *args_device[] = { adb_exe(), "-s", opt_serial, "shell", command, nullptr };
+	return adb_process_stream(opt_serial == nullptr ? args_any : args_device, out_stream);
+}
+
+///////////////////////////////////////////
+
+char *adb_shell_output(const char *opt_serial, const char *const *args) {
+	adb_stream_t stream;
+	if (!adb_shell(opt_serial, args, &stream)) return nullptr;
+	return adb_stream_read_all(&stream);
+}
+
+///////////////////////////////////////////
+
+int32_t adb_stream_read(adb_stream_t *stream, char *buffer, int32_t buffer_size, int32_t timeout_ms) {
+	if (stream->socket != nullptr)
+		return platform_socket_recv(stream->socket, buffer, buffer_size, timeout_ms);
+	if (stream->process == nullptr)
+		return -1;
+
+	// Pipes have no portable way to wait with a timeout, so poll them
+	uint64_t end = timeout_ms < 0
+		? UINT64_MAX
+		: platform_time_ns() + (uint64_t)timeout_ms * 1000000;
+	while (true) {
+		if (platform_pipe_peek(stream->pipe) > 0) {
+			int32_t read = platform_pipe_read(stream->pipe, buffer, buffer_size);
+			return read > 0 ? read : 0;
+		}
+		// The process may have written more on its way out
+		if (!platform_process_is_running(stream->process)) {
+			int32_t read = platform_pipe_peek(stream->pipe) > 0
+				? platform_pipe_read(stream->pipe, buffer, buffer_size)
+				: 0;
+			return read > 0 ? read : -1;
+		}
+		if (platform_time_ns() >= end)
+			return 0;
+		platform_sleep_ms(1);
+	}
+}
+
+///////////////////////////////////////////
+
+int32_t adb_stream_peek(adb_stream_t *stream) {
+	if (stream->socket  != nullptr) return platform_socket_peek(stream->socket);
+	if (stream->process != nullptr) return platform_pipe_peek  (stream->pipe);
+	return 0;
+}
+
+///////////////////////////////////////////
+
+void adb_stream_close(adb_stream_t *ref_stream) {
+	if (ref_stream->socket != nullptr) {
+		platform_socket_close(ref_stream->socket);
+	}
+	if (ref_stream->process != nullptr) {
+		platform_process_terminate(ref_stream->process);
+		platform_process_cleanup  (ref_stream->process);
+	}
+	*ref_stream = {};
+}
+
+///////////////////////////////////////////
+
+bool adb_cache_path(const char *serial, const char *prefix, char *out_path, int32_t path_size) {
+	// Serials can be addresses like 192.168.1.5:5555, which won't do for a
+	// file name
+	char filename[128];
+	int32_t at = snprintf(filename, sizeof(filename), "%s", prefix);
+	for (const char *c = serial; *c != '\0' && at < (int32_t)sizeof(filename) - 5; c++) {
+		bool safe = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') || *c == '-';
+		filename[at++] = safe ? *c : '_';
+	}
+	snprintf(filename + at, sizeof(filename) - at, ".txt");
+	return platform_cache_path(out_path, path_size, filename);
+}
+
+///////////////////////////////////////////
+
+// Zero if we shouldn't talk to the server at all
+int32_t adb_server_port() {
+	const char *native   = getenv("LOGPANTHER_ADB_NATIVE");
+	const char *port_str = getenv("ANDROID_ADB_SERVER_PORT");
+	if (native   != nullptr && strcmp(native, "0") == 0) return 0;
+	if (port_str != nullptr && atoi(port_str) > 0)      return atoi(port_str);
+	return 5037;
+}
+
+///////////////////////////////////////////
+
+platform_socket_t adb_server_connect() {
+	static const int32_t port = adb_server_port();
+	if (port == 0) return nullptr;
+
+	platform_socket_t socket = platform_socket_connect("127.0.0.1", (uint16_t)port);
+	if (socket != nullptr) return socket;
+
+	// Nothing's listening, so have adb start its server, but only try once.
+	// If that doesn't work we'll just keep spawning adb for everything.
+	static std::atomic<bool> start_attempted = false;
+	if (start_attempted.exchange(true)) return nullptr;
+
+	const char *args[] = { adb_exe(), "start-server", nullptr };
+	platform_process_result_t proc = platform_process_start(args);
+	if (!proc.success) return nullptr;
+	while (platform_process_is_running(proc.process)) {
+		platform_sleep_ms(10);
+	}
+	platform_process_cleanup(proc.process);
+
+	return platform_socket_connect("127.0.0.1", (uint16_t)port);
+}
+
+///////////////////////////////////////////
+
+bool adb_request(platform_socket_t socket, const char *service) {
+	int32_t len = (int32_t)strlen(service);
+	char    header[5];
+	snprintf(header, sizeof(header), "%04x", len);
+	if (!platform_socket_send(socket, header,  4  )) return false;
+	if (!platform_socket_send(socket, service, len)) return false;
+
+	char status[4];
+	if (!adb_read_exact(socket, status, 4)) return false;
+	if (memcmp(status, "OKAY", 4) == 0) return true;
+
+	// FAIL comes with a reason, but callers only need to know it failed,
+	// and some (like reconnecting) expect to fail a lot
+	return false;
+}
+
+///////////////////////////////////////////
+
+bool adb_read_exact(platform_socket_t socket, char *buffer, int32_t size) {
+	int32_t at = 0;
+	while (at < size) {
+		int32_t read = platform_socket_recv(socket, buffer + at, size - at, adb_timeout_ms);
+		if (read <= 0) return false;
+		at += read;
+	}
+	return true;
+}
+
+///////////////////////////////////////////
+
+char *adb_read_string(platform_socket_t socket) {
+	char header[5] = {};
+	if (!adb_read_exact(socket, header, 4)) return nullptr;
+
+	int32_t len = (int32_t)strtol(header, nullptr, 16);
+	char   *result = (char*)malloc(len + 1);
+	if (!adb_read_exact(socket, result, len)) {
+		free(result);
+		return nullptr;
+	}
+	result[len] = '\0';
+	return result;
+}
+
+///////////////////////////////////////////
+
+bool adb_process_stream(const char *const *args, adb_stream_t *out_stream) {
+	*out_stream = {};
+
+	platform_process_result_t proc = platform_process_start(args);
+	if (!proc.success) return false;
+
+	out_stream->process = proc.process;
+	out_stream->pipe    = proc.stdout_pipe;
+	return true;
+}
+
+///////////////////////////////////////////
+
+char *adb_stream_read_all(adb_stream_t *ref_stream) {
+	int32_t size     = 0;
+	int32_t capacity = 4096;
+	char   *result   = (char*)malloc(capacity);
+	while (true) {
+		if (capacity - size < 4096 + 1) {
+			capacity = capacity * 2;
+			result   = (char*)realloc(result, capacity);
+		}
+		int32_t read = adb_stream_read(ref_stream, result + size, 4096, adb_timeout_ms);
+		if (read < 0) break;
+		if (read == 0) {
+			// Nothing for a long while, give up on it
+			free(result);
+			result = nullptr;
+			break;
+		}
+		size += read;
+	}
+	if (result != nullptr)
+		result[size] = '\0';
+
+	adb_stream_close(ref_stream);
+	return result;
+}
+
+///////////////////////////////////////////
+
+// Joins args into a single command for the device's shell, quoting any
+// argument that the shell would otherwise split or expand.
+void adb_shell_command(const char *const *args, char *out_command, size_t command_size) {
+	size_t at = 0;
+	out_command[0] = '\0';
+	for (int32_t i = 0; args[i] != nullptr; i++) {
+		const char *arg  = args[i];
+		bool        safe = arg[0] != '\0';
+		for (const char *c = arg; *c != '\0' && safe; c++) {
+			safe = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') ||
+			       strchr("_-./:=@,+%", *c) != nullptr;
+		}
+
+		char quoted[1024];
+		if (safe) {
+			snprintf(quoted, sizeof(quoted), "%s", arg);
+		} else {
+			// 'it'\''s' is how sh spells "it's" inside single quotes
+			size_t q = 0;
+			quoted[q++] = '\'';
+			for (const char *c = arg; *c != '\0' && q < sizeof(quoted) - 6; c++) {
+				if (*c == '\'') { memcpy(quoted + q, "'\\''", 4); q += 4; }
+				else            { quoted[q++] = *c; }
+			}
+			quoted[q++] = '\'';
+			quoted[q]   = '\0';
+		}
+
+		at += snprintf(out_command + at, at < command_size ? command_size - at : 0, "%s%s", i > 0 ? " " : "", quoted);
+		if (at >= command_size) break;
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "platform.h"
+
+///////////////////////////////////////////
+
+// Output from a command running on a device. This is a connection straight to
+// the adb server when one is reachable, or the stdout of an adb process when
+// it isn't.
+struct adb_stream_t {
+	platform_socket_t  socket;
+	platform_process_t process;
+	platform_pipe_t    pipe;
+};
+
+// Path to the adb executable used when we need to spawn adb. This is just
+// "adb" unless the LOGPANTHER_ADB environment variable points somewhere else,
+// such as the fake-adb load testing tool.
+const char *adb_exe();
+
+// Text of `adb devices -l`, malloc'd, or nullptr on failure. A single request
+// to the adb server when it's running.
+char       *adb_devices     ();
+
+// Subscribes to device list changes. The stream carries a 4 hex digit length
+// prefixed copy of the `adb devices -l` text (without header) every time a
+// device comes, goes or changes state, starting with the current list.
+bool        adb_track_devices(adb_stream_t *out_stream);
+
+// Runs a shell command on the device (any device when opt_serial is null),
+// args is nullptr terminated. Talks to the adb server on localhost (port
+// ANDROID_ADB_SERVER_PORT, or 5037) directly, and only spawns adb when the
+// server can't be reached. Set LOGPANTHER_ADB_NATIVE=0 to always spawn adb.
+bool        adb_shell       (const char *opt_serial, const char *const *args, adb_stream_t *out_stream);
+// Runs a shell command to completion and returns its output, malloc'd, or
+// nullptr on failure.
+char       *adb_shell_output(const char *opt_serial, const char *const *args);
+
+// Waits up to timeout_ms for output (-1 waits forever) and reads what's
+// there. Returns number of bytes read, 0 on timeout, -1 once the command has
+// finished and all output is read.
+int32_t     adb_stream_read (adb_stream_t *stream, char *buffer, int32_t buffer_size, int32_t timeout_ms);
+// How many bytes are waiting to be read
+int32_t     adb_stream_peek (adb_stream_t *stream);
+// Stops the command if it's still running, and frees the stream
+void        adb_stream_close(adb_stream_t *ref_stream);
+
+// Path in the cache folder for a file about one device, named prefix, the
+// serial and ".txt". False if there's nowhere to put it.
+bool        adb_cache_path  (const char *serial, const char *prefix, char *out_path, int32_t path_size);
@@ -1,4 +1,6 @@
 #include "app_finder.h"
+#include "adb.h"
+#include "trace.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -6,23 +8,65 @@
 
 ///////////////////////////////////////////
 
-int app_finder_thread(void* arg);
-int app_launcher_thread(void* arg);
+// One refresh, with everything its thread needs, so a refresh for a device
+// we've since switched away from can finish on its own without holding up
+// the UI
+struct app_finder_job_t {
+    app_finder_t      *finder;
+    platform_thread_t  thread;
+    char               device_id[64];
+    bool               load_cache;
+    std::atomic<bool>  done;
+};
+
+int         app_finder_thread    (void* arg);
+int         app_launcher_thread  (void* arg);
+bool        app_finder_publish   (app_finder_job_t *job, const app_list_t *list, app_finder_state_ state);
+void        app_finder_reap      (app_finder_t *ref_finder, bool wait);
+bool        app_list_load        (app_list_t *ref_list, const char *filename);
+bool        app_list_save        (const app_list_t *list, const char *filename);
+bool        app_list_equal       (const app_list_t *a, const app_list_t *b);
+void        app_list_index       (app_list_t *ref_list);
+void        app_list_free        (app_list_t *ref_list);
+const char *app_prefix_text      (const app_list_t *list, app_prefix_t prefix);
+int         app_info_compare     (const void *a, const void *b);
+int         app_prefix_compare   (const void *a, const void *b);
+int         app_index_compare    (const void *a, const void *b);
 
 ///////////////////////////////////////////
 
-bool app_finder_start(app_finder_t *out_finder, const char *device_id) {
-    if (out_finder->state == app_finder_state_searching)
-        return true;
-    out_finder->state = app_finder_state_searching;
-    strncpy(out_finder->device_id, device_id, sizeof(out_finder->device_id) - 1);
-    out_finder->device_id[sizeof(out_finder->device_id) - 1] = '\0';
+bool app_finder_start(app_finder_t *ref_finder, const char *device_id) {
+    bool same_device = strcmp(ref_finder->device_id, device_id) == 0;
+    if (ref_finder->state == app_finder_state_searching && same_device)
+        return false;
 
-    out_finder->thread = platform_thread_create(app_finder_thread, out_finder);
+    app_finder_job_t *job = (app_finder_job_t*)calloc(1, sizeof(app_finder_job_t));
+    job->finder = ref_finder;
+    strncpy(job->device_id, device_id, sizeof(job->device_id) - 1);
+    job->load_cache = !same_device;
+
+    // Only the newest refresh may publish, the old one is left to finish
+    if (ref_finder->job_mutex == nullptr) ref_finder->job_mutex = platform_mutex_create();
+    platform_mutex_lock(ref_finder->job_mutex);
+    if (ref_finder->job != nullptr) ref_finder->stale.add(ref_finder->job);
+    ref_finder->job   = job;
+    ref_finder->state = app_finder_state_searching;
+    if (!same_device) app_list_free(&ref_finder->known);
+    platform_mutex_unlock(ref_finder->job_mutex);
+
+    if (!same_device) {
+        strncpy(ref_finder->device_id, device_id, sizeof(ref_finder->device_id) - 1);
+        ref_finder->device_id[sizeof(ref_finder->device_id) - 1] = '\0';
+        // The old device's list is no use, not even while we load
+        app_finder_update(ref_finder);
+        app_list_free(&ref_finder->list);
+    }
 
-    if (out_finder->thread == nullptr) {
+    job->thread = platform_thread_create(app_finder_thread, job);
+    if (job->thread == nullptr) {
         printf("Failed to create app finder thread\n");
-        out_finder->state = app_finder_state_error;
+        job->done         = true;
+        ref_finder->state = app_finder_state_error;
         return false;
     }
 
@@ -31,94 +75,273 @@ bool app_finder_start(app_finder_t *out_finder, const char *device_id) {
 
 ///////////////////////////////////////////
 
-void app_finder_destroy(app_finder_t *ref_finder) {
-    for (int32_t i = 0; i < ref_finder->apps.count; i++) {
-        // Nothing to free, package is inline
+bool app_finder_update(app_finder_t *ref_finder) {
+    app_finder_reap(ref_finder, false);
+
+    app_list_t *list = ref_finder->published.exchange(nullptr, std::memory_order_acquire);
+    if (list == nullptr) return false;
+
+    app_list_free(&ref_finder->list);
+    ref_finder->list = *list;
+    free(list);
+    return true;
+}
+
+///////////////////////////////////////////
+
+// Joins the stale refreshes that are done, or all of them and the current
+// one too when wait is set
+void app_finder_reap(app_finder_t *ref_finder, bool wait) {
+    for (int32_t i = 0; i < ref_finder->stale.count; ) {
+        app_finder_job_t *job = ref_finder->stale[i];
+        if (!wait && !job->done) { i++; continue; }
+        platform_thread_join(job->thread);
+        free(job);
+        ref_finder->stale.remove(i);
+    }
+    if (wait && ref_finder->job != nullptr) {
+        platform_thread_join(ref_finder->job->thread);
+        free(ref_finder->job);
+        ref_finder->job = nullptr;
     }
-    ref_finder->apps.free();
-    *ref_finder = {};
+}
+
+///////////////////////////////////////////
+
+void app_finder_destroy(app_finder_t *ref_finder) {
+    app_finder_reap(ref_finder, true);
+    ref_finder->stale.free();
+    app_finder_update(ref_finder);
+    app_list_free(&ref_finder->list);
+    app_list_free(&ref_finder->known);
+    if (ref_finder->job_mutex != nullptr) platform_mutex_destroy(ref_finder->job_mutex);
+    ref_finder->job_mutex = nullptr;
+    ref_finder->state     = app_finder_state_none;
+    ref_finder->device_id[0] = '\0';
 }
 
 ///////////////////////////////////////////
 
 int app_finder_thread(void* arg) {
-    app_finder_t *finder = (app_finder_t*)arg;
-    char buffer     [4096+1];
-    char line_buffer[4096+1];
-    int32_t line_buffer_pos = 0;
+    app_finder_job_t *job = (app_finder_job_t*)arg;
 
-    char command[256];
-    snprintf(command, sizeof(command), "adb -s %s shell pm list packages", finder->device_id);
+    TRACE_THREAD("app_finder_thread");
 
-    platform_process_result_t proc = platform_process_start(command);
-    if (!proc.success) {
-        finder->state = app_finder_state_error;
-        return -1;
+    // Show what the device had last time while we ask it what it has now
+    char cache_path[512];
+    bool has_cache = adb_cache_path(job->device_id, "packages-", cache_path, sizeof(cache_path));
+    if (job->load_cache && has_cache) {
+        app_list_t cached = {};
+        if (app_list_load(&cached, cache_path)) {
+            app_finder_publish(job, &cached, app_finder_state_searching);
+        }
+        app_list_free(&cached);
     }
 
-    finder->apps.clear();
+    const char *args[] = { "pm", "list", "packages", nullptr };
+    char *text = adb_shell_output(job->device_id, args);
+    if (text == nullptr) {
+        app_finder_publish(job, nullptr, app_finder_state_error);
+        job->done = true;
+        return -1;
+    }
 
-    while (true) {
-        // Check if data is available
-        int32_t available = platform_pipe_peek(proc.stdout_pipe);
-        if (available <= 0) {
-            // No data available - check if process is done
-            if (!platform_process_is_running(proc.process)) {
-                break; // Process done AND no more data
-            }
-            platform_sleep_ms(1);
-            continue;
+    app_list_t fresh = {};
+    char *line_buffer = text;
+    while (*line_buffer != '\0') {
+        char *line_end = line_buffer + strcspn(line_buffer, "\r\n");
+        char *next     = *line_end == '\0' ? line_end : line_end + 1;
+        *line_end = '\0';
+
+        // Lines look like: "package:com.example.app"
+        if (strncmp(line_buffer, "package:", 8) == 0) {
+            app_info_t info = {};
+            strncpy(info.package, line_buffer + 8, sizeof(info.package) - 1);
+            info.package[sizeof(info.package) - 1] = '\0';
+            fresh.apps.add(info);
         }
+        line_buffer = next;
+    }
+    free(text);
 
-        // Read the data from stdout
-        int32_t read = platform_pipe_read(proc.stdout_pipe, buffer, 4096);
-        if (read <= 0) {
-            platform_sleep_ms(1);
-            continue;
-        }
+    // Sort packages alphabetically for easier browsing
+    qsort(fresh.apps.data, fresh.apps.count, sizeof(app_info_t), app_info_compare);
+
+    if (app_finder_publish(job, &fresh, app_finder_state_finished) && has_cache)
+        app_list_save(&fresh, cache_path);
+    app_list_free(&fresh);
+
+    job->done = true;
+    return 1;
+}
+
+///////////////////////////////////////////
 
-        buffer[read] = '\0';
-        for (int i = 0; i < read; ++i) {
-            if (buffer[i] == '\n' || buffer[i] == '\r' || line_buffer_pos == 4096) {
-                if (line_buffer_pos == 0) continue;
-                line_buffer[line_buffer_pos] = '\0';
-                line_buffer_pos = 0;
-
-                // Lines look like: "package:com.example.app"
-                if (strncmp(line_buffer, "package:", 8) == 0) {
-                    app_info_t info = {};
-                    strncpy(info.package, line_buffer + 8, sizeof(info.package) - 1);
-                    info.package[sizeof(info.package) - 1] = '\0';
-                    finder->apps.add(info);
-                }
-            } else {
-                line_buffer[line_buffer_pos++] = buffer[i];
+// Hands a copy of list to the UI, with its prefix index, and keeps another
+// to compare the next refresh against. Most of the time nothing's changed,
+// and then there's nothing to hand over. A stale refresh does nothing at
+// all. Returns whether list was new.
+bool app_finder_publish(app_finder_job_t *job, const app_list_t *list, app_finder_state_ state) {
+    app_finder_t *finder = job->finder;
+    bool          fresh  = false;
+    platform_mutex_lock(finder->job_mutex);
+    if (finder->job == job) {
+        fresh = list != nullptr && !app_list_equal(list, &finder->known);
+        if (fresh) {
+            app_list_free(&finder->known);
+            finder->known.apps = list->apps.copy();
+
+            app_list_t *result = (app_list_t*)malloc(sizeof(app_list_t));
+            *result = {};
+            result->apps = list->apps.copy();
+            app_list_index(result);
+
+            app_list_t *unseen = finder->published.exchange(result, std::memory_order_acq_rel);
+            if (unseen != nullptr) {
+                app_list_free(unseen);
+                free(unseen);
             }
         }
+        finder->state = state;
     }
+    platform_mutex_unlock(finder->job_mutex);
+    return fresh;
+}
 
-    platform_process_cleanup(proc.process);
+///////////////////////////////////////////
 
-    // Sort packages alphabetically for easier browsing
-    for (int32_t i = 0; i < finder->apps.count - 1; i++) {
-        for (int32_t j = i + 1; j < finder->apps.count; j++) {
-            if (strcmp(finder->apps[i].package, finder->apps[j].package) > 0) {
-                app_info_t tmp = finder->apps[i];
-                finder->apps[i] = finder->apps[j];
-                finder->apps[j] = tmp;
-            }
+bool app_list_load(app_list_t *ref_list, const char *filename) {
+    FILE *fp = fopen(filename, "r");
+    if (fp == nullptr) return false;
+
+    char line[256];
+    while (fgets(line, sizeof(line), fp) != nullptr) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') continue;
+        app_info_t info = {};
+        strncpy(info.package, line, sizeof(info.package) - 1);
+        ref_list->apps.add(info);
+    }
+    fclose(fp);
+
+    qsort(ref_list->apps.data, ref_list->apps.count, sizeof(app_info_t), app_info_compare);
+    return ref_list->apps.count > 0;
+}
+
+///////////////////////////////////////////
+
+bool app_list_save(const app_list_t *list, const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (fp == nullptr) return false;
+    for (int32_t i = 0; i < list->apps.count; i++)
+        fprintf(fp, "%s\n", list->apps[i].package);
+    fclose(fp);
+    return true;
+}
+
+///////////////////////////////////////////
+
+bool app_list_equal(const app_list_t *a, const app_list_t *b) {
+    if (a->apps.count != b->apps.count) return false;
+    for (int32_t i = 0; i < a->apps.count; i++)
+        if (strcmp(a->apps[i].package, b->apps[i].package) != 0) return false;
+    return true;
+}
+
+///////////////////////////////////////////
+
+void app_list_index(app_list_t *ref_list) {
+    ref_list->prefixes.clear();
+    for (int32_t i = 0; i < ref_list->apps.count; i++) {
+        const char *package = ref_list->apps[i].package;
+        for (int32_t c = 0; package[c] != '\0'; c++) {
+            if (c == 0 || package[c - 1] == '.')
+                ref_list->prefixes.add({ i, c, package + c });
         }
     }
+    qsort(ref_list->prefixes.data, ref_list->prefixes.count, sizeof(app_prefix_t), app_prefix_compare);
+}
 
-    finder->state = app_finder_state_finished;
-    return 1;
+///////////////////////////////////////////
+
+void app_list_search(const app_list_t *list, const char *prefix, array_t<int32_t> *out_apps) {
+    out_apps->clear();
+    size_t len = strlen(prefix);
+    if (len == 0) {
+        for (int32_t i = 0; i < list->apps.count; i++)
+            out_apps->add(i);
+        return;
+    }
+
+    // Find the first part that sorts at or after prefix, then everything
+    // after it that starts with prefix
+    int32_t lo = 0;
+    int32_t hi = list->prefixes.count;
+    while (lo < hi) {
+        int32_t mid = (lo + hi) / 2;
+        if (strcmp(app_prefix_text(list, list->prefixes[mid]), prefix) < 0) lo = mid + 1;
+        else                                                               hi = mid;
+    }
+    for (int32_t i = lo; i < list->prefixes.count; i++) {
+        if (strncmp(app_prefix_text(list, list->prefixes[i]), prefix, len) != 0) break;
+        out_apps->add(list->prefixes[i].app);
+    }
+
+    // A package can match more than once, "com.example.com" for "co"
+    qsort(out_apps->data, out_apps->count, sizeof(int32_t), app_index_compare);
+    int32_t unique = 0;
+    for (int32_t i = 0; i < out_apps->count; i++) {
+        if (unique == 0 || out_apps->get(unique - 1) != out_apps->get(i))
+            out_apps->get(unique++) = out_apps->get(i);
+    }
+    out_apps->count = unique;
+}
+
+///////////////////////////////////////////
+
+int32_t app_list_find(const app_list_t *list, const char *package) {
+    int32_t lo = 0;
+    int32_t hi = list->apps.count - 1;
+    while (lo <= hi) {
+        int32_t mid = (lo + hi) / 2;
+        int32_t cmp = strcmp(list->apps[mid].package, package);
+        if      (cmp == 0) return mid;
+        else if (cmp <  0) lo = mid + 1;
+        else               hi = mid - 1;
+    }
+    return -1;
+}
+
+///////////////////////////////////////////
+
+void app_list_free(app_list_t *ref_list) {
+    ref_list->apps    .free();
+    ref_list->prefixes.free();
+}
+
+///////////////////////////////////////////
+
+const char *app_prefix_text(const app_list_t *list, app_prefix_t prefix) {
+    return list->apps[prefix.app].package + prefix.offset;
+}
+
+int app_info_compare(const void *a, const void *b) {
+    return strcmp(((const app_info_t*)a)->package, ((const app_info_t*)b)->package);
+}
+
+int app_prefix_compare(const void *a, const void *b) {
+    int result = strcmp(((const app_prefix_t*)a)->text, ((const app_prefix_t*)b)->text);
+    return result != 0 ? result : ((const app_prefix_t*)a)->app - ((const app_prefix_t*)b)->app;
+}
+
+int app_index_compare(const void *a, const void *b) {
+    return *(const int32_t*)a - *(const int32_t*)b;
 }
 
 ///////////////////////////////////////////
 
 bool app_launcher_start(app_launcher_t *launcher, const char *device_id, const char *package) {
-    if (launcher->state == app_launcher_state_launching ||
-        launcher->state == app_launcher_state_polling_pid)
+    if (launcher->state == app_launcher_state_launching)
         return false;
 
     launcher->state = app_launcher_state_launching;
@@ -143,70 +366,31 @@ bool app_launcher_start(app_launcher_t *launcher, const char *device_id, const c
 
 int app_launcher_thread(void* arg) {
     app_launcher_t *launcher = (app_launcher_t*)arg;
-    char command[512];
-    char buffer[256];
 
-    // Launch the app using monkey (finds launcher activity automatically)
-    snprintf(command, sizeof(command),
-             "adb -s %s shell monkey -p %s -c android.intent.category.LAUNCHER 1",
-             launcher->device_id, launcher->package);
+    TRACE_THREAD("app_launcher_thread");
 
-    platform_process_result_t proc = platform_process_start(command);
-    if (!proc.success) {
+    // Launch the app using monkey (finds launcher activity automatically),
+    // the output is done once monkey is
+    const char *monkey_args[] = { "monkey", "-p", launcher->package, "-c", "android.intent.category.LAUNCHER", "1", nullptr };
+    char *monkey_output = adb_shell_output(launcher->device_id, monkey_args);
+    if (monkey_output == nullptr) {
         launcher->state = app_launcher_state_error;
         return -1;
     }
-
-    // Wait for monkey to finish
-    while (platform_process_is_running(proc.process)) {
-        platform_sleep_ms(10);
-    }
-    platform_process_cleanup(proc.process);
-
-    // Now poll for PID
-    launcher->state = app_launcher_state_polling_pid;
-
-    snprintf(command, sizeof(command), "adb -s %s shell pidof %s",
-             launcher->device_id, launcher->package);
-
-    // Poll for up to 5 seconds
-    for (int attempt = 0; attempt < 50; attempt++) {
-        proc = platform_process_start(command);
-        if (!proc.success) {
-            platform_sleep_ms(100);
-            continue;
-        }
-
-        // Wait for pidof to finish and read output
-        while (true) {
-            int32_t available = platform_pipe_peek(proc.stdout_pipe);
-            if (available <= 0) {
-                if (!platform_process_is_running(proc.process)) {
-                    break;
-                }
-                platform_sleep_ms(1);
-                continue;
-            }
-
-            int32_t read = platform_pipe_read(proc.stdout_pipe, buffer, sizeof(buffer) - 1);
-            if (read > 0) {
-                buffer[read] = '\0';
-                // pidof returns space-separated PIDs if multiple, take the first
-                int pid = 0;
-                if (sscanf(buffer, "%d", &pid) == 1 && pid > 0) {
-                    launcher->pid = (uint16_t)pid;
-                    platform_process_cleanup(proc.process);
-                    launcher->state = app_launcher_state_finished;
-                    return 1;
-                }
-            }
-        }
-
-        platform_process_cleanup(proc.process);
-        platform_sleep_ms(100);
+    free(monkey_output);
+
+    // The logcat thread catches the process starting, but an app that was
+    // already running just comes to the front, so ask once for that case
+    const char *pidof_args[] = { "pidof", launcher->package, nullptr };
+    char *output = adb_shell_output(launcher->device_id, pidof_args);
+    if (output != nullptr) {
+        // pidof returns space-separated PIDs if multiple, take the first
+        int pid = 0;
+        if (sscanf(output, "%d", &pid) == 1 && pid > 0)
+            launcher->pid = (uint16_t)pid;
+        free(output);
     }
 
-    // Timed out waiting for PID
     launcher->state = app_launcher_state_finished;
     return 1;
 }
@@ -3,6 +3,8 @@
 #include "array.h"
 #include "platform.h"
 
+#include <atomic>
+
 ///////////////////////////////////////////
 
 enum app_finder_state_ {
@@ -16,32 +18,69 @@ struct app_info_t {
     char package[256];
 };
 
+// Where one of a package's dot separated parts starts, so typing "chrome"
+// finds com.android.chrome. Sorted by the text from there on.
+struct app_prefix_t {
+    int32_t     app;
+    int32_t     offset;
+    const char *text; // Into the list's apps, which don't move once indexed
+};
+
+// A sorted package list and its prefix index. The finder thread builds a
+// new one for every change and never touches it again once it's published.
+struct app_list_t {
+    array_t<app_info_t>   apps;
+    array_t<app_prefix_t> prefixes;
+};
+
+struct app_finder_job_t;
+
+// Package lists are cached on disk per device, so they show up straight
+// away, and get refreshed in the background.
 struct app_finder_t {
-    app_finder_state_    state;
-    array_t<app_info_t>  apps;
-    platform_thread_t    thread;
-    char                 device_id[64];
+    std::atomic<app_finder_state_> state;
+    // Newest list from the finder thread that the UI hasn't picked up yet
+    std::atomic<app_list_t*>       published;
+    // The UI thread's copy, updated by app_finder_update
+    app_list_t                     list;
+    char                           device_id[64];
+    // The current refresh. Ones for a device we've switched away from
+    // can't publish any more, and get joined once they're done.
+    app_finder_job_t              *job;
+    array_t<app_finder_job_t*>     stale;
+    // The last list published, so a refresh that finds the same packages
+    // doesn't hand the UI a copy
+    app_list_t                     known;
+    platform_mutex_t               job_mutex; // Guards job, known, and publishing
 };
 
-bool app_finder_start  (app_finder_t *out_finder, const char *device_id);
-void app_finder_destroy(app_finder_t *ref_finder);
+// Loads device_id's cached list if it's a different device, and asks it for
+// the current one. Cheap to call again, it won't start a second refresh.
+bool    app_finder_start  (app_finder_t *ref_finder, const char *device_id);
+// Picks up the newest list, returns true if it changed, and joins any stale
+// refreshes that have finished. UI thread only.
+bool    app_finder_update (app_finder_t *ref_finder);
+void    app_finder_destroy(app_finder_t *ref_finder);
+// Apps with a dot separated part starting with prefix, in package order.
+// Fills out_apps with indices into list->apps.
+void    app_list_search   (const app_list_t *list, const char *prefix, array_t<int32_t> *out_apps);
+int32_t app_list_find     (const app_list_t *list, const char *package);
 
 ///////////////////////////////////////////
 
 enum app_launcher_state_ {
     app_launcher_state_none,
     app_launcher_state_launching,
-    app_launcher_state_polling_pid,
     app_launcher_state_finished,
     app_launcher_state_error
 };
 
 struct app_launcher_t {
-    app_launcher_state_ state;
-    platform_thread_t   thread;
-    char                device_id[64];
-    char                package[256];
-    uint16_t            pid;
+    std::atomic<app_launcher_state_> state; // Set after pid
+    platform_thread_t                thread;
+    char                             device_id[64];
+    char                             package[256];
+    uint16_t                         pid;
 };
 
 bool app_launcher_start(app_launcher_t *launcher, const char *device_id, const char *package);
@@ -0,0 +1,248 @@
+#include "bitmap.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <bit>
+
+///////////////////////////////////////////
+
+const int32_t  bitmap_chunk_words = (1 << bitmap_chunk_bits) / 64;
+const int64_t  bitmap_low_mask    = (1 << bitmap_chunk_bits) - 1;
+
+bool    bitmap_chunk_has    (const bitmap_chunk_t *chunk, uint16_t low);
+void    bitmap_chunk_to_bits(bitmap_chunk_t *ref_chunk);
+void    bitmap_chunk_to_list(bitmap_chunk_t *ref_chunk);
+int32_t bitmap_chunk_recount(bitmap_chunk_t *ref_chunk);
+void    bitmap_chunk_free   (bitmap_chunk_t *ref_chunk);
+
+///////////////////////////////////////////
+
+bool bitmap_chunk_has(const bitmap_chunk_t *chunk, uint16_t low) {
+	if (chunk->bits != nullptr)
+		return (chunk->bits[low >> 6] >> (low & 63)) & 1;
+
+	int32_t l = 0, r = chunk->count - 1;
+	while (l <= r) {
+		int32_t mid = (l + r) / 2;
+		if      (chunk->list[mid] < low) l = mid + 1;
+		else if (chunk->list[mid] > low) r = mid - 1;
+		else return true;
+	}
+	return false;
+}
+
+///////////////////////////////////////////
+
+void bitmap_chunk_to_bits(bitmap_chunk_t *ref_chunk) {
+	if (ref_chunk->bits != nullptr) return;
+	ref_chunk->bits = (uint64_t*)calloc(bitmap_chunk_words, sizeof(uint64_t));
+	for (int32_t i = 0; i < ref_chunk->count; i++)
+		ref_chunk->bits[ref_chunk->list[i] >> 6] |= 1ull << (ref_chunk->list[i] & 63);
+	free(ref_chunk->list);
+	ref_chunk->list     = nullptr;
+	ref_chunk->capacity = 0;
+}
+
+///////////////////////////////////////////
+
+void bitmap_chunk_to_list(bitmap_chunk_t *ref_chunk) {
+	if (ref_chunk->bits == nullptr) return;
+	ref_chunk->capacity = ref_chunk->count;
+	ref_chunk->list     = (uint16_t*)malloc((ref_chunk->capacity > 0 ? ref_chunk->capacity : 1) * sizeof(uint16_t));
+	int32_t at = 0;
+	for (int32_t w = 0; w < bitmap_chunk_words; w++) {
+		for (uint64_t word = ref_chunk->bits[w]; word != 0; word &= word - 1)
+			ref_chunk->list[at++] = (uint16_t)(w * 64 + std::countr_zero(word));
+	}
+	free(ref_chunk->bits);
+	ref_chunk->bits = nullptr;
+}
+
+///////////////////////////////////////////
+
+// Counts the bits again after words were changed in bulk, and goes back to
+// a list if they've thinned out. Returns how much the count changed by.
+int32_t bitmap_chunk_recount(bitmap_chunk_t *ref_chunk) {
+	int32_t count = 0;
+	for (int32_t w = 0; w < bitmap_chunk_words; w++)
+		count += std::popcount(ref_chunk->bits[w]);
+	int32_t change = count - ref_chunk->count;
+	ref_chunk->count = count;
+	if (count <= bitmap_list_max)
+		bitmap_chunk_to_list(ref_chunk);
+	return change;
+}
+
+///////////////////////////////////////////
+
+void bitmap_chunk_free(bitmap_chunk_t *ref_chunk) {
+	free(ref_chunk->list);
+	free(ref_chunk->bits);
+	*ref_chunk = {};
+}
+
+///////////////////////////////////////////
+
+void bitmap_add(bitmap_t *ref_bitmap, int64_t id) {
+	int32_t c = (int32_t)(id >> bitmap_chunk_bits);
+	while (ref_bitmap->chunks.count <= c) ref_bitmap->chunks.add({});
+
+	bitmap_chunk_t &chunk = ref_bitmap->chunks[c];
+	uint16_t        low   = (uint16_t)(id & bitmap_low_mask);
+	if (chunk.bits == nullptr && chunk.count > 0 && chunk.list[chunk.count - 1] >= low) return;
+	if (chunk.bits == nullptr && chunk.count == bitmap_list_max) bitmap_chunk_to_bits(&chunk);
+
+	if (chunk.bits != nullptr) {
+		uint64_t bit = 1ull << (low & 63);
+		if (chunk.bits[low >> 6] & bit) return;
+		chunk.bits[low >> 6] |= bit;
+	} else {
+		if (chunk.count == chunk.capacity) {
+			chunk.capacity = chunk.capacity < 16 ? 16 : chunk.capacity * 2;
+			chunk.list     = (uint16_t*)realloc(chunk.list, chunk.capacity * sizeof(uint16_t));
+		}
+		chunk.list[chunk.count] = low;
+	}
+	chunk.count       += 1;
+	ref_bitmap->count += 1;
+}
+
+///////////////////////////////////////////
+
+bool bitmap_has(const bitmap_t *bitmap, int64_t id) {
+	int64_t c = id >> bitmap_chunk_bits;
+	if (id < 0 || c >= bitmap->chunks.count) return false;
+	return bitmap_chunk_has(&bitmap->chunks[(int32_t)c], (uint16_t)(id & bitmap_low_mask));
+}
+
+///////////////////////////////////////////
+
+int64_t bitmap_next(const bitmap_t *bitmap, int64_t from) {
+	if (from < 0) from = 0;
+	for (int64_t c = from >> bitmap_chunk_bits; c < bitmap->chunks.count; c++) {
+		const bitmap_chunk_t &chunk = bitmap->chunks[(int32_t)c];
+		int32_t low  = c == (from >> bitmap_chunk_bits) ? (int32_t)(from & bitmap_low_mask) : 0;
+		int64_t base = c << bitmap_chunk_bits;
+		if (chunk.count == 0) continue;
+
+		if (chunk.bits != nullptr) {
+			uint64_t word = chunk.bits[low >> 6] & (~0ull << (low & 63));
+			for (int32_t w = low >> 6; ; ) {
+				if (word != 0) return base + w * 64 + std::countr_zero(word);
+				if (++w == bitmap_chunk_words) break;
+				word = chunk.bits[w];
+			}
+		} else {
+			// First one at or after low
+			int32_t l = 0, r = chunk.count;
+			while (l < r) {
+				int32_t mid = (l + r) / 2;
+				if (chunk.list[mid] < low) l = mid + 1;
+				else                       r = mid;
+			}
+			if (l < chunk.count) return base + chunk.list[l];
+		}
+	}
+	return -1;
+}
+
+///////////////////////////////////////////
+
+void bitmap_or(bitmap_t *ref_bitmap, const bitmap_t *other) {
+	while (ref_bitmap->chunks.count < other->chunks.count) ref_bitmap->chunks.add({});
+
+	for (int32_t c = 0; c < other->chunks.count; c++) {
+		const bitmap_chunk_t &from = other->chunks[c];
+		bitmap_chunk_t       &to   = ref_bitmap->chunks[c];
+		if (from.count == 0) continue;
+
+		if (to.bits != nullptr || from.bits != nullptr || to.count + from.count > bitmap_list_max) {
+			bitmap_chunk_to_bits(&to);
+			if (from.bits != nullptr) {
+				for (int32_t w = 0; w < bitmap_chunk_words; w++)
+					to.bits[w] |= from.bits[w];
+			} else {
+				for (int32_t i = 0; i < from.count; i++)
+					to.bits[from.list[i] >> 6] |= 1ull << (from.list[i] & 63);
+			}
+			ref_bitmap->count += bitmap_chunk_recount(&to);
+			continue;
+		}
+
+		// Both short lists, merged in order
+		int32_t   capacity = to.count + from.count;
+		uint16_t *list     = (uint16_t*)malloc(capacity * sizeof(uint16_t));
+		int32_t   a = 0, b = 0, count = 0;
+		while (a < to.count || b < from.count) {
+			if      (b == from.count || (a < to.count && to.list[a] < from.list[b])) list[count++] = to.list[a++];
+			else if (a == to.count   || from.list[b] < to.list[a])                  list[count++] = from.list[b++];
+			else { list[count++] = to.list[a++]; b++; }
+		}
+		free(to.list);
+		ref_bitmap->count += count - to.count;
+		to.list     = list;
+		to.count    = count;
+		to.capacity = capacity;
+	}
+}
+
+///////////////////////////////////////////
+
+void bitmap_andnot(bitmap_t *ref_bitmap, const bitmap_t *other) {
+	int32_t chunk_count = ref_bitmap->chunks.count < other->chunks.count ? ref_bitmap->chunks.count : other->chunks.count;
+	for (int32_t c = 0; c < chunk_count; c++) {
+		const bitmap_chunk_t &without = other->chunks[c];
+		bitmap_chunk_t       &chunk   = ref_bitmap->chunks[c];
+		if (chunk.count == 0 || without.count == 0) continue;
+
+		if (chunk.bits != nullptr) {
+			if (without.bits != nullptr) {
+				for (int32_t w = 0; w < bitmap_chunk_words; w++)
+					chunk.bits[w] &= ~without.bits[w];
+			} else {
+				for (int32_t i = 0; i < without.count; i++)
+					chunk.bits[without.list[i] >> 6] &= ~(1ull << (without.list[i] & 63));
+			}
+			ref_bitmap->count += bitmap_chunk_recount(&chunk);
+			continue;
+		}
+
+		int32_t count = 0;
+		for (int32_t i = 0; i < chunk.count; i++) {
+			if (!bitmap_chunk_has(&without, chunk.list[i]))
+				chunk.list[count++] = chunk.list[i];
+		}
+		ref_bitmap->count -= chunk.count - count;
+		chunk.count = count;
+	}
+}
+
+///////////////////////////////////////////
+
+size_t bitmap_memory(const bitmap_t *bitmap) {
+	size_t result = (size_t)bitmap->chunks.capacity * sizeof(bitmap_chunk_t);
+	for (int32_t c = 0; c < bitmap->chunks.count; c++) {
+		const bitmap_chunk_t &chunk = bitmap->chunks[c];
+		result += chunk.bits != nullptr
+			? bitmap_chunk_words * sizeof(uint64_t)
+			: chunk.capacity     * sizeof(uint16_t);
+	}
+	return result;
+}
+
+///////////////////////////////////////////
+
+void bitmap_clear(bitmap_t *ref_bitmap) {
+	for (int32_t c = 0; c < ref_bitmap->chunks.count; c++)
+		bitmap_chunk_free(&ref_bitmap->chunks[c]);
+	ref_bitmap->chunks.clear();
+	ref_bitmap->count = 0;
+}
+
+///////////////////////////////////////////
+
+void bitmap_free(bitmap_t *ref_bitmap) {
+	bitmap_clear(ref_bitmap);
+	ref_bitmap->chunks.free();
+	*ref_bitmap = {};
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// A compressed set of 64 bit ids, the way Roaring bitmaps do it. Ids are
+// split into chunks of 65536 by their high bits, and each chunk keeps its
+// low 16 bits as a sorted list while it has only a few, or as 1024 words of
+// bits once it has more than bitmap_list_max. Sets combine chunk by chunk.
+// Like array_t it's a POD struct, so it needs an explicit bitmap_free.
+//
+//	bitmap_t a = {}, b = {};
+//	bitmap_add(&a, 1); bitmap_add(&a, 70000);
+//	bitmap_add(&b, 70000);
+//	bitmap_andnot(&a, &b);
+//	for (int64_t id = bitmap_next(&a, 0); id >= 0; id = bitmap_next(&a, id + 1))
+//		printf("%lld\n", id); // 1
+//	bitmap_free(&a);
+//	bitmap_free(&b);
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "array.h"
+
+///////////////////////////////////////////
+
+const int32_t bitmap_chunk_bits = 16;
+// Past this many a chunk's list takes more room than its bits would
+const int32_t bitmap_list_max   = 4096;
+
+struct bitmap_chunk_t {
+	uint16_t *list;     // Sorted, while count <= bitmap_list_max
+	uint64_t *bits;     // 1024 words once it's past that, and list is null
+	int32_t   count;
+	int32_t   capacity; // Of list
+};
+
+struct bitmap_t {
+	array_t<bitmap_chunk_t> chunks; // By id >> bitmap_chunk_bits, empty ones too
+	int64_t                 count;
+};
+
+// Ids have to come in ascending order
+void    bitmap_add   (      bitmap_t *ref_bitmap, int64_t id);
+bool    bitmap_has   (const bitmap_t *bitmap, int64_t id);
+// The first id from on, or -1 when there are none
+int64_t bitmap_next  (const bitmap_t *bitmap, int64_t from);
+// ref_bitmap gets every id in either
+void    bitmap_or    (      bitmap_t *ref_bitmap, const bitmap_t *other);
+// ref_bitmap loses the ids that are in other
+void    bitmap_andnot(      bitmap_t *ref_bitmap, const bitmap_t *other);
+size_t  bitmap_memory(const bitmap_t *bitmap);
+// Empties it
+void    bitmap_clear (      bitmap_t *ref_bitmap);
+void    bitmap_free  (      bitmap_t *ref_bitmap);
@@ -0,0 +1,135 @@
+#pragma once
+
+// block_array_t keeps items in fixed size blocks that never move once
+// they're allocated, found through a table of block pointers. Appending
+// never copies what's already there, pointers to items stay good until
+// they're removed, and indices are 64 bit. Like array_t it's a POD struct,
+// so it needs an explicit .free().
+//
+// It isn't thread safe, so callers hold a lock for reading as well as
+// writing when it's shared.
+//
+//	block_array_t<int64_t> items = {};
+//	items.add(1);
+//	items.add(2);
+//	items.add_front(1);
+//	items[0] = 0;
+//	for (int64_t i = 0; i < items.count; i++)
+//		printf("%lld\n", items[i]);
+//	items.free();
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+///////////////////////////////////////////
+
+template <typename T, int32_t block_bits = 16>
+struct block_array_t {
+	static const int64_t block_size = 1ll << block_bits;
+	static const int64_t block_mask = block_size - 1;
+
+	T      **blocks;       // table_size pointers, null for blocks not allocated
+	int64_t  table_size;
+	int64_t  first;        // Position of item 0 in the blocks
+	int64_t  count;
+	int64_t  block_count;  // Blocks allocated
+
+	T      &operator[](int64_t i) const { int64_t at = first + i; return blocks[at >> block_bits][at & block_mask]; }
+	T      &last      ()          const { return (*this)[count - 1]; }
+	size_t  memory    ()          const { return (size_t)block_count * block_size * sizeof(T) + (size_t)table_size * sizeof(T*); }
+
+	int64_t add(const T &item) {
+		int64_t at = first + count;
+		reserve(at + 1);
+		blocks[at >> block_bits][at & block_mask] = item;
+		count += 1;
+		return count - 1;
+	}
+
+	void pop     () { count -= 1; }
+	void clear   () { truncate(0); }
+
+	// Drops items from to_count on, and frees the blocks they leave empty
+	void truncate(int64_t to_count) {
+		if (to_count >= count) return;
+		count = to_count;
+		for (int64_t b = (first + count + block_mask) >> block_bits; b < table_size; b++) {
+			if (blocks[b] == nullptr) continue;
+			::free(blocks[b]);
+			blocks[b]    = nullptr;
+			block_count -= 1;
+		}
+	}
+
+	// Makes room for item_count items ahead of item 0, for the caller to
+	// fill in, shifting the indices of everything there by item_count. Only
+	// block pointers get moved to make room.
+	void add_front(int64_t item_count) {
+		if (first < item_count) {
+			// pop() can leave a block allocated past the end
+			int64_t used = table_size;
+			while (used > 0 && blocks[used - 1] == nullptr) used--;
+			int64_t shift = ((item_count - first + block_mask) >> block_bits);
+			grow_table(used + shift);
+			T **table = (T**)calloc(table_size, sizeof(T*));
+			for (int64_t b = 0; b + shift < table_size; b++)
+				table[b + shift] = blocks[b];
+			set_table(table);
+			first += shift * block_size;
+		}
+		first -= item_count;
+		count += item_count;
+		for (int64_t b = first >> block_bits; b <= (first + item_count - 1) >> block_bits && item_count > 0; b++) {
+			if (blocks[b] == nullptr) alloc_block(b);
+		}
+	}
+
+	// Drops the first item_count items, and frees the blocks they leave empty
+	void remove_front(int64_t item_count) {
+		if (item_count > count) item_count = count;
+		int64_t from_block = first >> block_bits;
+		first += item_count;
+		count -= item_count;
+		for (int64_t b = from_block; b < (first >> block_bits); b++) {
+			if (blocks[b] == nullptr) continue;
+			::free(blocks[b]);
+			blocks[b]    = nullptr;
+			block_count -= 1;
+		}
+	}
+
+	void free() {
+		for (int64_t b = 0; b < table_size; b++)
+			::free(blocks[b]);
+		::free(blocks);
+		*this = {};
+	}
+
+	// Makes sure there's a block for the position just below end
+	void reserve(int64_t end) {
+		grow_table((end + block_mask) >> block_bits);
+		int64_t last_block = (end - 1) >> block_bits;
+		if (end > 0 && blocks[last_block] == nullptr) alloc_block(last_block);
+	}
+
+	void grow_table(int64_t block_total) {
+		if (block_total <= table_size) return;
+		int64_t size = table_size < 16 ? 16 : table_size;
+		while (size < block_total) size *= 2;
+		T **table = (T**)calloc(size, sizeof(T*));
+		if (blocks != nullptr) memcpy(table, blocks, table_size * sizeof(T*));
+		set_table(table);
+		table_size = size;
+	}
+
+	void alloc_block(int64_t b) {
+		blocks[b]    = (T*)malloc(block_size * sizeof(T));
+		block_count += 1;
+	}
+
+	void set_table(T **table) {
+		::free(blocks);
+		blocks = table;
+	}
+};
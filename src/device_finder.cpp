@@ -1,18 +1,23 @@
 #include "device_finder.h"
+#include "trace.h"
 
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 
 ///////////////////////////////////////////
 
-int device_finder_thread(void* arg);
+int  device_finder_thread (void* arg);
+void device_finder_publish(device_finder_t *ref_finder, device_list_t *list);
 
 ///////////////////////////////////////////
 
-bool device_finder_start  (device_finder_t *out_finder) {
-    if (out_finder->state == device_finder_state_searching)
+bool device_finder_start  (device_finder_t *out_finder, void (*on_change)()) {
+    if (out_finder->thread != nullptr)
         return true;
-    out_finder->state = device_finder_state_searching;
+    out_finder->state     = device_finder_state_searching;
+    out_finder->on_change = on_change;
+    out_finder->run       = true;
 
 	out_finder->thread = platform_thread_create(device_finder_thread, out_finder);
 
@@ -27,9 +32,28 @@ bool device_finder_start  (device_finder_t *out_finder) {
 
 ///////////////////////////////////////////
 
+bool device_finder_update(device_finder_t *ref_finder) {
+    device_list_t *list = ref_finder->published.exchange(nullptr, std::memory_order_acquire);
+    if (list == nullptr) return false;
+
+    ref_finder->devices.free();
+    ref_finder->devices = list->devices;
+    free(list);
+    return true;
+}
+
+///////////////////////////////////////////
+
 void device_finder_destroy(device_finder_t *ref_finder) {
+    // The tracker never waits on the stream for long, so it'll notice this
+    ref_finder->run = false;
+    platform_thread_join(ref_finder->thread);
+    ref_finder->thread = nullptr;
+
+    device_finder_update(ref_finder);
     ref_finder->devices.free();
-    *ref_finder = {};
+    ref_finder->state     = device_finder_state_none;
+    ref_finder->on_change = nullptr;
 }
 
 ///////////////////////////////////////////
@@ -46,71 +70,107 @@ bool string_startswith(const char *a, const char *is) {
 
 ///////////////////////////////////////////
 
-int device_finder_thread(void* arg) {
-	device_finder_t *thread = (device_finder_t*)arg;
-	char buffer     [4096+1];
-	char line_buffer[4096+1];
-	int32_t line_buffer_pos = 0;
-
-	platform_process_result_t proc = platform_process_start("adb devices -l");
-	if (!proc.success) {
-        thread->state = device_finder_state_error;
-        return -1;
+device_list_t *device_list_parse(char *text) {
+    device_list_t *result = (device_list_t*)malloc(sizeof(device_list_t));
+    *result = {};
+
+    char *line_buffer = text;
+    while (*line_buffer != '\0') {
+        char *line_end = line_buffer + strcspn(line_buffer, "\r\n");
+        char *next     = *line_end == '\0' ? line_end : line_end + 1;
+        *line_end = '\0';
+
+        device_info_t info = {};
+        if (line_buffer[0] != '\0' &&
+            !string_startswith(line_buffer, "List") &&
+            !string_startswith(line_buffer, "*") &&
+            sscanf(line_buffer, "%63s", info.id) == 1) {
+
+            char    id     [64];
+            char    product[64];
+            char    device [64];
+            int32_t transport_id;
+            sscanf(line_buffer, "%63s device product:%63s model:%63s device:%63s transport_id:%d", id, product, info.model, device, &transport_id);
+
+            result->devices.add(info);
+        }
+        line_buffer = next;
 	}
+    return result;
+}
 
-    thread->devices.clear();
-
-    while (true) {
-		// Check if data is available
-		int32_t available = platform_pipe_peek(proc.stdout_pipe);
-		if (available <= 0) {
-			// No data available - check if process is done
-			if (!platform_process_is_running(proc.process)) {
-				break; // Process done AND no more data
-			}
-			platform_sleep_ms(1);
-			continue;
-		}
-
-		// Read the data from stdout, and add it to the logs.
-		int32_t read = platform_pipe_read(proc.stdout_pipe, buffer, 4096);
-		if (read <= 0) {
-            platform_sleep_ms(1);
-            continue;
-        }
+///////////////////////////////////////////
 
-		buffer[read] = '\0';
-        for (int i = 0; i < read; ++i) {
-			if (buffer[i] == '\n' || buffer[i] == '\r' || line_buffer_pos == 4096) {
-                if (line_buffer_pos == 0) continue;
-				line_buffer[line_buffer_pos] = '\0';
-				line_buffer_pos = 0;
-
-                if (string_startswith(line_buffer, "List")) continue;
-                if (string_startswith(line_buffer, "*")) continue;
-
-                device_info_t info = {};
-                if (sscanf(line_buffer, "%s", info.id) == 0) {
-                    thread->state = device_finder_state_error;
-                    return -1;
-                }
-
-                char    id     [64];
-                char    product[64];
-                char    model  [64];
-                char    device [64];
-                int32_t transport_id;
-                sscanf(line_buffer, "%s device product:%s model:%s device:%s transport_id:%d", id, product, info.model, device, &transport_id);
-
-                thread->devices.add(info);
-			} else {
-				line_buffer[line_buffer_pos++] = buffer[i];
-			}
-		}
-	}
+void device_finder_publish(device_finder_t *ref_finder, device_list_t *list) {
+    // If the UI never picked up the last list, nobody else can have it
+    device_list_t *unseen = ref_finder->published.exchange(list, std::memory_order_acq_rel);
+    if (unseen != nullptr) {
+        unseen->devices.free();
+        free(unseen);
+    }
+    if (ref_finder->on_change != nullptr)
+        ref_finder->on_change();
+}
+
+///////////////////////////////////////////
+
+int device_finder_thread(void* arg) {
+	device_finder_t *finder = (device_finder_t*)arg;
+	char    buffer[16384 + 1];
+	int32_t buffer_pos = 0;
+
+	TRACE_THREAD("device_finder_thread");
+
+    while (finder->run) {
+        // The subscription only ends if the adb server goes away. Let the
+        // UI know the list is stale, and try again in a moment.
+        if (finder->stream.socket == nullptr && finder->stream.process == nullptr) {
+            if (!adb_track_devices(&finder->stream)) {
+                finder->state = device_finder_state_error;
+                for (int32_t i = 0; i < 10 && finder->run; i++)
+                    platform_sleep_ms(100);
+                continue;
+            }
+            buffer_pos = 0;
+        }
 
-    platform_process_cleanup(proc.process);
+        int32_t read = adb_stream_read(&finder->stream, buffer + buffer_pos, (int32_t)sizeof(buffer) - 1 - buffer_pos, 100);
+        if (read < 0) {
+            // No server, so no devices we can reach either
+            adb_stream_close(&finder->stream);
+            device_list_t *empty = (device_list_t*)malloc(sizeof(device_list_t));
+            *empty = {};
+            device_finder_publish(finder, empty);
+            finder->state = device_finder_state_error;
+            continue;
+        }
+        buffer_pos += read;
+
+        // Each message is the whole list, prefixed with its length in hex
+        int32_t at = 0;
+        while (buffer_pos - at >= 4) {
+            char header[5] = {};
+            memcpy(header, buffer + at, 4);
+            int32_t len = (int32_t)strtol(header, nullptr, 16);
+            if (len < 0 || len > (int32_t)sizeof(buffer) - 5) {
+                // Not something we understand, start over
+                adb_stream_close(&finder->stream);
+                break;
+            }
+            if (buffer_pos - at - 4 < len) break;
+
+            char saved = buffer[at + 4 + len];
+            buffer[at + 4 + len] = '\0';
+            TRACE_ZONE("device_finder update");
+            device_finder_publish(finder, device_list_parse(buffer + at + 4));
+            buffer[at + 4 + len] = saved;
+            finder->state = device_finder_state_finished;
+            at += 4 + len;
+        }
+        memmove(buffer, buffer + at, buffer_pos - at);
+        buffer_pos -= at;
+    }
 
-    thread->state = device_finder_state_finished;
+    adb_stream_close(&finder->stream);
     return 1;
-}
\ No newline at end of file
+}
@@ -2,6 +2,9 @@
 
 #include "array.h"
 #include "platform.h"
+#include "adb.h"
+
+#include <atomic>
 
 ///////////////////////////////////////////
 
@@ -17,11 +20,28 @@ struct device_info_t {
     char model[64];
 };
 
-struct device_finder_t {
-    device_finder_state_   state;
+// A snapshot of the connected devices. The tracker thread builds a new one
+// for every change and never touches it again once it's published.
+struct device_list_t {
     array_t<device_info_t> devices;
-	platform_thread_t      thread;
 };
 
-bool device_finder_start  (device_finder_t *out_finder);
-void device_finder_destroy(device_finder_t *ref_finder);
\ No newline at end of file
+// Keeps a device tracking subscription open with the adb server, so the
+// device list follows devices as they're plugged and unplugged.
+struct device_finder_t {
+    std::atomic<device_finder_state_> state;
+    // Newest list from the tracker that the UI hasn't picked up yet
+    std::atomic<device_list_t*>       published;
+    // The UI thread's copy, updated by device_finder_update
+    array_t<device_info_t>            devices;
+    platform_thread_t                 thread;
+    adb_stream_t                      stream;
+    std::atomic<bool>                 run;
+    void                            (*on_change)();
+};
+
+// on_change gets called from the tracker thread whenever there's a new list
+bool device_finder_start  (device_finder_t *out_finder, void (*on_change)());
+// Picks up the newest device list, returns true if it changed. UI thread only.
+bool device_finder_update (device_finder_t *ref_finder);
+void device_finder_destroy(device_finder_t *ref_finder);
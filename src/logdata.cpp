@@ -1,30 +1,116 @@
 
 #include "logdata.h"
+#include "adb.h"
+#include "lz.h"
+#include "perf.h"
+#include "trace.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <atomic>
 
 ///////////////////////////////////////////
 
 int           logcat_thread    (void* arg);
-logcat_line_t logcat_parse_line(char *line_buffer, char *out_tag);
+int           logcat_backfill_thread(void* arg);
+int           logcat_names_thread(void* arg);
+int           logcat_pack_thread (void* arg);
+logcat_line_t logcat_parse_line(char *line_buffer, char *out_tag, const char **out_text);
+uint64_t      logcat_line_time (int32_t month, int32_t day, int32_t hour, int32_t minute, int32_t second, int32_t millisecond);
+uint64_t      logcat_line_key  (const logcat_line_t *line, const char *text);
+void          logcat_reconnect (logcat_thread_t *ref_thread, const logcat_line_t *last, const logcat_filter_t *filter, char *out_since, size_t since_size);
+void          logcat_truncate  (logcat_thread_t *ref_thread, uint64_t from_time, logcat_line_t *out_last, uint64_t *out_recent_keys, int32_t recent_max);
+void          logcat_add_marker(logcat_thread_t *ref_thread, const char *text);
+void          logcat_add_line  (logcat_data_t *ref_data, logcat_line_t *ref_line, const char *text);
+void          logcat_add_text  (logcat_data_t *ref_data, logcat_line_t *ref_line, const char *text);
+bool          logcat_collapse  (logcat_data_t *ref_data, const logcat_line_t *line, const char *text);
+void          logcat_repeat_drop(logcat_data_t *ref_data, const logcat_repeat_t *repeat);
+void          logcat_segment_free (logcat_data_t *ref_data, int32_t segment);
+void          logcat_segments_clear(logcat_data_t *ref_data);
+uint64_t      logcat_name_hash     (const char *name);
+void          logcat_names_table_add(logcat_data_t *ref_data, int32_t index);
+void          logcat_names_compact (logcat_data_t *ref_data);
+void          logcat_index_add     (logcat_data_t *ref_data, const logcat_line_t *line, int64_t line_idx);
+void          logcat_index_free    (logcat_data_t *ref_data);
+void          logcat_index_trim    (logcat_data_t *ref_data);
+void          logcat_index_prepend (logcat_data_t *ref_data, const logcat_data_t *history, int64_t keep);
+void          logcat_events_trim   (logcat_data_t *ref_data, int64_t drop_front);
+void          logcat_events_prepend(logcat_data_t *ref_data, const logcat_data_t *history, int64_t keep);
+template <int32_t bits> int64_t logcat_ids_find   (const block_array_t<int64_t, bits> *ids, int64_t id);
+template <int32_t bits> void    logcat_ids_trim   (block_array_t<int64_t, bits> *ref_ids, int64_t from, int64_t to);
+template <int32_t bits> void    logcat_ids_prepend(block_array_t<int64_t, bits> *ref_ids, const block_array_t<int64_t, bits> *history, int64_t keep, int64_t base);
+bool          logcat_spill_next    (logcat_data_t *ref_data);
+void          logcat_spill_prefetch(logcat_data_t *ref_data, int32_t from_segment);
+bool          logcat_parse_banner(const char *text, int32_t *ref_buffer);
+void          logcat_event_tags_load (logcat_thread_t *ref_thread);
+void          logcat_parse_event_tags(logcat_data_t *ref_data, char *text);
+void          logcat_decode_event    (logcat_data_t *ref_data, const logcat_line_t *line, const char *text);
+int32_t       logcat_event_find      (const logcat_data_t *data, const char *tag);
+void          logcat_proc_line (logcat_thread_t *ref_thread, const char *tag, const char *text);
+void          logcat_set_process(logcat_data_t *ref_data, uint16_t pid, const char *name);
+void          logcat_set_thread (logcat_data_t *ref_data, uint16_t pid, uint16_t tid, const char *name);
+void          logcat_parse_ps  (logcat_data_t *ref_data, char *text);
+
+const char *logcat_buffer_names[logcat_buffer_count] = { "", "main", "system", "crash", "radio", "events", "kernel", "security", "stats" };
+
+// A segment holds a couple thousand lines, the newest few stay uncompressed
+// since that's where the live tail is being read and appended, and reading
+// anywhere else only keeps a handful unpacked at once.
+const int32_t logcat_segment_size  = 256 * 1024;
+const int32_t logcat_segments_hot  = 4;
+const int32_t logcat_segment_cache = 16;
+const int32_t logcat_spill_ahead   = 4;
+// How far back collapse looks for a line to count a new one against. Far
+// enough for a few threads spamming at once.
+const int32_t logcat_collapse_window = 16;
+// Packed text kept in memory when LOGPANTHER_MEMORY_MB doesn't say
+const size_t  logcat_packed_max_default = 256ull * 1024 * 1024;
+
+void            (*logcat_on_wake)()   = nullptr;
+std::atomic<bool> logcat_wake_pending = false;
 
 ///////////////////////////////////////////
 
 void logcat_create (logcat_data_t *out_data) {
 	*out_data = {};
 	out_data->lines_mutex = platform_mutex_create();
+
+	const char *memory_mb = getenv("LOGPANTHER_MEMORY_MB");
+	out_data->packed_max = memory_mb != nullptr && memory_mb[0] != '\0'
+		? (size_t)strtoull(memory_mb, nullptr, 10) * 1024 * 1024
+		: logcat_packed_max_default;
 }
 
 ///////////////////////////////////////////
 
 void logcat_destroy(logcat_data_t *ref_data) {
-	for (int i = 0; i < ref_data->lines.count; ++i)
-		free(ref_data->lines[i].line);
+	logcat_segments_clear(ref_data);
+	ref_data->segments     .free();
+	ref_data->segment_cache.free();
+	platform_file_close(ref_data->spill_file);
 	for (int i = 0; i < ref_data->tags.count; ++i)
 		free(ref_data->tags[i]);
-	ref_data->lines.free();
-	ref_data->tags .free();
+	for (int i = 0; i < ref_data->names.count; ++i)
+		free(ref_data->names[i]);
+	ref_data->lines  .free();
+	ref_data->repeats.free();
+	pattern_tree_free(&ref_data->patterns);
+	ref_data->tags   .free();
+	ref_data->names  .free();
+	free(ref_data->names_table);
+	logcat_index_free(ref_data);
+	for (int32_t i = 0; i < ref_data->events.count; i++)
+		free(ref_data->events[i].tag);
+	for (int32_t i = 0; i < ref_data->field_names.count; i++)
+		free(ref_data->field_names[i]);
+	ref_data->events      .free();
+	ref_data->tag_events  .free();
+	ref_data->field_names .free();
+	ref_data->fields      .free();
+	ref_data->event_fields.free();
+	free(ref_data->pid_names);
+	free(ref_data->tid_names);
 	platform_mutex_destroy(ref_data->lines_mutex);
 
 	*ref_data = {};
@@ -32,83 +118,159 @@ void logcat_destroy(logcat_data_t *ref_data) {
 
 ///////////////////////////////////////////
 
-int32_t logcat_thread_start(const char *device_id, logcat_thread_t *out_thread, logcat_data_t *out_data){
+int32_t logcat_thread_start(const char *device_id, logcat_thread_t *out_thread, logcat_data_t *ref_data){
+	// Whatever the last device left goes, its spill file included
 	*out_thread = {};
-	*out_data   = {};
-	logcat_create(out_data);
-	out_thread->data = out_data;
+	logcat_destroy(ref_data);
+	logcat_create (ref_data);
+	out_thread->data = ref_data;
 	out_thread->run = true;
-	strncpy(out_data->src_id, device_id, sizeof(out_data->src_id));
+	strncpy(ref_data->src_id, device_id, sizeof(ref_data->src_id));
+	strncpy(out_thread->device_id, device_id, sizeof(out_thread->device_id) - 1);
 
-	char command[1024];
-	if (device_id == nullptr) {
-		snprintf(command, 1024, "adb logcat -T 1");
-	} else {
-		snprintf(command, 1024, "adb -s %s logcat -T 1", device_id);
-	}
-
-	platform_process_result_t proc = platform_process_start(command);
-	if (!proc.success) {
-		printf("Failed to start logcat process\n");
+	// Every buffer, with a banner each time it switches between them
+	const char *args[] = { "logcat", "-b", "all", "-D", "-T", "1", nullptr };
+	if (!adb_shell(device_id, args, &out_thread->stream)) {
+		printf("Failed to start logcat\n");
 		return -1;
 	}
+	out_thread->connected = true;
 
-	out_thread->process = proc.process;
-	out_thread->stdout_pipe = proc.stdout_pipe;
-
-	// Create thread to read from the child process' standard output
+	// Create thread to read logcat's output
 	out_thread->thread = platform_thread_create(logcat_thread, out_thread);
 
 	if (out_thread->thread == nullptr) {
 		printf("Failed to create logcat thread\n");
-		platform_process_cleanup(proc.process);
+		adb_stream_close(&out_thread->stream);
 		return -2;
 	}
 
+	// History is nice to have, so carry on without it if this fails
+	out_thread->backfilling     = true;
+	out_thread->backfill_thread = platform_thread_create(logcat_backfill_thread, out_thread);
+	if (out_thread->backfill_thread == nullptr)
+		out_thread->backfilling = false;
+
+	// Same for process and thread names
+	out_thread->names_thread = platform_thread_create(logcat_names_thread, out_thread);
+
+	// Without this the text just stays uncompressed
+	out_thread->pack_thread = platform_thread_create(logcat_pack_thread, out_thread);
+
 	return 1;
 }
 
 ///////////////////////////////////////////
 
 void logcat_thread_end(logcat_thread_t *ref_thread) {
-	if (ref_thread->run == false) return;
-
-	platform_process_terminate(ref_thread->process);
+	// The thread may have already stopped on its own when logcat ended, but
+	// it still needs joining and its stream closing.
+	if (ref_thread->thread == nullptr) return;
 
+	// The threads never wait on their streams for long, so they'll notice
 	ref_thread->run = false;
 	platform_thread_join(ref_thread->thread);
+	platform_thread_join(ref_thread->backfill_thread);
+	platform_thread_join(ref_thread->names_thread);
+	platform_thread_join(ref_thread->pack_thread);
+	ref_thread->thread          = nullptr;
+	ref_thread->backfill_thread = nullptr;
+	ref_thread->names_thread    = nullptr;
+	ref_thread->pack_thread     = nullptr;
+
+	adb_stream_close(&ref_thread->stream);
+	adb_stream_close(&ref_thread->backfill_stream);
+}
+
+///////////////////////////////////////////
+
+void logcat_thread_filter(logcat_thread_t *ref_thread, const logcat_filter_t *filter) {
+	platform_mutex_lock(ref_thread->data->lines_mutex);
+	ref_thread->filter         = *filter;
+	ref_thread->filter_changed = true;
+	platform_mutex_unlock(ref_thread->data->lines_mutex);
+}
+
+///////////////////////////////////////////
 
-	platform_process_cleanup(ref_thread->process);
+void logcat_thread_watch(logcat_thread_t *ref_thread, const char *package) {
+	platform_mutex_lock(ref_thread->data->lines_mutex);
+	strncpy(ref_thread->watch_package, package, sizeof(ref_thread->watch_package) - 1);
+	ref_thread->watch_pid = 0;
+	platform_mutex_unlock(ref_thread->data->lines_mutex);
 }
 
 ///////////////////////////////////////////
 
 bool logcat_from_file(logcat_data_t *out_data, const char *filename) {
+	TRACE_ZONE("logcat_from_file");
 	FILE *fp = fopen(filename, "r");
 	if (fp == nullptr) return false;
 
 	// Parse the file one line at a time
-	char line_buffer[4096];
-	char tag_buffer [4096];
+	char    line_buffer[4096];
+	char    tag_buffer [4096];
+	int32_t buffer = logcat_buffer_main;
 	while (fgets(line_buffer, 4096, fp) != nullptr) {
-		logcat_line_t line_data = logcat_parse_line(line_buffer, tag_buffer);
-		line_data.tag = logcat_get_tag(out_data, tag_buffer);
-		out_data->lines.add(line_data);
+		if (logcat_parse_banner(line_buffer, &buffer)) continue;
+		const char   *text;
+		logcat_line_t line_data = logcat_parse_line(line_buffer, tag_buffer, &text);
+		line_data.tag    = logcat_get_tag(out_data, tag_buffer);
+		line_data.buffer = line_data.severity != 0 ? buffer : logcat_buffer_none;
+		logcat_add_line(out_data, &line_data, text);
+
+		// There's no thread packing for us, and a big file shouldn't need
+		// all of its text unpacked at once
+		if (out_data->segment_open >= out_data->segment_unpacked + logcat_segments_hot)
+			while (logcat_pack_next(out_data)) {}
 	}
+	fclose(fp);
 	return true;
 }
 
 ///////////////////////////////////////////
 
-bool logcat_to_file(const logcat_data_t *data, const char *filename) {
+bool logcat_to_file(logcat_data_t *data, const char *filename) {
+	TRACE_ZONE("logcat_to_file");
 	FILE *fp = fopen(filename, "w");
 	if (fp == nullptr) return false;
 
-	for (int32_t i = 0; i < data->lines.count; i+=1) {
-		const logcat_line_t &line = data->lines[i];
+	// Banners like logcat's own, so loading it back knows the buffers. The
+	// lock is let go now and then, so a long history doesn't stall ingest
+	// while it's written. Trimming and backfill move lines while it's let
+	// go, so the place to pick up from is kept as a line id.
+	int32_t buffer = logcat_buffer_main;
+	int64_t id     = INT64_MIN;
+	while (true) {
+		platform_mutex_lock(data->lines_mutex);
+		int64_t i   = id < data->line_base ? 0 : id - data->line_base;
+		int64_t end = i + 4096 < data->lines.count ? i + 4096 : data->lines.count;
+		for (; i < end; i+=1) {
+			const logcat_line_t &line = data->lines[i];
+			const char          *text = logcat_line_text(data, &line);
 
-		if (line.severity == 0) fprintf(fp, "%s", line.line);
-		else                    fprintf(fp, "%02d-%02d %02d:%02d:%02d.%03d %5d %5d %c %s: %s", line.month, line.day, line.hour, line.minute, line.second, line.millisecond, line.pid, line.tid, line.severity, data->tags[line.tag], line.line);
+			if (line.buffer != logcat_buffer_none && line.buffer != buffer) {
+				buffer = line.buffer;
+				fprintf(fp, "--------- switch to %s\n", logcat_buffer_names[buffer]);
+			}
+			if (line.severity == 0) {
+				fprintf(fp, "%s", text);
+				continue;
+			}
+
+			// Collapsed copies go back out as lines. Only the first and
+			// latest times were kept, so the ones between get the first's.
+			const logcat_repeat_t *repeat = line.repeated ? logcat_line_repeat(data, i) : nullptr;
+			int64_t                copies = repeat != nullptr ? repeat->count : 1;
+			for (int64_t c = 0; c < copies; c++) {
+				const logcat_line_t &copy = c > 0 && c == copies - 1 ? repeat->last : line;
+				fprintf(fp, "%02d-%02d %02d:%02d:%02d.%03d %5d %5d %c %s: %s", copy.month, copy.day, copy.hour, copy.minute, copy.second, copy.millisecond, copy.pid, copy.tid, copy.severity, data->tags[copy.tag], text);
+			}
+		}
+		bool done = i >= data->lines.count;
+		id = data->line_base + i;
+		platform_mutex_unlock(data->lines_mutex);
+		if (done) break;
 	}
 
 	fclose(fp);
@@ -118,6 +280,7 @@ bool logcat_to_file(const logcat_data_t *data, const char *filename) {
 ///////////////////////////////////////////
 
 uint16_t logcat_get_tag(logcat_data_t *data, char *tag) {
+	TRACE_ZONE("logcat_get_tag");
 	for (size_t i = 0; i < data->tags.count; i++)
 	{
 		if (strcmp(data->tags[i], tag) == 0)
@@ -127,22 +290,700 @@ uint16_t logcat_get_tag(logcat_data_t *data, char *tag) {
 	char *new_tag = (char*)malloc(strlen(tag) + 1);
 	strcpy(new_tag, tag);
 	data->tags.add(new_tag);
+	data->tag_events.add(logcat_event_find(data, new_tag));
 	return data->tags.count - 1;
 }
 
 ///////////////////////////////////////////
 
+uint64_t logcat_name_hash(const char *name) {
+	uint64_t hash = 14695981039346656037ull;
+	for (const char *c = name; *c != '\0'; c++) {
+		hash ^= (uint8_t)*c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+///////////////////////////////////////////
+
+// Puts names[index] in the table, which stays at most half full so a probe
+// always finds an empty slot
+void logcat_names_table_add(logcat_data_t *ref_data, int32_t index) {
+	if (ref_data->names.count * 2 >= ref_data->names_table_size) {
+		free(ref_data->names_table);
+		ref_data->names_table_size = ref_data->names_table_size < 1024 ? 1024 : ref_data->names_table_size * 2;
+		ref_data->names_table      = (int32_t*)calloc(ref_data->names_table_size, sizeof(int32_t));
+		for (int32_t i = 0; i < ref_data->names.count; i++)
+			if (i != index) logcat_names_table_add(ref_data, i);
+	}
+	uint32_t mask = ref_data->names_table_size - 1;
+	uint32_t at   = (uint32_t)logcat_name_hash(ref_data->names[index]) & mask;
+	while (ref_data->names_table[at] != 0) at = (at + 1) & mask;
+	ref_data->names_table[at] = index + 1;
+}
+
+///////////////////////////////////////////
+
+// Drops the names no pid or tid has any more, which a capture running for
+// days piles up as processes come and go, and renumbers the rest
+void logcat_names_compact(logcat_data_t *ref_data) {
+	array_t<int32_t> remap = {};
+	for (int32_t i = 0; i < ref_data->names.count; i++) remap.add(-1);
+	remap[0] = 0;
+	for (int32_t id = 0; id <= UINT16_MAX; id++) {
+		if (ref_data->pid_names != nullptr) remap[ref_data->pid_names[id]]      = 0;
+		if (ref_data->tid_names != nullptr) remap[ref_data->tid_names[id].name] = 0;
+	}
+
+	int32_t count = 0;
+	for (int32_t i = 0; i < ref_data->names.count; i++) {
+		if (remap[i] < 0) {
+			free(ref_data->names[i]);
+			continue;
+		}
+		remap[i] = count;
+		ref_data->names[count++] = ref_data->names[i];
+	}
+	ref_data->names.count = count;
+	for (int32_t id = 0; id <= UINT16_MAX; id++) {
+		if (ref_data->pid_names != nullptr) ref_data->pid_names[id]      = (uint16_t)remap[ref_data->pid_names[id]];
+		if (ref_data->tid_names != nullptr) ref_data->tid_names[id].name = (uint16_t)remap[ref_data->tid_names[id].name];
+	}
+	remap.free();
+
+	memset(ref_data->names_table, 0, ref_data->names_table_size * sizeof(int32_t));
+	for (int32_t i = 0; i < ref_data->names.count; i++)
+		logcat_names_table_add(ref_data, i);
+	ref_data->names_moved += 1;
+}
+
+///////////////////////////////////////////
+
+uint16_t logcat_get_name(logcat_data_t *data, const char *name) {
+	if (data->names.count == 0) {
+		data->names.add(strdup(""));
+		logcat_names_table_add(data, 0);
+	}
+
+	uint32_t mask = data->names_table_size - 1;
+	for (uint32_t at = (uint32_t)logcat_name_hash(name) & mask; data->names_table[at] != 0; at = (at + 1) & mask) {
+		int32_t i = data->names_table[at] - 1;
+		if (strcmp(data->names[i], name) == 0)
+			return (uint16_t)i;
+	}
+
+	if (data->names.count > UINT16_MAX) logcat_names_compact(data);
+	if (data->names.count > UINT16_MAX) return 0;
+	data->names.add(strdup(name));
+	logcat_names_table_add(data, data->names.count - 1);
+	return data->names.count - 1;
+}
+
+///////////////////////////////////////////
+
+const char *logcat_process_name(const logcat_data_t *data, uint16_t pid) {
+	if (data->pid_names == nullptr) return "";
+	return data->names[data->pid_names[pid]];
+}
+
+///////////////////////////////////////////
+
+const char *logcat_thread_name(const logcat_data_t *data, uint16_t pid, uint16_t tid) {
+	if (data->tid_names == nullptr || data->tid_names[tid].pid != pid) return "";
+	return data->names[data->tid_names[tid].name];
+}
+
+///////////////////////////////////////////
+
+// Both expect the lines mutex to be held
+void logcat_set_process(logcat_data_t *ref_data, uint16_t pid, const char *name) {
+	if (ref_data->pid_names == nullptr)
+		ref_data->pid_names = (uint16_t*)calloc(UINT16_MAX + 1, sizeof(uint16_t));
+	ref_data->pid_names[pid] = logcat_get_name(ref_data, name);
+}
+
+void logcat_set_thread(logcat_data_t *ref_data, uint16_t pid, uint16_t tid, const char *name) {
+	if (ref_data->tid_names == nullptr)
+		ref_data->tid_names = (logcat_thread_name_t*)calloc(UINT16_MAX + 1, sizeof(logcat_thread_name_t));
+	ref_data->tid_names[tid] = { pid, logcat_get_name(ref_data, name) };
+}
+
+///////////////////////////////////////////
+
 void logcat_clear(logcat_data_t *data) {
 	platform_mutex_lock(data->lines_mutex);
-	for (int32_t i = 0; i < data->lines.count; i+=1) free(data->lines[i].line);
+	logcat_segments_clear(data);
 	for (int32_t i = 0; i < data->tags.count;  i+=1) free(data->tags [i]);
-	data->lines.clear();
-	data->tags .clear();
+	data->lines  .clear();
+	data->repeats.clear();
+	data->tags   .clear();
+	data->repeat_copies = 0;
+	pattern_tree_reset(&data->patterns);
+	data->lines_moved  += 1;
+	data->line_base     = 0;
+	logcat_index_free(data);
+	data->tag_events  .clear();
+	data->fields      .clear();
+	data->event_fields.clear();
 	platform_mutex_unlock(data->lines_mutex);
 }
 
 ///////////////////////////////////////////
 
+void logcat_add_line(logcat_data_t *ref_data, logcat_line_t *ref_line, const char *text) {
+	if (ref_data->collapse && logcat_collapse(ref_data, ref_line, text))
+		return;
+	if (ref_line->severity != 0)
+		ref_line->pattern = pattern_match(&ref_data->patterns, text, 1);
+
+	logcat_add_text(ref_data, ref_line, text);
+	if (ref_line->buffer == logcat_buffer_events) {
+		ref_data->event_fields.add(ref_data->fields.count);
+		logcat_decode_event(ref_data, ref_line, text);
+	}
+	logcat_index_add(ref_data, ref_line, ref_data->lines.count);
+	ref_data->lines.add(*ref_line);
+}
+
+///////////////////////////////////////////
+
+// Counts line against an identical one among the last few, instead of
+// adding it, if there is one. A new repeat can belong to a line before the
+// newest repeats, but only by a few, so keeping them in order is cheap.
+bool logcat_collapse(logcat_data_t *ref_data, const logcat_line_t *line, const char *text) {
+	if (line->severity == 0) return false;
+
+	block_array_t<logcat_repeat_t, 12> &repeats = ref_data->repeats;
+	int64_t end = ref_data->lines.count;
+	for (int64_t i = end - 1; i >= 0 && i >= end - logcat_collapse_window; i--) {
+		logcat_line_t &prev = ref_data->lines[i];
+		if (prev.pid != line->pid || prev.tid != line->tid || prev.tag != line->tag || prev.severity != line->severity || prev.buffer != line->buffer)
+			continue;
+		if (strcmp(logcat_line_text(ref_data, &prev), text) != 0)
+			continue;
+
+		if (!prev.repeated) {
+			prev.repeated = 1;
+			repeats.add({ i, 1, prev });
+			for (int64_t r = repeats.count - 1; r > 0 && repeats[r - 1].line > i; r--) {
+				logcat_repeat_t swap = repeats[r];
+				repeats[r]     = repeats[r - 1];
+				repeats[r - 1] = swap;
+			}
+		}
+		logcat_repeat_t *repeat = (logcat_repeat_t *)logcat_line_repeat(ref_data, i);
+		repeat->count += 1;
+		repeat->last   = *line;
+		repeat->last.segment  = prev.segment;
+		repeat->last.text     = prev.text;
+		repeat->last.pattern  = prev.pattern;
+		repeat->last.repeated = 1;
+		ref_data->repeat_copies += 1;
+		if (prev.pattern != pattern_none)
+			ref_data->patterns.patterns[prev.pattern].lines += 1;
+		return true;
+	}
+	return false;
+}
+
+///////////////////////////////////////////
+
+// Takes back a repeat's copies, for when its line goes
+void logcat_repeat_drop(logcat_data_t *ref_data, const logcat_repeat_t *repeat) {
+	ref_data->repeat_copies -= repeat->count - 1;
+	if (repeat->last.pattern != pattern_none)
+		ref_data->patterns.patterns[repeat->last.pattern].lines -= repeat->count - 1;
+}
+
+///////////////////////////////////////////
+
+const logcat_repeat_t *logcat_line_repeat(const logcat_data_t *data, int64_t line) {
+	const block_array_t<logcat_repeat_t, 12> &repeats = data->repeats;
+	int64_t lo = 0, hi = repeats.count;
+	while (lo < hi) {
+		int64_t mid = (lo + hi) / 2;
+		if (repeats[mid].line < line) lo = mid + 1;
+		else                          hi = mid;
+	}
+	return lo < repeats.count && repeats[lo].line == line ? &repeats[lo] : nullptr;
+}
+
+///////////////////////////////////////////
+
+void logcat_trim(logcat_data_t *ref_data, int64_t first, int64_t last) {
+	for (int64_t i = last + 1; i < ref_data->lines.count; i++)
+		logcat_line_release(ref_data, &ref_data->lines[i]);
+	for (int64_t i = 0; i < first; i++)
+		logcat_line_release(ref_data, &ref_data->lines[i]);
+	ref_data->lines.truncate    (last + 1);
+	ref_data->lines.remove_front(first);
+
+	// Repeats go with their lines, and the rest move along with them
+	block_array_t<logcat_repeat_t, 12> &repeats = ref_data->repeats;
+	while (repeats.count > 0 && repeats.last().line > last) {
+		logcat_repeat_drop(ref_data, &repeats.last());
+		repeats.pop();
+	}
+	int64_t dropped = 0;
+	while (dropped < repeats.count && repeats[dropped].line < first) {
+		logcat_repeat_drop(ref_data, &repeats[dropped]);
+		dropped++;
+	}
+	repeats.remove_front(dropped);
+	for (int64_t r = 0; r < repeats.count; r++)
+		repeats[r].line -= first;
+
+	ref_data->line_base   += first;
+	ref_data->lines_moved += 1;
+	int64_t events_front = logcat_ids_find(&ref_data->buffer_lines[logcat_buffer_events], ref_data->line_base);
+	logcat_index_trim (ref_data);
+	logcat_events_trim(ref_data, events_front);
+}
+
+///////////////////////////////////////////
+
+// Copies text into the open segment, and points line at it
+void logcat_add_text(logcat_data_t *ref_data, logcat_line_t *ref_line, const char *text) {
+	int32_t size = (int32_t)strlen(text) + 1;
+	if (ref_data->segment_open >= ref_data->segments.count ||
+	    ref_data->segments[ref_data->segment_open].text_size + size > logcat_segment_size) {
+		// A fixed size that's never grown, so text pointers hold still
+		logcat_segment_t segment = {};
+		segment.text = (char*)malloc(logcat_segment_size);
+		ref_data->segment_open = ref_data->segments.add(segment);
+	}
+
+	logcat_segment_t &segment = ref_data->segments[ref_data->segment_open];
+	memcpy(segment.text + segment.text_size, text, size);
+	ref_line->segment   = (uint32_t)ref_data->segment_open;
+	ref_line->text      = (uint32_t)segment.text_size;
+	segment.text_size  += size;
+	segment.lines      += 1;
+	ref_data->text_bytes += size;
+}
+
+///////////////////////////////////////////
+
+const char *logcat_line_text(logcat_data_t *ref_data, const logcat_line_t *line) {
+	logcat_segment_t *segment = &ref_data->segments[line->segment];
+	if (segment->text != nullptr) {
+		// Hot segments aren't in the cache, unpacked ones move to its end
+		array_t<int32_t> &cache = ref_data->segment_cache;
+		if ((segment->packed != nullptr || segment->spilled) && (cache.count == 0 || cache.last() != (int32_t)line->segment)) {
+			for (int32_t i = 0; i < cache.count; i++) {
+				if (cache[i] != (int32_t)line->segment) continue;
+				cache.remove(i);
+				break;
+			}
+			cache.add(line->segment);
+		}
+		return segment->text + line->text;
+	}
+	if (segment->packed == nullptr && !segment->spilled) return "";
+
+	TRACE_ZONE("logcat_line_text unpack");
+	if (ref_data->segment_cache.count >= logcat_segment_cache) {
+		logcat_segment_t &evict = ref_data->segments[ref_data->segment_cache[0]];
+		free(evict.text);
+		evict.text = nullptr;
+		ref_data->segment_cache.remove(0);
+	}
+	segment->text = (char*)malloc(segment->text_size);
+	bool unpacked = false;
+	if (segment->packed != nullptr) {
+		unpacked = lz_decompress(segment->packed, segment->packed_size, (uint8_t*)segment->text, segment->text_size);
+	} else {
+		platform_map_t map;
+		if (platform_file_map(ref_data->spill_file, segment->spill_at, segment->packed_size, &map)) {
+			unpacked = lz_decompress((const uint8_t*)map.data, segment->packed_size, (uint8_t*)segment->text, segment->text_size);
+			platform_file_unmap(&map);
+		}
+		// Spilled text mostly gets read front to back, by filters and
+		// saving, so have the next few on their way while this one's used
+		logcat_spill_prefetch(ref_data, line->segment + 1);
+	}
+	if (!unpacked) {
+		free(segment->text);
+		segment->text = nullptr;
+		return "";
+	}
+	ref_data->segment_cache.add(line->segment);
+	return segment->text + line->text;
+}
+
+///////////////////////////////////////////
+
+void logcat_line_release(logcat_data_t *ref_data, const logcat_line_t *line) {
+	if (line->pattern != pattern_none)
+		ref_data->patterns.patterns[line->pattern].lines -= 1;
+
+	logcat_segment_t &segment = ref_data->segments[line->segment];
+	segment.lines -= 1;
+	if (segment.lines > 0) return;
+
+	if ((int32_t)line->segment == ref_data->segment_open) {
+		// Still being appended to, so just start it over
+		ref_data->text_bytes -= segment.text_size;
+		segment.text_size     = 0;
+	} else {
+		logcat_segment_free(ref_data, line->segment);
+	}
+}
+
+///////////////////////////////////////////
+
+void logcat_segment_free(logcat_data_t *ref_data, int32_t segment_idx) {
+	logcat_segment_t &segment = ref_data->segments[segment_idx];
+	if ((segment.packed != nullptr || segment.spilled) && segment.text != nullptr) {
+		for (int32_t i = 0; i < ref_data->segment_cache.count; i++) {
+			if (ref_data->segment_cache[i] != segment_idx) continue;
+			ref_data->segment_cache.remove(i);
+			break;
+		}
+	}
+	ref_data->text_bytes -= segment.text_size;
+	if (segment.packed != nullptr) ref_data->packed_bytes -= segment.packed_size;
+	free(segment.text);
+	free(segment.packed);
+	segment = {};
+}
+
+///////////////////////////////////////////
+
+void logcat_segments_clear(logcat_data_t *ref_data) {
+	for (int32_t i = 0; i < ref_data->segments.count; i++) {
+		free(ref_data->segments[i].text);
+		free(ref_data->segments[i].packed);
+	}
+	ref_data->segments     .clear();
+	ref_data->segment_cache.clear();
+	ref_data->segment_open      = 0;
+	ref_data->segment_unpacked  = 0;
+	ref_data->segment_resident  = 0;
+	ref_data->segments_cleared += 1;
+	ref_data->text_bytes        = 0;
+	ref_data->packed_bytes      = 0;
+	// The spill file keeps what it has, it's only ever appended to
+}
+
+///////////////////////////////////////////
+
+bool logcat_pack_next(logcat_data_t *ref_data) {
+	// Making room comes before packing more
+	if (logcat_spill_next(ref_data)) return true;
+
+	perf_lock(ref_data->lines_mutex, perf_thread_ingest);
+	int32_t                 idx = ref_data->segment_unpacked;
+	const logcat_segment_t *segment = nullptr;
+	for (; idx < ref_data->segments.count - logcat_segments_hot; idx++) {
+		const logcat_segment_t &at = ref_data->segments[idx];
+		if (idx != ref_data->segment_open && at.text != nullptr && at.packed == nullptr && !at.spilled) {
+			segment = &at;
+			break;
+		}
+		// Only the open segment can be skipped and still need packing later
+		if (idx == ref_data->segment_unpacked && idx != ref_data->segment_open)
+			ref_data->segment_unpacked = idx + 1;
+	}
+	if (segment == nullptr) {
+		perf_unlock(ref_data->lines_mutex, perf_thread_ingest);
+		return false;
+	}
+
+	// Closed segments don't change, but they can be freed, so work from a
+	// copy and check it's still there after
+	int32_t size    = segment->text_size;
+	int32_t cleared = ref_data->segments_cleared;
+	char   *text    = (char*)malloc(size);
+	memcpy(text, segment->text, size);
+	perf_unlock(ref_data->lines_mutex, perf_thread_ingest);
+
+	TRACE_ZONE("logcat_pack_next compress");
+	int32_t  capacity    = lz_bound(size);
+	uint8_t *packed      = (uint8_t*)malloc(capacity);
+	int32_t  packed_size = lz_compress((const uint8_t*)text, size, packed, capacity);
+	free(text);
+	if (packed_size > 0) packed = (uint8_t*)realloc(packed, packed_size);
+
+	perf_lock(ref_data->lines_mutex, perf_thread_ingest);
+	logcat_segment_t *check = idx < ref_data->segments.count ? &ref_data->segments[idx] : nullptr;
+	if (packed_size > 0 && cleared == ref_data->segments_cleared && check != nullptr &&
+	    check->text != nullptr && check->packed == nullptr && !check->spilled && check->text_size == size) {
+		free(check->text);
+		check->text        = nullptr;
+		check->packed      = packed;
+		check->packed_size = packed_size;
+		ref_data->packed_bytes += packed_size;
+	} else {
+		free(packed);
+	}
+	perf_unlock(ref_data->lines_mutex, perf_thread_ingest);
+	return true;
+}
+
+///////////////////////////////////////////
+
+void logcat_index_add(logcat_data_t *ref_data, const logcat_line_t *line, int64_t line_idx) {
+	if (ref_data->pid_lines == nullptr) {
+		ref_data->pid_lines = (logcat_id_list_t*)calloc(UINT16_MAX + 1, sizeof(logcat_id_list_t));
+		ref_data->tid_lines = (logcat_id_list_t*)calloc(UINT16_MAX + 1, sizeof(logcat_id_list_t));
+	}
+	int64_t id = ref_data->line_base + line_idx;
+	ref_data->buffer_lines[line->buffer].add(id);
+	ref_data->level_lines[logcat_severity_level(line->severity)].add(id);
+	ref_data->pid_lines[line->pid].add(id);
+	ref_data->tid_lines[line->tid].add(id);
+}
+
+///////////////////////////////////////////
+
+void logcat_index_free(logcat_data_t *ref_data) {
+	for (int32_t b = 0; b < logcat_buffer_count; b++)
+		ref_data->buffer_lines[b].free();
+	for (int32_t l = 0; l < logcat_level_count; l++)
+		ref_data->level_lines[l].free();
+	for (int32_t id = 0; id <= UINT16_MAX && ref_data->pid_lines != nullptr; id++) {
+		ref_data->pid_lines[id].free();
+		ref_data->tid_lines[id].free();
+	}
+	free(ref_data->pid_lines);
+	free(ref_data->tid_lines);
+	ref_data->pid_lines = nullptr;
+	ref_data->tid_lines = nullptr;
+}
+
+///////////////////////////////////////////
+
+// First position in ids at or after id
+template <int32_t bits>
+int64_t logcat_ids_find(const block_array_t<int64_t, bits> *ids, int64_t id) {
+	int64_t low = 0, high = ids->count;
+	while (low < high) {
+		int64_t mid = (low + high) / 2;
+		if ((*ids)[mid] < id) low  = mid + 1;
+		else                  high = mid;
+	}
+	return low;
+}
+
+///////////////////////////////////////////
+
+// Keeps the ids in [from, to), and frees the blocks the rest leave empty
+template <int32_t bits>
+void logcat_ids_trim(block_array_t<int64_t, bits> *ref_ids, int64_t from, int64_t to) {
+	ref_ids->truncate    (logcat_ids_find(ref_ids, to));
+	ref_ids->remove_front(logcat_ids_find(ref_ids, from));
+}
+
+///////////////////////////////////////////
+
+// Puts history's ids for its first keep lines ahead of ref_ids, as ids from
+// base on
+template <int32_t bits>
+void logcat_ids_prepend(block_array_t<int64_t, bits> *ref_ids, const block_array_t<int64_t, bits> *history, int64_t keep, int64_t base) {
+	int64_t count = logcat_ids_find(history, keep);
+	ref_ids->add_front(count);
+	for (int64_t i = 0; i < count; i++)
+		(*ref_ids)[i] = (*history)[i] + base;
+}
+
+///////////////////////////////////////////
+
+int64_t logcat_index_find(const logcat_data_t *data, const logcat_id_list_t *list, int64_t line) {
+	return logcat_ids_find(list, data->line_base + line);
+}
+
+///////////////////////////////////////////
+
+// Drops the ids of lines that trimming let go of, a binary search per list
+// rather than anything per line. Expects the lines mutex to be held.
+void logcat_index_trim(logcat_data_t *ref_data) {
+	int64_t from = ref_data->line_base;
+	int64_t to   = ref_data->line_base + ref_data->lines.count;
+	for (int32_t b = 0; b < logcat_buffer_count; b++)
+		logcat_ids_trim(&ref_data->buffer_lines[b], from, to);
+	for (int32_t l = 0; l < logcat_level_count; l++)
+		logcat_ids_trim(&ref_data->level_lines[l], from, to);
+	// A pid or tid that has gone quiet gives its table back too
+	for (int32_t id = 0; id <= UINT16_MAX && ref_data->pid_lines != nullptr; id++) {
+		logcat_id_list_t *lists[2] = { &ref_data->pid_lines[id], &ref_data->tid_lines[id] };
+		for (int32_t l = 0; l < 2; l++) {
+			if (lists[l]->count == 0) continue;
+			logcat_ids_trim(lists[l], from, to);
+			if (lists[l]->count == 0) lists[l]->free();
+		}
+	}
+}
+
+///////////////////////////////////////////
+
+// Puts the ids of history's first keep lines ahead of ours, after they were
+// slotted in ahead of the live ones and line_base moved back to make room.
+// history's ids start from 0. Expects the lines mutex to be held.
+void logcat_index_prepend(logcat_data_t *ref_data, const logcat_data_t *history, int64_t keep) {
+	int64_t base = ref_data->line_base;
+	for (int32_t b = 0; b < logcat_buffer_count; b++)
+		logcat_ids_prepend(&ref_data->buffer_lines[b], &history->buffer_lines[b], keep, base);
+	for (int32_t l = 0; l < logcat_level_count; l++)
+		logcat_ids_prepend(&ref_data->level_lines[l], &history->level_lines[l], keep, base);
+	if (history->pid_lines == nullptr) return;
+	if (ref_data->pid_lines == nullptr) {
+		ref_data->pid_lines = (logcat_id_list_t*)calloc(UINT16_MAX + 1, sizeof(logcat_id_list_t));
+		ref_data->tid_lines = (logcat_id_list_t*)calloc(UINT16_MAX + 1, sizeof(logcat_id_list_t));
+	}
+	for (int32_t id = 0; id <= UINT16_MAX; id++) {
+		if (history->pid_lines[id].count > 0) logcat_ids_prepend(&ref_data->pid_lines[id], &history->pid_lines[id], keep, base);
+		if (history->tid_lines[id].count > 0) logcat_ids_prepend(&ref_data->tid_lines[id], &history->tid_lines[id], keep, base);
+	}
+}
+
+///////////////////////////////////////////
+
+// Drops the fields of events trimming let go of, after the index has been
+// trimmed: drop_front of them from the start, and the rest from the end.
+void logcat_events_trim(logcat_data_t *ref_data, int64_t drop_front) {
+	int64_t events = ref_data->buffer_lines[logcat_buffer_events].count;
+	while (ref_data->event_fields.count > drop_front + events) {
+		ref_data->fields.count = ref_data->event_fields.last();
+		ref_data->event_fields.pop();
+	}
+	if (drop_front == 0) return;
+
+	int32_t offset = drop_front < ref_data->event_fields.count ? ref_data->event_fields[(int32_t)drop_front] : ref_data->fields.count;
+	memmove(ref_data->fields.data, ref_data->fields.data + offset, (ref_data->fields.count - offset) * sizeof(logcat_field_t));
+	ref_data->fields.count -= offset;
+	memmove(ref_data->event_fields.data, ref_data->event_fields.data + drop_front, events * sizeof(int32_t));
+	ref_data->event_fields.count = (int32_t)events;
+	for (int32_t e = 0; e < ref_data->event_fields.count; e++)
+		ref_data->event_fields[e] -= offset;
+}
+
+///////////////////////////////////////////
+
+// Decodes history's events among its first keep lines, which have already
+// been slotted in ahead of ours, and puts their fields ahead of the ones we
+// have. Those are found through history's own index, so the backfill has to
+// index its lines as it goes. Call before logcat_index_prepend, as this
+// reads our index from before.
+void logcat_events_prepend(logcat_data_t *ref_data, const logcat_data_t *history, int64_t keep) {
+	const block_array_t<int64_t, 14> &events = history->buffer_lines[logcat_buffer_events];
+	int64_t count = logcat_ids_find(&events, keep);
+	if (count == 0) return;
+
+	array_t<logcat_field_t> live_fields = ref_data->fields;
+	array_t<int32_t>        live_starts = ref_data->event_fields;
+	ref_data->fields       = {};
+	ref_data->event_fields = {};
+	for (int64_t i = 0; i < count; i++) {
+		// history's ids start from 0, which is also where its lines are now
+		const logcat_line_t &line = ref_data->lines[events[i]];
+		ref_data->event_fields.add(ref_data->fields.count);
+		logcat_decode_event(ref_data, &line, logcat_line_text(ref_data, &line));
+	}
+	int32_t offset = ref_data->fields.count;
+	ref_data->fields.add_range(live_fields.data, live_fields.count);
+	for (int32_t e = 0; e < live_starts.count; e++)
+		ref_data->event_fields.add(live_starts[e] + offset);
+	live_fields.free();
+	live_starts.free();
+}
+
+///////////////////////////////////////////
+
+void logcat_events_decode(logcat_data_t *ref_data) {
+	const block_array_t<int64_t, 14> &events = ref_data->buffer_lines[logcat_buffer_events];
+	ref_data->fields      .clear();
+	ref_data->event_fields.clear();
+	for (int64_t i = 0; i < events.count; i++) {
+		const logcat_line_t &line = ref_data->lines[events[i] - ref_data->line_base];
+		ref_data->event_fields.add(ref_data->fields.count);
+		logcat_decode_event(ref_data, &line, logcat_line_text(ref_data, &line));
+	}
+}
+
+///////////////////////////////////////////
+
+int32_t logcat_line_fields(const logcat_data_t *data, int64_t line, const logcat_field_t **out_fields) {
+	if (line < 0 || line >= data->lines.count || data->lines[line].buffer != logcat_buffer_events) return 0;
+
+	const block_array_t<int64_t, 14> &events = data->buffer_lines[logcat_buffer_events];
+	int64_t id = data->line_base + line;
+	int64_t lo = logcat_ids_find(&events, id);
+	if (lo >= data->event_fields.count || events[lo] != id) return 0;
+
+	int32_t start = data->event_fields[lo];
+	int32_t end   = lo + 1 < data->event_fields.count ? data->event_fields[lo + 1] : data->fields.count;
+	*out_fields = &data->fields[start];
+	return end - start;
+}
+
+///////////////////////////////////////////
+
+int32_t logcat_find_field(const logcat_data_t *data, const char *name) {
+	for (int32_t i = 0; i < data->field_names.count; i++) {
+		if (strcmp(data->field_names[i], name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+///////////////////////////////////////////
+
+const char *logcat_buffer_name(int32_t buffer) {
+	return buffer >= 0 && buffer < logcat_buffer_count ? logcat_buffer_names[buffer] : "";
+}
+
+///////////////////////////////////////////
+
+int32_t logcat_severity_level(uint8_t severity) {
+	switch (severity) {
+	case 'V': return 1;
+	case 'D': return 2;
+	case 'I': return 3;
+	case 'W': return 4;
+	case 'E': return 5;
+	case 'F': case 'A': return 6;
+	default:  return 0;
+	}
+}
+
+///////////////////////////////////////////
+
+int64_t logcat_level_next(const logcat_data_t *data, int32_t level_min, int64_t from, int32_t direction) {
+	// In ids, like the lists
+	int64_t result = -1;
+	int64_t from_id = data->line_base + from;
+	for (int32_t l = level_min < 1 ? 1 : level_min; l < logcat_level_count; l++) {
+		// First entry past from
+		const block_array_t<int64_t, 14> &lines = data->level_lines[l];
+		int64_t low = logcat_ids_find(&lines, from_id + 1);
+		if (direction < 0) {
+			// Skip back over from itself, to the last entry before it
+			low -= 1;
+			if (low >= 0 && lines[low] == from_id) low -= 1;
+			if (low >= 0 && (result == -1 || lines[low] > result)) result = lines[low];
+		} else if (low < lines.count && (result == -1 || lines[low] < result)) {
+			result = lines[low];
+		}
+	}
+	return result == -1 ? -1 : result - data->line_base;
+}
+
+///////////////////////////////////////////
+
+void logcat_wake_set(void (*on_wake)()) {
+	logcat_on_wake = on_wake;
+}
+
+///////////////////////////////////////////
+
+void logcat_wake_reset() {
+	logcat_wake_pending.store(false, std::memory_order_relaxed);
+}
+
+///////////////////////////////////////////
+
 int logcat_thread(void* arg) {
 	logcat_thread_t *thread = (logcat_thread_t*)arg;
 	char    buffer      [4096+1];
@@ -151,42 +992,160 @@ int logcat_thread(void* arg) {
 	char    tag         [4096+1];
 	int32_t line_buffer_pos = 0;
 
+	// The last line we got, and the keys of the lines before it. When logcat
+	// is resumed from the last line's timestamp, it repeats every line with
+	// that timestamp, and these let us skip the ones we already have.
+	const int32_t recent_max = 256;
+	uint64_t      recent_keys[recent_max] = {};
+	int32_t       recent_at = 0;
+	logcat_line_t last      = {};
+	bool          resuming  = false;
+	uint64_t      lost_at   = 0;
+	int32_t       wait_ms   = 0;
+	char          since[32] = {};
+	int32_t       buffer_id = logcat_buffer_main; // Where the lines are coming from
+
+	// The filter the device is using, and the time it started using it. Up
+	// to then we have everything, after it only what the filter let through.
+	logcat_filter_t filter       = {};
+	uint64_t        filter_since = 0;
+
+	TRACE_THREAD("logcat_thread");
+
 	while (thread->run) {
-		// Make sure the process is still running
-		if (!platform_process_is_running(thread->process)) {
-			break;
+		if (thread->filter_changed) {
+			TRACE_ZONE("logcat_thread filter");
+			platform_mutex_lock(thread->data->lines_mutex);
+			logcat_filter_t next = thread->filter;
+			thread->filter_changed = false;
+			platform_mutex_unlock(thread->data->lines_mutex);
+
+			bool was_filtered = filter.pid != 0 || filter.tag_count != 0;
+			bool now_filtered = next  .pid != 0 || next  .tag_count != 0;
+			if (was_filtered) {
+				// Whatever we got since narrowing may be missing lines the
+				// new filter wants, so drop it and fetch it again
+				memset(recent_keys, 0, sizeof(recent_keys));
+				logcat_truncate(thread, filter_since, &last, recent_keys, recent_max);
+			} else if (now_filtered) {
+				filter_since = last.time;
+			}
+			if (!now_filtered) filter_since = 0;
+			filter = next;
+
+			if (was_filtered || now_filtered) {
+				line_buffer_pos = 0;
+				resuming        = last.time != 0;
+				logcat_reconnect(thread, &last, &filter, since, sizeof(since));
+
+				char marker[128] = "--------- log-panther: device sends everything";
+				if      (filter.pid       != 0) snprintf(marker, sizeof(marker), "--------- log-panther: device only sends pid %d", filter.pid);
+				else if (filter.tag_count != 0) snprintf(marker, sizeof(marker), "--------- log-panther: device only sends %d tag(s)", filter.tag_count);
+				logcat_add_marker(thread, marker);
+			}
 		}
 
-		// Check if data is available
-		int32_t available = platform_pipe_peek(thread->stdout_pipe);
-		if (available <= 0) {
-			platform_sleep_ms(1);
+		// Wait for data, and add it to the logs
+		int32_t read = adb_stream_read(&thread->stream, buffer, 4096, 100);
+		if (read == 0) continue;
+		if (read <  0) {
+			// logcat ended, most likely the device went away. Keep trying
+			// to pick up where it left off until someone stops us. adb fails
+			// fast while the device is missing, so trying often is cheap,
+			// and gets us back quickly after a replug.
+			if (lost_at == 0) {
+				lost_at = platform_time_ns();
+				wait_ms = 25;
+			} else {
+				platform_sleep_ms(wait_ms);
+				wait_ms = wait_ms * 2 < 250 ? wait_ms * 2 : 250;
+			}
+			thread->connected = false;
+			line_buffer_pos   = 0;
+			resuming          = last.time != 0;
+			logcat_reconnect(thread, &last, &filter, since, sizeof(since));
 			continue;
 		}
 
-		// Read the data from stdout, and add it to the logs.
-		int32_t read = platform_pipe_read(thread->stdout_pipe, buffer, 4096);
-		if (read <= 0) continue;
-
 		buffer[read] = '\0';
+		TRACE_ZONE("logcat_thread read");
+
+		// Tally perf counters locally, and publish them once per read
+		uint64_t parse_ns = 0;
+		uint64_t lines    = 0;
 
 		for (int i = 0; i < read; ++i) {
 			if (buffer[i] == '\n' || line_buffer_pos == 4096) {
 				line_buffer[line_buffer_pos] = '\0';
 				line_buffer_pos = 0;
 
-				logcat_line_t line_data = logcat_parse_line(line_buffer, tag);
+				uint64_t      parse_start = platform_time_ns();
+				const char   *text;
+				logcat_line_t line_data   = logcat_parse_line(line_buffer, tag, &text);
+				parse_ns += platform_time_ns() - parse_start;
+				lines    += 1;
+
+				// Banners just say which buffer the next lines are from
+				if (line_data.severity == 0 && logcat_parse_banner(text, &buffer_id))
+					continue;
+				line_data.buffer = line_data.severity != 0 ? buffer_id : logcat_buffer_none;
+
+				// Only call it reconnected once logcat gives us a log line,
+				// until then it's adb complaining the device isn't there
+				if (lost_at != 0 && line_data.severity != 0) {
+					if (last.time != 0) {
+						char marker[128];
+						snprintf(marker, sizeof(marker), "--------- log-panther: connection lost, resumed after %.1fs from %s", (platform_time_ns() - lost_at) / 1000000000.0, since);
+						logcat_add_marker(thread, marker);
+					}
+					thread->connected = true;
+					lost_at = 0;
+				}
 
-				if (!thread->pause) {
-					platform_mutex_lock(thread->data->lines_mutex);
+				// Skip what a resumed logcat repeats: its "beginning of"
+				// banners, and lines from the last timestamp we already have
+				bool duplicate = false;
+				if (lost_at != 0) {
+					duplicate = true;
+				} else if (resuming && line_data.severity == 0) {
+					duplicate = strncmp(text, "---------", 9) == 0;
+				} else if (resuming) {
+					uint64_t key = logcat_line_key(&line_data, text);
+					if (line_data.time == last.time) {
+						for (int32_t k = 0; k < recent_max && !duplicate; k++)
+							duplicate = recent_keys[k] == key;
+					} else {
+						duplicate = line_data.time < last.time;
+					}
+					resuming = duplicate;
+				}
+				if (line_data.severity != 0 && !duplicate) {
+					recent_keys[recent_at] = logcat_line_key(&line_data, text);
+					recent_at = (recent_at + 1) % recent_max;
+					last      = line_data;
+				}
+
+				if (!duplicate && line_data.severity != 0 && (tag[0] == 'A' || tag[0] == 'B' || tag[0] == 'P'))
+					logcat_proc_line(thread, tag, text);
+
+				if (!duplicate && !thread->pause) {
+					perf_lock(thread->data->lines_mutex, perf_thread_ingest);
 					line_data.tag = logcat_get_tag(thread->data, tag);
-					thread->data->lines.add(line_data);
-					platform_mutex_unlock(thread->data->lines_mutex);
+					logcat_add_line(thread->data, &line_data, text);
+					perf_unlock(thread->data->lines_mutex, perf_thread_ingest);
 				}
 			} else {
 				line_buffer[line_buffer_pos++] = buffer[i];
 			}
 		}
+
+		if (lines > 0 && !thread->pause && logcat_on_wake != nullptr && !logcat_wake_pending.exchange(true, std::memory_order_relaxed))
+			logcat_on_wake();
+
+		perf.lines      .fetch_add(lines,    std::memory_order_relaxed);
+		perf.bytes      .fetch_add(read,     std::memory_order_relaxed);
+		perf.parse_ns   .fetch_add(parse_ns, std::memory_order_relaxed);
+		perf.queue_bytes.store    (adb_stream_peek(&thread->stream), std::memory_order_relaxed);
 	}
 	thread->run = false;
 
@@ -195,8 +1154,698 @@ int logcat_thread(void* arg) {
 
 ///////////////////////////////////////////
 
+// Keeps process names current from ActivityManager announcing new ones,
+// "Start proc 1234:com.example/u0a56 for activity ...", or on older
+// devices "Start proc com.example for activity ...: pid=1234 uid=...", and
+// picks out the watched package's pid. Names outlive their process, so
+// older lines keep theirs until the pid gets reused.
+void logcat_proc_line(logcat_thread_t *ref_thread, const char *tag, const char *text) {
+	// Installs and removals go out as broadcasts, which get logged as
+	// "... act=android.intent.action.PACKAGE_ADDED dat=package:com.example ..."
+	bool activity = strcmp(tag, "ActivityManager") == 0;
+	if ((activity || strcmp(tag, "BroadcastQueue") == 0 || strcmp(tag, "PackageManager") == 0) &&
+	    (strstr(text, "android.intent.action.PACKAGE_ADDED"   ) != nullptr ||
+	     strstr(text, "android.intent.action.PACKAGE_REMOVED" ) != nullptr ||
+	     strstr(text, "android.intent.action.PACKAGE_REPLACED") != nullptr)) {
+		ref_thread->packages_changed += 1;
+	}
+
+	if (!activity) return;
+	const char *at = strstr(text, "Start proc ");
+	if (at == nullptr) return;
+	at += 11;
+
+	int32_t     pid     = 0;
+	int32_t     scanned = 0;
+	const char *name    = at;
+	if (sscanf(at, "%d:%n", &pid, &scanned) == 1 && scanned > 0) {
+		name = at + scanned;
+	} else {
+		const char *pid_at = strstr(at, "pid=");
+		if (pid_at == nullptr || sscanf(pid_at, "pid=%d", &pid) != 1) return;
+	}
+	if (pid <= 0 || pid > UINT16_MAX) return;
+
+	char   process[256];
+	size_t len = strcspn(name, "/ ");
+	if (len >= sizeof(process)) len = sizeof(process) - 1;
+	memcpy(process, name, len);
+	process[len] = '\0';
+
+	platform_mutex_lock(ref_thread->data->lines_mutex);
+	logcat_set_process(ref_thread->data, (uint16_t)pid, process);
+	logcat_set_thread (ref_thread->data, (uint16_t)pid, (uint16_t)pid, process);
+	ref_thread->names_stale = true;
+	// The main process is named after the package, extra ones get a
+	// ":suffix" that we leave alone
+	if (ref_thread->watch_package[0] != '\0' && strcmp(process, ref_thread->watch_package) == 0) {
+		ref_thread->watch_pid     = pid;
+		ref_thread->watch_starts += 1;
+	}
+	platform_mutex_unlock(ref_thread->data->lines_mutex);
+}
+
+///////////////////////////////////////////
+
+// Names everything that's running from a ps snapshot, then takes another
+// whenever new processes have started, so their threads get names too.
+// ActivityManager tells us the process names in the meantime.
+int logcat_names_thread(void* arg) {
+	logcat_thread_t *thread   = (logcat_thread_t*)arg;
+	const char      *serial   = thread->device_id[0] != '\0' ? thread->device_id : nullptr;
+	const char      *ps_args[] = { "ps", "-A", "-T", "-o", "PID,TID,NAME,CMD", nullptr };
+	uint64_t         last_ns  = 0;
+
+	TRACE_THREAD("logcat_names_thread");
+
+	// Events need their layouts to be decoded, and fetching those can take a
+	// while, so it's done here rather than holding up the log
+	logcat_event_tags_load(thread);
+
+	thread->names_stale = true;
+	while (thread->run) {
+		// Processes tend to start in bunches, and ps isn't free on the device
+		if (!thread->names_stale || platform_time_ns() - last_ns < 2000000000ull) {
+			platform_sleep_ms(100);
+			continue;
+		}
+		thread->names_stale = false;
+		last_ns             = platform_time_ns();
+
+		TRACE_ZONE("logcat_names_thread ps");
+		char *ps = adb_shell_output(serial, ps_args);
+		if (ps != nullptr) logcat_parse_ps(thread->data, ps);
+		free(ps);
+	}
+	return 0;
+}
+
+///////////////////////////////////////////
+
+// Writes the oldest packed segment out to the spill file when there's more
+// packed than packed_max, false if there's nothing to do.
+bool logcat_spill_next(logcat_data_t *ref_data) {
+	perf_lock(ref_data->lines_mutex, perf_thread_ingest);
+	const logcat_segment_t *segment = nullptr;
+	int32_t                 idx     = ref_data->segment_resident;
+	if (ref_data->packed_max != 0 && ref_data->packed_bytes > ref_data->packed_max) {
+		for (; idx < ref_data->segment_unpacked; idx++) {
+			const logcat_segment_t &at = ref_data->segments[idx];
+			if (at.packed != nullptr) {
+				segment = &at;
+				break;
+			}
+			if (idx == ref_data->segment_resident)
+				ref_data->segment_resident = idx + 1;
+		}
+	}
+	if (segment != nullptr && ref_data->spill_file == nullptr) {
+		ref_data->spill_file = platform_temp_file_create();
+		// Nowhere to spill to, so everything just stays in memory
+		if (ref_data->spill_file == nullptr) ref_data->packed_max = 0;
+	}
+	if (segment == nullptr || ref_data->spill_file == nullptr) {
+		perf_unlock(ref_data->lines_mutex, perf_thread_ingest);
+		return false;
+	}
+
+	// Same as packing, write from a copy and check it's still there after.
+	// Only this thread appends, so the end of the file is ours.
+	int32_t  size    = segment->packed_size;
+	int32_t  cleared = ref_data->segments_cleared;
+	uint64_t at      = ref_data->spill_size;
+	uint8_t *packed  = (uint8_t*)malloc(size);
+	memcpy(packed, segment->packed, size);
+	perf_unlock(ref_data->lines_mutex, perf_thread_ingest);
+
+	TRACE_ZONE("logcat_spill_next write");
+	bool written = platform_file_append(ref_data->spill_file, packed, size);
+	free(packed);
+
+	perf_lock(ref_data->lines_mutex, perf_thread_ingest);
+	logcat_segment_t *check = idx < ref_data->segments.count ? &ref_data->segments[idx] : nullptr;
+	if (!written) {
+		// Likely out of disk, the file's end is anyone's guess now
+		ref_data->packed_max = 0;
+	} else {
+		ref_data->spill_size += size;
+		if (cleared == ref_data->segments_cleared && check != nullptr && check->packed != nullptr && check->packed_size == size) {
+			free(check->packed);
+			check->packed   = nullptr;
+			check->spilled  = true;
+			check->spill_at = at;
+			ref_data->packed_bytes -= size;
+		}
+	}
+	perf_unlock(ref_data->lines_mutex, perf_thread_ingest);
+	return written;
+}
+
+///////////////////////////////////////////
+
+void logcat_spill_prefetch(logcat_data_t *ref_data, int32_t from_segment) {
+	uint64_t start = 0;
+	uint64_t end   = 0;
+	int32_t  found = 0;
+	for (int32_t s = from_segment; s < ref_data->segments.count && found < logcat_spill_ahead; s++) {
+		const logcat_segment_t &segment = ref_data->segments[s];
+		if (!segment.spilled || segment.text != nullptr) continue;
+		if (found == 0) start = segment.spill_at;
+		if (segment.spill_at < start) break; // Out of order, leave it be
+		end    = segment.spill_at + segment.packed_size;
+		found += 1;
+	}
+	if (found > 0) platform_file_prefetch(ref_data->spill_file, start, end - start);
+}
+
+///////////////////////////////////////////
+
+int logcat_pack_thread(void* arg) {
+	logcat_thread_t *thread = (logcat_thread_t*)arg;
+
+	TRACE_THREAD("logcat_pack_thread");
+
+	while (thread->run) {
+		if (!logcat_pack_next(thread->data))
+			platform_sleep_ms(100);
+	}
+	return 0;
+}
+
+///////////////////////////////////////////
+
+// Reads `ps -A -T -o PID,TID,NAME,CMD`, where NAME is the process and CMD
+// the thread, which may have spaces in it. A line at a time, so the UI only
+// ever waits on one.
+void logcat_parse_ps(logcat_data_t *ref_data, char *text) {
+	for (char *line = text; line != nullptr && *line != '\0'; ) {
+		char *next = strchr(line, '\n');
+		if (next != nullptr) *next++ = '\0';
+
+		int32_t pid, tid, scanned = 0;
+		char    process[256];
+		if (sscanf(line, "%d %d %255s %n", &pid, &tid, process, &scanned) == 3 && scanned > 0 &&
+		    pid > 0 && pid <= UINT16_MAX && tid > 0 && tid <= UINT16_MAX) {
+			char  *thread = line + scanned;
+			size_t len    = strlen(thread);
+			while (len > 0 && (thread[len - 1] == '\r' || thread[len - 1] == ' ')) thread[--len] = '\0';
+
+			platform_mutex_lock(ref_data->lines_mutex);
+			if (pid == tid) logcat_set_process(ref_data, (uint16_t)pid, process);
+			logcat_set_thread(ref_data, (uint16_t)pid, (uint16_t)tid, thread);
+			platform_mutex_unlock(ref_data->lines_mutex);
+		}
+		line = next;
+	}
+}
+
+///////////////////////////////////////////
+
+// Adds up how much `logcat -g` says is in the device's buffers. Lines look
+// like "main: ring buffer is 256 KiB (243 KiB consumed), max entry ..."
+size_t logcat_parse_buffer_sizes(const char *text) {
+	size_t result = 0;
+	for (const char *at = text; at != nullptr && (at = strchr(at, '(')) != nullptr; at++) {
+		double value;
+		char   unit[16];
+		if (sscanf(at + 1, "%lf %15s consumed", &value, unit) != 2) continue;
+		if      (strncmp(unit, "GiB", 3) == 0) value *= 1024.0 * 1024.0 * 1024.0;
+		else if (strncmp(unit, "MiB", 3) == 0) value *= 1024.0 * 1024.0;
+		else if (strncmp(unit, "KiB", 3) == 0) value *= 1024.0;
+		result += (size_t)value;
+	}
+	return result;
+}
+
+///////////////////////////////////////////
+
+int logcat_backfill_thread(void* arg) {
+	logcat_thread_t *thread = (logcat_thread_t*)arg;
+	const char      *serial = thread->device_id[0] != '\0' ? thread->device_id : nullptr;
+	char    buffer     [4096+1];
+	char    line_buffer[4096+1];
+	char    tag        [4096+1];
+	int32_t line_buffer_pos = 0;
+	int32_t buffer_id       = logcat_buffer_main;
+
+	TRACE_THREAD("logcat_backfill_thread");
+
+	// Buffer sizes only drive the progress bar
+	const char *size_args[] = { "logcat", "-b", "all", "-g", nullptr };
+	char       *sizes       = adb_shell_output(serial, size_args);
+	thread->backfill_total = logcat_parse_buffer_sizes(sizes);
+	free(sizes);
+
+	const char *args[] = { "logcat", "-b", "all", "-D", "-d", nullptr };
+	if (!thread->run || !adb_shell(serial, args, &thread->backfill_stream)) {
+		thread->backfilling = false;
+		return -1;
+	}
+
+	// Collect the history on the side, with its own tag table, so the live
+	// thread and UI don't have to wait on us
+	logcat_data_t history = {};
+	while (thread->run) {
+		int32_t read = adb_stream_read(&thread->backfill_stream, buffer, 4096, 100);
+		if (read == 0) continue;
+		if (read <  0) break;
+		thread->backfill_bytes += read;
+
+		TRACE_ZONE("logcat_backfill_thread read");
+		for (int32_t i = 0; i < read; i++) {
+			if (buffer[i] == '\n' || line_buffer_pos == 4096) {
+				line_buffer[line_buffer_pos] = '\0';
+				line_buffer_pos = 0;
+
+				if (logcat_parse_banner(line_buffer, &buffer_id)) continue;
+				const char   *text;
+				logcat_line_t line_data = logcat_parse_line(line_buffer, tag, &text);
+				line_data.tag    = logcat_get_tag(&history, tag);
+				line_data.buffer = line_data.severity != 0 ? buffer_id : logcat_buffer_none;
+				if (line_data.severity != 0)
+					line_data.pattern = pattern_match(&history.patterns, text, 1);
+				logcat_add_text (&history, &line_data, text);
+				logcat_index_add(&history, &line_data, history.lines.count);
+				history.lines.add(line_data);
+			} else {
+				line_buffer[line_buffer_pos++] = buffer[i];
+			}
+		}
+	}
+
+	// The live tail starts with the last line that was in the buffer when we
+	// attached, so that's where history stops. Give it a moment to show up
+	// if the device is quiet.
+	for (int32_t i = 0; i < 200 && thread->run; i++) {
+		bool has_live = false;
+		platform_mutex_lock(thread->data->lines_mutex);
+		for (int64_t l = 0; l < thread->data->lines.count && !has_live; l++)
+			has_live = thread->data->lines[l].severity != 0;
+		platform_mutex_unlock(thread->data->lines_mutex);
+		if (has_live) break;
+		platform_sleep_ms(10);
+	}
+
+	int64_t keep = 0;
+	if (thread->run) {
+		TRACE_ZONE("logcat_backfill merge");
+		logcat_data_t *data = thread->data;
+		perf_lock(data->lines_mutex, perf_thread_ingest);
+
+		int64_t live_first = -1;
+		for (int64_t l = 0; l < data->lines.count && live_first == -1; l++)
+			if (data->lines[l].severity != 0) live_first = l;
+
+		keep = history.lines.count;
+		if (live_first != -1) {
+			const logcat_line_t &first     = data->lines[live_first];
+			uint64_t             first_key = logcat_line_key(&first, logcat_line_text(data, &first));
+			for (keep = 0; keep < history.lines.count; keep++) {
+				const logcat_line_t &line = history.lines[keep];
+				if (line.severity == 0) continue;
+				if (line.time > first.time || (line.time == first.time && logcat_line_key(&line, logcat_line_text(&history, &line)) == first_key))
+					break;
+			}
+		}
+
+		// Move history's tags over to the shared table
+		array_t<uint16_t> tag_map = {};
+		for (int32_t t = 0; t < history.tags.count; t++)
+			tag_map.add(logcat_get_tag(data, history.tags[t]));
+		for (int64_t l = 0; l < keep; l++)
+			history.lines[l].tag = tag_map[history.lines[l].tag];
+		tag_map.free();
+
+		// And its templates, which its own text matches again
+		array_t<uint16_t> pattern_map = {};
+		for (int32_t p = 0; p < history.patterns.patterns.count; p++)
+			pattern_map.add(p == pattern_none ? pattern_none : pattern_match(&data->patterns, pattern_text(&history.patterns, p), 0));
+		for (int64_t l = 0; l < keep; l++) {
+			logcat_line_t &line = history.lines[l];
+			line.pattern = pattern_map[line.pattern];
+			if (line.pattern != pattern_none)
+				data->patterns.patterns[line.pattern].lines += 1;
+		}
+		pattern_map.free();
+
+		// And its text segments, after the live ones. They're older than
+		// those, but the packing gets to them soon enough.
+		for (int64_t l = keep; l < history.lines.count; l++)
+			logcat_line_release(&history, &history.lines[l]);
+		int32_t segment_base = data->segments.count;
+		for (int32_t s = 0; s < history.segments.count; s++) {
+			logcat_segment_t segment = history.segments[s];
+			if (segment.lines == 0) {
+				free(segment.text);
+				segment = {};
+			}
+			data->segments.add(segment);
+			data->text_bytes += segment.text_size;
+		}
+		for (int64_t l = 0; l < keep; l++)
+			history.lines[l].segment += segment_base;
+		history.segments.clear();
+
+		// Slots it all in ahead of the live lines, without moving them
+		data->lines.add_front(keep);
+		for (int64_t l = 0; l < keep; l++)
+			data->lines[l] = history.lines[l];
+		for (int64_t r = 0; r < data->repeats.count; r++)
+			data->repeats[r].line += keep;
+		data->prepended   += keep;
+		data->lines_moved += 1;
+		data->line_base   -= keep;
+		logcat_events_prepend(data, &history, keep);
+		logcat_index_prepend (data, &history, keep);
+
+		perf_unlock(data->lines_mutex, perf_thread_ingest);
+
+		if (logcat_on_wake != nullptr && !logcat_wake_pending.exchange(true, std::memory_order_relaxed))
+			logcat_on_wake();
+	}
+
+	// Anything past the live tail's first line is already in there
+	logcat_segments_clear(&history);
+	for (int32_t t = 0; t < history.tags.count; t++)
+		free(history.tags[t]);
+	history.segments     .free();
+	history.segment_cache.free();
+	history.lines.free();
+	history.tags .free();
+	logcat_index_free(&history);
+	pattern_tree_free(&history.patterns);
+	history.tag_events.free();
+
+	thread->backfilling = false;
+	return 1;
+}
+
+///////////////////////////////////////////
+
+void logcat_reconnect(logcat_thread_t *ref_thread, const logcat_line_t *last, const logcat_filter_t *filter, char *out_since, size_t since_size) {
+	TRACE_ZONE("logcat_reconnect");
+	adb_stream_close(&ref_thread->stream);
+
+	// Ask for everything since the last line we saw, so nothing logged while
+	// we were gone gets lost
+	if (last->time != 0) snprintf(out_since, since_size, "%02d-%02d %02d:%02d:%02d.%03d", last->month, last->day, last->hour, last->minute, last->second, last->millisecond);
+	else                 snprintf(out_since, since_size, "1");
+
+	// A pid narrows with --pid, tags with filterspecs that silence the rest
+	const char *args[7 + 16 + 2] = { "logcat", "-b", "all", "-D", "-T", out_since };
+	int32_t     arg_count        = 6;
+	char        pid_arg [32];
+	char        tag_args[16][72];
+	if (filter->pid != 0) {
+		snprintf(pid_arg, sizeof(pid_arg), "--pid=%d", filter->pid);
+		args[arg_count++] = pid_arg;
+	} else if (filter->tag_count > 0) {
+		for (int32_t i = 0; i < filter->tag_count && i < 16; i++) {
+			snprintf(tag_args[i], sizeof(tag_args[i]), "%s:V", filter->tags[i]);
+			args[arg_count++] = tag_args[i];
+		}
+		args[arg_count++] = "*:S";
+	}
+	args[arg_count] = nullptr;
+
+	adb_shell(ref_thread->device_id[0] != '\0' ? ref_thread->device_id : nullptr, args, &ref_thread->stream);
+}
+
+///////////////////////////////////////////
+
+// Drops lines from from_time onward off the end of the log, and reports the
+// new last line and the keys of the lines that share its timestamp, so
+// logcat can be resumed from there.
+void logcat_truncate(logcat_thread_t *ref_thread, uint64_t from_time, logcat_line_t *out_last, uint64_t *out_recent_keys, int32_t recent_max) {
+	logcat_data_t *data = ref_thread->data;
+	perf_lock(data->lines_mutex, perf_thread_ingest);
+
+	int64_t line_count = data->lines.count;
+	while (true) {
+		while (data->lines.count > 0) {
+			const logcat_line_t &line = data->lines.last();
+			// The narrowing millisecond goes too, it may hold lines from both sides
+			if (line.severity != 0 && line.time < from_time) break;
+			// The open segment's last text is this line's, so it can be reused
+			logcat_segment_t &segment = data->segments[line.segment];
+			if ((int32_t)line.segment == data->segment_open && segment.lines > 1) {
+				data->text_bytes -= segment.text_size - line.text;
+				segment.text_size = line.text;
+			}
+			// It's the last one in its pid's and tid's lists too
+			data->pid_lines[line.pid].pop();
+			data->tid_lines[line.tid].pop();
+			logcat_line_release(data, &line);
+			data->lines.pop();
+		}
+		block_array_t<logcat_repeat_t, 12> &repeats = data->repeats;
+		while (repeats.count > 0 && repeats.last().line >= data->lines.count) {
+			logcat_repeat_drop(data, &repeats.last());
+			repeats.pop();
+		}
+
+		// A line that stays may have counted copies from after the new
+		// last line, which logcat will send again, so it has to go too
+		uint64_t last_time = 0;
+		for (int64_t i = data->lines.count - 1; i >= 0 && last_time == 0; i--)
+			if (data->lines[i].severity != 0) last_time = data->lines[i].time;
+		uint64_t repeat_from = from_time;
+		for (int64_t r = repeats.count - 1; r >= 0 && r >= repeats.count - logcat_collapse_window; r--) {
+			if (repeats[r].last.time > last_time && data->lines[repeats[r].line].time < repeat_from)
+				repeat_from = data->lines[repeats[r].line].time;
+		}
+		if (repeat_from == from_time) break;
+		from_time = repeat_from;
+	}
+	if (data->lines.count != line_count)
+		data->lines_moved += 1;
+	for (int32_t b = 0; b < logcat_buffer_count; b++) {
+		block_array_t<int64_t, 14> &buffer_lines = data->buffer_lines[b];
+		while (buffer_lines.count > 0 && buffer_lines.last() >= data->line_base + data->lines.count)
+			buffer_lines.pop();
+	}
+	for (int32_t l = 0; l < logcat_level_count; l++) {
+		block_array_t<int64_t, 14> &level_lines = data->level_lines[l];
+		while (level_lines.count > 0 && level_lines.last() >= data->line_base + data->lines.count)
+			level_lines.pop();
+	}
+	while (data->event_fields.count > data->buffer_lines[logcat_buffer_events].count) {
+		data->fields.count = data->event_fields.last();
+		data->event_fields.pop();
+	}
+
+	*out_last = {};
+	int32_t key_count = 0;
+	for (int64_t i = data->lines.count - 1; i >= 0 && key_count < recent_max; i--) {
+		const logcat_line_t &line = data->lines[i];
+		if (line.severity == 0) continue;
+		if (out_last->time == 0)
+			*out_last = line;
+		if (line.time != out_last->time) break;
+		out_recent_keys[key_count++] = logcat_line_key(&line, logcat_line_text(data, &line));
+	}
+
+	perf_unlock(data->lines_mutex, perf_thread_ingest);
+}
+
+///////////////////////////////////////////
+
+void logcat_add_marker(logcat_thread_t *ref_thread, const char *text) {
+	logcat_line_t line_data = {};
+
+	char empty_tag[1] = "";
+	perf_lock(ref_thread->data->lines_mutex, perf_thread_ingest);
+	line_data.tag = logcat_get_tag(ref_thread->data, empty_tag);
+	logcat_add_line(ref_thread->data, &line_data, text);
+	perf_unlock(ref_thread->data->lines_mutex, perf_thread_ingest);
+}
+
+///////////////////////////////////////////
+
+// Events buffer lines name their event, but not its fields, those are in
+// the device's /system/etc/event-log-tags. That only changes with the OS,
+// so it's fetched once per device and kept in the cache folder.
+void logcat_event_tags_load(logcat_thread_t *ref_thread) {
+	TRACE_ZONE("logcat_event_tags_load");
+
+	char path[512];
+	bool has_path = adb_cache_path(ref_thread->device_id, "event-log-tags-", path, sizeof(path));
+
+	char *text = nullptr;
+	FILE *fp   = has_path ? fopen(path, "rb") : nullptr;
+	if (fp != nullptr) {
+		fseek(fp, 0, SEEK_END);
+		long size = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+		text = (char*)malloc(size + 1);
+		text[fread(text, 1, size, fp)] = '\0';
+		fclose(fp);
+	} else {
+		const char *args[] = { "cat", "/system/etc/event-log-tags", nullptr };
+		text = adb_shell_output(ref_thread->device_id[0] != '\0' ? ref_thread->device_id : nullptr, args);
+		// Don't keep an error message around as if it was the file
+		if (text != nullptr && has_path && strstr(text, "No such file") == nullptr && (fp = fopen(path, "wb")) != nullptr) {
+			fwrite(text, 1, strlen(text), fp);
+			fclose(fp);
+		}
+	}
+	if (text == nullptr) return;
+
+	perf_lock(ref_thread->data->lines_mutex, perf_thread_ingest);
+	logcat_parse_event_tags(ref_thread->data, text);
+	logcat_events_decode   (ref_thread->data);
+	perf_unlock(ref_thread->data->lines_mutex, perf_thread_ingest);
+	free(text);
+}
+
+///////////////////////////////////////////
+
+// Lines look like "<number> <tag> (<name>|<type>[|<unit>]),...", where type
+// 1 is int, 2 long, 3 string, 4 list and 5 float. Expects the lines mutex
+// to be held.
+void logcat_parse_event_tags(logcat_data_t *ref_data, char *text) {
+	char *line = text;
+	while (*line != '\0') {
+		char *line_end = line + strcspn(line, "\r\n");
+		char *next     = *line_end == '\0' ? line_end : line_end + 1;
+		*line_end = '\0';
+
+		int32_t number;
+		int32_t scanned = 0;
+		char    tag[128];
+		if (line[0] != '#' && sscanf(line, "%d %127s %n", &number, tag, &scanned) >= 2 && scanned > 0) {
+			logcat_event_t event = {};
+			bool           valid = true;
+			for (char *field = strchr(line + scanned, '('); field != nullptr && valid; field = strchr(field, '(')) {
+				field += 1;
+				char    name[64];
+				int32_t type = 0;
+				valid = event.field_count < 16 && sscanf(field, "%63[^|)]|%d", name, &type) >= 1;
+				if (!valid) break;
+
+				int32_t name_idx = logcat_find_field(ref_data, name);
+				if (name_idx < 0) name_idx = ref_data->field_names.add(strdup(name));
+				event.field_names[event.field_count] = (uint16_t)name_idx;
+				event.numeric    [event.field_count] = type == 1 || type == 2 || type == 5;
+				event.field_count += 1;
+			}
+			if (valid && event.field_count > 0 && logcat_event_find(ref_data, tag) < 0) {
+				event.tag = strdup(tag);
+				ref_data->events.add(event);
+			}
+		}
+		line = next;
+	}
+
+	ref_data->tag_events.clear();
+	for (int32_t t = 0; t < ref_data->tags.count; t++)
+		ref_data->tag_events.add(logcat_event_find(ref_data, ref_data->tags[t]));
+}
+
+///////////////////////////////////////////
+
+int32_t logcat_event_find(const logcat_data_t *data, const char *tag) {
+	for (int32_t i = 0; i < data->events.count; i++) {
+		if (strcmp(data->events[i].tag, tag) == 0)
+			return i;
+	}
+	return -1;
+}
+
+///////////////////////////////////////////
+
+// logcat prints an event's fields as "[1,2,text]", or a lone one bare. Text
+// isn't quoted, so when there's more commas than fields we can't tell which
+// is which, and leave it be.
+void logcat_decode_event(logcat_data_t *ref_data, const logcat_line_t *line, const char *text) {
+	if (line->tag >= ref_data->tag_events.count || ref_data->tag_events[line->tag] < 0) return;
+	const logcat_event_t &event = ref_data->events[ref_data->tag_events[line->tag]];
+
+	const char *start = text;
+	while (*start == ' ') start++;
+	const char *end = start + strlen(start);
+	if (*start == '[') {
+		start += 1;
+		end    = strrchr(start, ']');
+		if (end == nullptr) return;
+	}
+	int32_t commas = 0;
+	for (const char *c = start; c < end; c++)
+		if (*c == ',') commas++;
+	if (commas + 1 != event.field_count) return;
+
+	const char *at = start;
+	for (int32_t f = 0; f < event.field_count; f++) {
+		const char *next = f + 1 < event.field_count ? strchr(at, ',') : end;
+		if (event.numeric[f]) {
+			char  *parsed;
+			double value = strtod(at, &parsed);
+			if (parsed > at && parsed <= next)
+				ref_data->fields.add({ event.field_names[f], value });
+		}
+		at = next + 1;
+	}
+}
+
+///////////////////////////////////////////
+
+// Reading more than one buffer, logcat marks the first line from each with
+// "--------- beginning of <buffer>", and with -D each change of buffer with
+// "--------- switch to <buffer>". Returns true if text is one of those.
+bool logcat_parse_banner(const char *text, int32_t *ref_buffer) {
+	const char *name = nullptr;
+	if      (strncmp(text, "--------- beginning of ", 23) == 0) name = text + 23;
+	else if (strncmp(text, "--------- switch to ",    20) == 0) name = text + 20;
+	else return false;
+
+	size_t len = 0;
+	while (name[len] >= 'a' && name[len] <= 'z') len++;
+	for (int32_t b = 1; b < logcat_buffer_count; b++) {
+		if (strlen(logcat_buffer_names[b]) == len && strncmp(name, logcat_buffer_names[b], len) == 0) {
+			*ref_buffer = b;
+			return true;
+		}
+	}
+	// A buffer we don't know of yet, better shown than lost
+	*ref_buffer = logcat_buffer_main;
+	return true;
+}
+
+///////////////////////////////////////////
+
+// Packs a logcat timestamp into something that sorts and compares as time
+// does. logcat doesn't say which year it is, so this only works within one.
+uint64_t logcat_line_time(int32_t month, int32_t day, int32_t hour, int32_t minute, int32_t second, int32_t millisecond) {
+	uint64_t result = (uint64_t)month;
+	result = result * 32   + day;
+	result = result * 24   + hour;
+	result = result * 60   + minute;
+	result = result * 60   + second;
+	result = result * 1000 + millisecond;
+	return result;
+}
+
+///////////////////////////////////////////
+
+// Identifies a line well enough to tell if we've seen it before
+uint64_t logcat_line_key(const logcat_line_t *line, const char *text) {
+	// FNV-1a over the text, with the rest of the header folded in
+	uint64_t hash = 14695981039346656037ull;
+	for (const char *c = text; *c != '\0'; c++) {
+		hash ^= (uint8_t)*c;
+		hash *= 1099511628211ull;
+	}
+	hash ^= line->time * 0x9E3779B97F4A7C15ull;
+	hash ^= ((uint64_t)line->pid << 32 | line->tid) * 0xC2B2AE3D27D4EB4Full;
+	return hash;
+}
+
+///////////////////////////////////////////
+
 // line parsing extracted from logcat_from_file and logcat_thread
-logcat_line_t logcat_parse_line(char *line_buffer, char *out_tag) {
+// out_text points into line_buffer, after the header
+logcat_line_t logcat_parse_line(char *line_buffer, char *out_tag, const char **out_text) {
+	TRACE_ZONE("logcat_parse_line");
 	logcat_line_t result = {};
 
 	if (line_buffer[0] >= '0' && line_buffer[0] <= '9') {
@@ -212,22 +1861,16 @@ logcat_line_t logcat_parse_line(char *line_buffer, char *out_tag) {
 		result.millisecond = ms;
 		result.pid    = pid;
 		result.tid    = tid;
+		result.time   = logcat_line_time(m, d, h, min, s, ms);
 
 		size_t tag_len = strlen(out_tag);
 		while (tag_len > 0 && out_tag[tag_len - 1] == ':') tag_len--;
 		out_tag[tag_len] = '\0';
 
-		const char *copy = line_buffer + scanned;
-		result.line = (char*)malloc(strlen(copy) + 1);
-		strcpy(result.line, copy);
+		*out_text = line_buffer + scanned;
 	} else {
 		out_tag[0] = '\0';
-		result.line = (char*)malloc(strlen(line_buffer) + 1);
-		strcpy(result.line, line_buffer);
-	}
-	if (result.line == nullptr) {
-		printf("err: %s\n", line_buffer);
-		result.line = nullptr;
+		*out_text  = line_buffer;
 	}
 	return result;
 }
\ No newline at end of file
@@ -3,10 +3,31 @@
 #include <stdint.h>
 
 #include "array.h"
+#include "block_array.h"
+#include "pattern.h"
 #include "platform.h"
+#include "adb.h"
 
 ///////////////////////////////////////////
 
+// Which of the device's log buffers a line came from. logcat only says so
+// in the "--------- switch to <buffer>" banners between lines.
+enum logcat_buffer_ {
+	logcat_buffer_none, // Not from the device, like log-panther's own markers
+	logcat_buffer_main,
+	logcat_buffer_system,
+	logcat_buffer_crash,
+	logcat_buffer_radio,
+	logcat_buffer_events,
+	logcat_buffer_kernel,
+	logcat_buffer_security,
+	logcat_buffer_stats,
+	logcat_buffer_count,
+};
+
+// Severities by logcat_severity_level, 0 for lines without one
+const int32_t logcat_level_count = 7;
+
 struct logcat_line_t {
 	uint8_t  month;
 	uint8_t  day;
@@ -18,33 +39,213 @@ struct logcat_line_t {
 	uint16_t pid;
 	uint16_t tid;
 	uint16_t tag;
-	uint64_t time;
-	char    *line;
+	uint8_t  buffer; // logcat_buffer_
+	uint8_t  repeated; // Has an entry in repeats, see logcat_line_repeat
+	uint64_t time; // Sortable ms timestamp within a year, see logcat_line_time
+	uint64_t segment : 24; // Where the text is, see logcat_line_text. 4TB of it.
+	uint64_t text    : 24; // Offset into the segment's text
+	uint64_t pattern : 16; // Message template, see pattern_match
+};
+
+// Line text is appended to segments of logcat_segment_size. Once one is full
+// and a few newer ones have followed it, it gets compressed, and is unpacked
+// again into a small cache of segments when something reads it. When more
+// than packed_max is packed, the oldest go out to a temp file, and get
+// mapped back in to unpack.
+struct logcat_segment_t {
+	char    *text;        // Null while packed and not cached
+	uint8_t *packed;      // Null until it's compressed, or once it's spilled
+	int32_t  text_size;   // Bytes of text, with each line's terminator
+	int32_t  packed_size;
+	int32_t  lines;       // Lines still using it, it's freed once none are
+	bool     spilled;
+	uint64_t spill_at;    // Where it is in the spill file
+};
+
+// A line that came again, the same but for its time, while collapse was on.
+// The copies aren't stored, just counted here.
+struct logcat_repeat_t {
+	int64_t       line;  // The first copy
+	int64_t       count; // Copies, the first one included
+	logcat_line_t last;  // The latest copy, its text is the first's
 };
 
+// Who a thread id belongs to, so a reused tid can't pick up a dead
+// thread's name
+struct logcat_thread_name_t {
+	uint16_t pid;
+	uint16_t name;
+};
+
+// A number from an events buffer line's payload
+struct logcat_field_t {
+	uint16_t name; // Index into field_names
+	double   value;
+};
+
+// How an event's payload is laid out, from the device's event-log-tags,
+// "20003 dvm_lock_sample (process|3),(main|1|5),(thread|3),(time|1|3),..."
+struct logcat_event_t {
+	char    *tag;
+	int32_t  field_count;
+	uint16_t field_names[16];
+	bool     numeric    [16]; // Int, long or float, the ones we keep
+};
+
+// Line ids of one pid or tid, in small blocks since most only have a few
+typedef block_array_t<int64_t, 8> logcat_id_list_t;
+
 struct logcat_data_t {
 	int32_t                lines_last;
-	array_t<logcat_line_t> lines;
+	block_array_t<logcat_line_t> lines; // Never moves a line once it's added, see block_array_t
 	array_t<char *>        tags;
+	array_t<char *>        names;     // Process and thread names, 0 is ""
+	int32_t               *names_table;      // Open addressing, names index + 1
+	int32_t                names_table_size;
+	int32_t                names_moved; // Goes up when unused names are dropped and the rest renumbered
+	uint16_t              *pid_names; // 65536 name indices, by pid
+	logcat_thread_name_t  *tid_names; // 65536 names, by tid
+	// The index lists hold line ids, which are the line's index plus
+	// line_base. Trimming and backfill move line_base rather than every id.
+	int64_t                line_base;
+	block_array_t<int64_t, 14> buffer_lines[logcat_buffer_count]; // Ids of each buffer's lines, in order
+	block_array_t<int64_t, 14> level_lines [logcat_level_count];  // Same, by logcat_severity_level
+	logcat_id_list_t      *pid_lines; // Same, 65536 of them by pid, made with the first line
+	logcat_id_list_t      *tid_lines; // And by tid
+
+	// Events buffer payloads, decoded as the lines come in
+	array_t<logcat_event_t> events;       // Payload layouts
+	array_t<int32_t>        tag_events;   // events index by tags index, -1 if it's not an event
+	array_t<char *>         field_names;
+	array_t<logcat_field_t> fields;
+	array_t<int32_t>        event_fields; // Where each of buffer_lines[logcat_buffer_events]' fields start in fields
+
+	// Line text, see logcat_line_text
+	array_t<logcat_segment_t> segments;
+	int32_t                   segment_open;     // The one being appended to
+	int32_t                   segment_unpacked; // Segments before this one are all packed or freed
+	array_t<int32_t>          segment_cache;    // Unpacked segments, least recently used first
+	int32_t                   segments_cleared; // Goes up when they're all thrown away
+	int32_t                   segment_resident; // Segments before this one are all spilled or freed
+	size_t                    packed_bytes;     // Packed text in memory
+	size_t                    packed_max;       // Past this it spills, 0 never does. From LOGPANTHER_MEMORY_MB.
+	platform_file_t           spill_file;       // Only ever appended to, made on first use
+	uint64_t                  spill_size;
+	// Lines from the same pid, tid and tag with the same text as one of the
+	// last few get counted against it instead, while collapse is on
+	bool                                collapse; // Set by the UI, under the lock
+	block_array_t<logcat_repeat_t, 12>  repeats;  // By line, in order
+	int64_t                             repeat_copies; // Copies counted rather than stored
+
+	pattern_tree_t         patterns;   // Templates of the lines' text, by logcat_line_t::pattern
+	size_t                 text_bytes; // Line text held, uncompressed
+	int64_t                prepended;  // Lines inserted at the front, the UI shifts its indices by this and zeroes it
+	int32_t                lines_moved; // Goes up when lines are removed or inserted anywhere but the end, so anything kept by line index has to start over
     platform_mutex_t       lines_mutex;
 	char                   src_id[64];
 };
 
+// What to ask the device for, instead of everything. logcat can narrow to
+// one pid, or to a set of exact tag names, but not both ORed together.
+struct logcat_filter_t {
+	int32_t pid;
+	int32_t tag_count;
+	char    tags[16][64];
+};
+
 struct logcat_thread_t {
     logcat_data_t         *data;
 	platform_thread_t      thread;
-	platform_process_t     process;
-	platform_pipe_t        stdout_pipe;
+	adb_stream_t           stream;
+	char                   device_id[64];
 	bool                   run;
 	bool                   pause;
+	bool                   connected; // False while waiting to reconnect
+	logcat_filter_t        filter;         // Set through logcat_thread_filter
+	bool                   filter_changed; // Under the lines mutex
+
+	// Follows a package's process through ActivityManager's "Start proc"
+	// lines, so a launched app can be filtered to without asking the device
+	char                   watch_package[256]; // Set through logcat_thread_watch
+	int32_t                watch_pid;          // Latest pid it started with
+	int32_t                watch_starts;       // Goes up each time it starts
+	int32_t                packages_changed;   // Goes up on package install/removal broadcasts
+
+	// Fetches what's already in the device's log buffer, alongside the live
+	// tail, and slots it in ahead of the live lines when it's done
+	platform_thread_t      backfill_thread;
+	adb_stream_t           backfill_stream;
+	bool                   backfilling;
+	size_t                 backfill_bytes;
+	size_t                 backfill_total; // Estimate from logcat -g, 0 if unknown
+
+	// Keeps data's process and thread names up to date
+	platform_thread_t      names_thread;
+	bool                   names_stale; // Processes started since the last ps
+
+	// Compresses data's older text segments
+	platform_thread_t      pack_thread;
 };
 
 void     logcat_create      (      logcat_data_t *out_data);
-int32_t  logcat_thread_start(const char *opt_device_id, logcat_thread_t *out_thread, logcat_data_t *out_data);
+int32_t  logcat_thread_start(const char *opt_device_id, logcat_thread_t *out_thread, logcat_data_t *ref_data);
 void     logcat_thread_end  (      logcat_thread_t *ref_thread);
+// Asks the device to only send lines matching filter, or everything when it's
+// empty. The capture restarts from where it was, and lines left out while a
+// narrower filter was on get fetched again when it's relaxed.
+void     logcat_thread_filter(     logcat_thread_t *ref_thread, const logcat_filter_t *filter);
+// Starts following package's process, see watch_pid and watch_starts
+void     logcat_thread_watch(      logcat_thread_t *ref_thread, const char *package);
 bool     logcat_from_file   (      logcat_data_t   *out_data, const char *filename);
-bool     logcat_to_file     (const logcat_data_t   *data, const char *filename);
+bool     logcat_to_file     (      logcat_data_t   *data, const char *filename);
 void     logcat_destroy     (      logcat_data_t   *ref_data);
 bool     logcat_to_file     (const logcat_data_t   *data);
 uint16_t logcat_get_tag     (      logcat_data_t   *data, char *tag);
-void     logcat_clear       (      logcat_data_t   *ref_data);
\ No newline at end of file
+void     logcat_clear       (      logcat_data_t   *ref_data);
+// Decodes every events buffer line again. Expects the lines mutex to be
+// held.
+void     logcat_events_decode(     logcat_data_t   *ref_data);
+// Keeps only lines first through last, and lets go of the rest. Expects the
+// lines mutex to be held.
+void     logcat_trim        (      logcat_data_t   *ref_data, int64_t first, int64_t last);
+
+const char *logcat_buffer_name(int32_t buffer);
+// Severity letters in order, V as 1 up to F as 6, 0 for lines without one
+int32_t     logcat_severity_level(uint8_t severity);
+// The nearest line after from, or before it when direction is -1, with a
+// level of at least level_min, or -1 if there's none. A binary search per
+// level. Expects the lines mutex to be held.
+int64_t     logcat_level_next    (const logcat_data_t *data, int32_t level_min, int64_t from, int32_t direction);
+// Where line is in one of pid_lines or tid_lines, or where it would go if
+// it isn't there
+int64_t     logcat_index_find    (const logcat_data_t *data, const logcat_id_list_t *list, int64_t line);
+
+// A line's text, unpacking its segment if it was compressed. Expects the
+// lines mutex to be held, and the text is only good until the next call.
+const char *logcat_line_text   (      logcat_data_t *ref_data, const logcat_line_t *line);
+// How often a line came again while collapse was on, null if it didn't.
+// Expects the lines mutex to be held.
+const logcat_repeat_t *logcat_line_repeat(const logcat_data_t *data, int64_t line);
+// Lets go of a line's text, for when it's removed from lines. Expects the
+// lines mutex to be held.
+void        logcat_line_release(      logcat_data_t *ref_data, const logcat_line_t *line);
+// Compresses the oldest segment that's due for it, false if none are. Takes
+// the lines mutex itself, but not while compressing.
+bool        logcat_pack_next   (      logcat_data_t *ref_data);
+
+// Numbers decoded from an events buffer line, 0 if there are none. Expects
+// the lines mutex to be held, and out_fields is only good until it's let go.
+int32_t  logcat_line_fields (const logcat_data_t *data, int64_t line, const logcat_field_t **out_fields);
+int32_t  logcat_find_field  (const logcat_data_t *data, const char *name);
+
+// Names for pids and tids, "" while unknown. Kept up to date from a ps
+// snapshot and ActivityManager's lines, and cheap enough to call per line.
+const char *logcat_process_name(const logcat_data_t *data, uint16_t pid);
+const char *logcat_thread_name (const logcat_data_t *data, uint16_t pid, uint16_t tid);
+uint16_t    logcat_get_name    (      logcat_data_t *data, const char *name);
+
+// Lets the ingest thread wake up the UI when new lines arrive. on_wake gets
+// called from the ingest thread at most once between calls to
+// logcat_wake_reset, so a burst of lines only wakes the UI once per frame.
+void     logcat_wake_set    (void (*on_wake)());
+void     logcat_wake_reset  ();
\ No newline at end of file
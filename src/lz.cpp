@@ -0,0 +1,180 @@
+#include "lz.h"
+
+#include <string.h>
+
+///////////////////////////////////////////
+
+const int32_t lz_hash_bits  = 14;
+const int32_t lz_min_match  = 4;
+const int32_t lz_max_offset = 65535;
+// Like LZ4, matches stop short of the end so the last bytes are always
+// literals, and the decoder never has a match running off the end
+const int32_t lz_end_literals = 5;
+const int32_t lz_match_limit  = 12;
+
+uint32_t lz_read32      (const uint8_t *at);
+uint8_t *lz_write_length(uint8_t *out, int32_t length);
+bool     lz_emit        (uint8_t **ref_out, const uint8_t *out_end, const uint8_t *literals, int32_t literal_count, int32_t offset, int32_t match_length);
+bool     lz_read_length (const uint8_t **ref_in, const uint8_t *in_end, int32_t *ref_length);
+void     lz_copy_wild   (uint8_t *dst, const uint8_t *src, int32_t size);
+
+///////////////////////////////////////////
+
+uint32_t lz_read32(const uint8_t *at) {
+	uint32_t result;
+	memcpy(&result, at, sizeof(result));
+	return result;
+}
+
+///////////////////////////////////////////
+
+uint8_t *lz_write_length(uint8_t *out, int32_t length) {
+	while (length >= 255) {
+		*out++  = 255;
+		length -= 255;
+	}
+	*out++ = (uint8_t)length;
+	return out;
+}
+
+///////////////////////////////////////////
+
+int32_t lz_bound(int32_t size) {
+	return size + size / 255 + 16;
+}
+
+///////////////////////////////////////////
+
+// Writes one sequence, match_length 0 for the literals only last one
+bool lz_emit(uint8_t **ref_out, const uint8_t *out_end, const uint8_t *literals, int32_t literal_count, int32_t offset, int32_t match_length) {
+	uint8_t *out = *ref_out;
+	// Token, length bytes, literals, offset
+	if (out_end - out < 1 + literal_count / 255 + 1 + literal_count + 2 + match_length / 255 + 1)
+		return false;
+
+	uint8_t *token = out++;
+	*token = (uint8_t)((literal_count < 15 ? literal_count : 15) << 4);
+	if (literal_count >= 15) out = lz_write_length(out, literal_count - 15);
+	memcpy(out, literals, literal_count);
+	out += literal_count;
+
+	if (match_length > 0) {
+		int32_t extra = match_length - lz_min_match;
+		*token |= (uint8_t)(extra < 15 ? extra : 15);
+		*out++  = (uint8_t)(offset & 0xFF);
+		*out++  = (uint8_t)(offset >> 8);
+		if (extra >= 15) out = lz_write_length(out, extra - 15);
+	}
+	*ref_out = out;
+	return true;
+}
+
+///////////////////////////////////////////
+
+int32_t lz_compress(const uint8_t *src, int32_t size, uint8_t *dst, int32_t capacity) {
+	// Where each 4 byte sequence was last seen, hashed
+	int32_t table[1 << lz_hash_bits];
+	memset(table, 0xFF, sizeof(table));
+
+	uint8_t       *out     = dst;
+	const uint8_t *out_end = dst + capacity;
+	int32_t        at      = 0;
+	int32_t        anchor  = 0; // Start of the literals not written yet
+	while (at < size - lz_match_limit) {
+		uint32_t sequence  = lz_read32(src + at);
+		uint32_t hash      = (sequence * 2654435761u) >> (32 - lz_hash_bits);
+		int32_t  candidate = table[hash];
+		table[hash] = at;
+		if (candidate < 0 || at - candidate > lz_max_offset || lz_read32(src + candidate) != sequence) {
+			// Stride faster through stuff that doesn't repeat
+			at += 1 + ((at - anchor) >> 6);
+			continue;
+		}
+
+		while (at > anchor && candidate > 0 && src[at - 1] == src[candidate - 1]) {
+			at--;
+			candidate--;
+		}
+		int32_t length = lz_min_match;
+		while (at + length < size - lz_end_literals && src[at + length] == src[candidate + length])
+			length++;
+
+		if (!lz_emit(&out, out_end, src + anchor, at - anchor, at - candidate, length))
+			return 0;
+		at     += length;
+		anchor  = at;
+	}
+	if (!lz_emit(&out, out_end, src + anchor, size - anchor, 0, 0))
+		return 0;
+	return (int32_t)(out - dst);
+}
+
+///////////////////////////////////////////
+
+bool lz_read_length(const uint8_t **ref_in, const uint8_t *in_end, int32_t *ref_length) {
+	const uint8_t *in = *ref_in;
+	uint8_t        add;
+	do {
+		if (in >= in_end) return false;
+		add          = *in++;
+		*ref_length += add;
+	} while (add == 255);
+	*ref_in = in;
+	return true;
+}
+
+///////////////////////////////////////////
+
+// Copies 8 bytes at a time, which can run up to 7 past size on both ends,
+// so only for when there's room. Most runs are short, and this beats
+// calling memcpy for each.
+void lz_copy_wild(uint8_t *dst, const uint8_t *src, int32_t size) {
+	uint8_t *end = dst + size;
+	do {
+		memcpy(dst, src, 8);
+		dst += 8;
+		src += 8;
+	} while (dst < end);
+}
+
+///////////////////////////////////////////
+
+bool lz_decompress(const uint8_t *src, int32_t size, uint8_t *dst, int32_t dst_size) {
+	const uint8_t *in      = src;
+	const uint8_t *in_end  = src + size;
+	uint8_t       *out     = dst;
+	uint8_t       *out_end = dst + dst_size;
+	while (in < in_end) {
+		uint8_t token = *in++;
+
+		int32_t literal_count = token >> 4;
+		if (literal_count == 15 && !lz_read_length(&in, in_end, &literal_count)) return false;
+		if (literal_count > in_end - in || literal_count > out_end - out)        return false;
+		if (in_end - in >= literal_count + 8 && out_end - out >= literal_count + 8) lz_copy_wild(out, in, literal_count);
+		else                                                                        memcpy      (out, in, literal_count);
+		in  += literal_count;
+		out += literal_count;
+		if (in == in_end) break;
+
+		if (in_end - in < 2) return false;
+		int32_t offset = in[0] | (in[1] << 8);
+		in += 2;
+		int32_t length = token & 15;
+		if (length == 15 && !lz_read_length(&in, in_end, &length)) return false;
+		length += lz_min_match;
+		if (offset == 0 || offset > out - dst || length > out_end - out) return false;
+
+		// Matches can overlap what they're writing, which repeats the pattern
+		const uint8_t *from = out - offset;
+		if (offset >= 8 && out_end - out >= length + 8) {
+			lz_copy_wild(out, from, length);
+		} else if (offset >= length) {
+			memcpy(out, from, length);
+		} else {
+			for (int32_t i = 0; i < length; i++)
+				out[i] = from[i];
+		}
+		out += length;
+	}
+	return out == out_end;
+}
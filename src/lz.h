@@ -0,0 +1,18 @@
+#pragma once
+
+// A small LZ77 block codec in LZ4's block format: each sequence is a token
+// byte (literal count high nibble, match length - 4 low nibble, 15 meaning
+// more length bytes follow), the literals, then a 2 byte little endian
+// offset back into what's been written. The last sequence is literals only.
+// Built for speed over ratio, which suits log text well enough.
+
+#include <stdint.h>
+
+///////////////////////////////////////////
+
+// The most lz_compress can write for size bytes of input
+int32_t lz_bound     (int32_t size);
+// Returns the compressed size, or 0 if it doesn't fit in capacity
+int32_t lz_compress  (const uint8_t *src, int32_t size, uint8_t *dst, int32_t capacity);
+// Unpacks exactly dst_size bytes, false if src is damaged or a different size
+bool    lz_decompress(const uint8_t *src, int32_t size, uint8_t *dst, int32_t dst_size);
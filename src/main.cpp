@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <cmath>
+#include <atomic>
 
 #include <GLFW/glfw3.h>
 #include <glad/glad.h>
@@ -15,10 +16,14 @@
 #include "../vendor/imgui_impl_opengl3.h"
 
 #include "array.h"
+#include "bitmap.h"
 #include "logdata.h"
+#include "query.h"
 #include "device_finder.h"
 #include "app_finder.h"
 #include "platform.h"
+#include "perf.h"
+#include "trace.h"
 
 #define GLSL_VERSION "#version 330"
 
@@ -29,22 +34,71 @@ logcat_thread_t logcat_thread = {};
 device_finder_t device_finder = {};
 app_finder_t    app_finder    = {};
 app_launcher_t  app_launcher  = {};
-int32_t         app_selected  = -1;
+char            app_selected[256];
 bool            device_autoconnect;
+platform_thread_t search_thread = nullptr; // See details_search_wake
+std::atomic<bool> search_run    = true;    // Cleared to stop it early
+std::atomic<bool> search_busy   = false;   // Until it runs out of lines to scan
+
+// A test on a number decoded from an events buffer line, parsed from text
+// like "dvm_lock_sample.time>100" or "time>=100"
+struct details_field_t {
+	int32_t tag;   // logcat.tags index, -1 for any event with the field
+	int32_t name;  // logcat.field_names index, -1 if no event has it
+	char    op;    // < > = !, or l and g for <= and >=
+	double  value;
+};
+
+// Which lines a text or tag filter matches, kept from frame to frame so it
+// only has to look at the lines that came in since, see details_match_terms
+struct details_term_t {
+	char    *text;
+	bool     tag;     // Tests the tag instead of the text
+	bool     used;    // By a filter this frame
+	int64_t  scanned; // Lines it's been tested on
+	bitmap_t lines;
+	array_t<bool> tags; // For a tag term, whether each of logcat.tags matches
+};
+// Terms kept around after their filter is gone, so bringing it back is free
+const int32_t details_terms_max = 32;
+// A term further behind than this is left to details_search_thread, so
+// typing a filter never waits on a scan
+const int64_t  details_search_sync     = 4096;
+// How long the search thread holds the lines mutex at a time
+const uint64_t details_search_slice_ns = 4 * 1000 * 1000;
 
 struct details_t {
 	array_t<char*>   tag_exclude;
 	array_t<char*>   tag_include;
+	array_t<char*>   app_exclude;
+	array_t<char*>   app_include;
+	array_t<bool>    app_exclude_names; // By logcat.names index, see details_match_apps
+	array_t<bool>    app_include_names;
 	array_t<char*>   text_exclude;
 	array_t<char*>   text_include;
+	array_t<char*>   field_include;
+	array_t<details_field_t> field_tests; // field_include parsed, see details_match_fields
 	array_t<uint16_t> pid_exclude;
 	array_t<uint16_t> pid_include;
-	int32_t selected;       // The anchor/primary selected line (shown in Selected window)
-	int32_t selection_end;  // -1 = no range, otherwise the other end of selection range
+	array_t<uint16_t> pattern_exclude;     // Template ids, see logcat_line_t::pattern
+	array_t<uint16_t> pattern_include;
+	array_t<bool>     pattern_exclude_ids; // By template id, see details_match_patterns
+	array_t<bool>     pattern_include_ids;
+	array_t<details_term_t> terms; // Least recently used first
+	int32_t  terms_moved;   // logcat.lines_moved when the terms were last good
+	bitmap_t term_include;  // This frame's text and tag includes ORed together
+	bitmap_t term_exclude;
+	bitmap_t term_rows;     // term_include without term_exclude, see details_terms_only
+	int64_t  search_scanned; // Lines the slowest term has been tested on, of search_total
+	int64_t  search_total;
+	query_t  query;         // From query_text, lines have to pass it as well as the rest
+	int64_t selected;       // The anchor/primary selected line (shown in Selected window)
+	int64_t selection_end;  // -1 = no range, otherwise the other end of selection range
 	float   selected_at;
-	int32_t focus_idx;
+	int64_t focus_idx;
 	float   focus_at;
-	int32_t center_idx;
+	int64_t center_idx;
+	int64_t step_at;        // Where the last step landed in its pid or tid list, see details_step
 };
 details_t details = {};
 
@@ -55,21 +109,42 @@ char text_search [512] = {};
 char tag_search  [512] = {};
 char text_exclude[512] = {};
 char tag_exclude [512] = {};
+char app_search  [256] = {};
+char app_exclude [256] = {};
+char field_search[128] = {};
 char pid_search  [32]  = {};
 char pid_exclude [32]  = {};
+char query_text  [512] = {};
 size_t text_search_len  = 0;
 size_t tag_search_len   = 0;
 size_t text_exclude_len = 0;
 size_t tag_exclude_len  = 0;
+size_t app_search_len   = 0;
+size_t app_exclude_len  = 0;
+size_t field_search_len = 0;
 uint16_t pid_search_live  = 0;
 uint16_t pid_exclude_live = 0;
 
+bool push_filters  = false; // Ask the device to leave out lines the filters would hide anyway
+bool collapse_lines = false; // Goes to logcat.collapse each frame, under the lock
+uint32_t buffers_shown = ~0u; // Bit per logcat_buffer_, lines from the others are left out entirely
+int32_t  level_min     = 1;   // Lines below this logcat_severity_level are left out entirely
+int32_t  only_pid      = -1;  // Lines from other processes are left out entirely, -1 for off
+int32_t  only_tid      = -1;  // Same for threads, only_pid is this thread's process
+int32_t  app_watch_starts = 0; // logcat_thread.watch_starts we've acted on
+uint16_t app_watch_pid    = 0; // Pid of the launched app we last filtered to
+
 bool show_copied_tooltip = false;
+bool show_diagnostics    = false;
+bool show_patterns       = false;
 bool drag_selecting = false;
 float zoom_scale = 1.0f;
+float buffer_column_width = 56.0f;
 float pid_column_width = 50.0f;
+float app_column_width = 120.0f;
 float tag_column_width = 100.0f;
 bool dragging_pid_column = false;
+bool dragging_app_column = false;
 bool dragging_tag_column = false;
 float drag_start_x = 0.0f;
 float drag_start_width = 0.0f;
@@ -80,19 +155,43 @@ const char *_strcasestr(const char *haystack, const char *needle);
 
 void      step();
 
-bool      details_is_valid      (const details_t *details, const logcat_line_t *line);
-void      details_get_selection  (const details_t *details, int32_t *out_start, int32_t *out_end);
-void      details_copy_selection (const details_t *details, const logcat_data_t *data, bool filter_active);
+bool      details_is_valid      (const details_t *details, int64_t line_idx);
+bool      details_line_shown    (const logcat_line_t *line);
+const logcat_id_list_t *details_only_lines();
+int64_t   details_step          (details_t *details, const logcat_id_list_t *list, int32_t direction);
+void      details_get_selection  (const details_t *details, int64_t *out_start, int64_t *out_end);
+void      details_copy_selection (const details_t *details, logcat_data_t *data, bool filter_active);
+void      details_promote_generic(array_t<char*> *lower, array_t<char*> *higher, const char *tag, char *avoid_buffer);
 void      details_promote_tag   (details_t *details, const char *tag);
 void      details_demote_tag    (details_t *details, const char *tag);
 void      details_promote_text  (details_t *details, const char *tag);
 void      details_demote_text   (details_t *details, const char *tag);
-
-void      window_log    ();
-void      window_filters();
-void      window_details();
+bool      details_device_filter (const details_t *details, logcat_filter_t *out_filter);
+void      details_match_apps    (details_t *details);
+void      details_match_fields  (details_t *details);
+void      details_match_patterns(details_t *details);
+void      details_match_terms   (details_t *details);
+void      details_match_query   (details_t *details);
+bool      details_query_behind  (const details_t *details);
+details_term_t *details_term    (details_t *details, const char *text, bool tag);
+void      details_term_scan     (details_t *details, details_term_t *ref_term, int64_t to);
+details_term_t *details_term_behind(details_t *details);
+int       details_search_thread (void *);
+void      details_search_wake   ();
+void      details_search_stop   ();
+void      details_forget_lines  (details_t *details);
+void      device_connect        (const char *device_id);
+bool      details_terms_only    (const details_t *details);
+void      details_toggle_pattern(array_t<uint16_t> *list, uint16_t pattern);
+
+void      window_log        ();
+void      window_filters    ();
+void      window_details    ();
+void      window_diagnostics();
+void      window_patterns   ();
 
 void      ui_set_theme();
+double    ui_wait_timeout();
 #ifdef PLATFORM_WINDOWS
 GLFWimage load_icon_image(int resource_id);
 #endif
@@ -102,10 +201,6 @@ GLFWimage load_icon_image(int resource_id);
 int main(int argc, char** argv) {
 	platform_set_working_dir_to_exe();
 
-	if (!device_finder_start(&device_finder)) {
-		printf("Could not start device finder\n");
-		return 1;
-	}
 	device_autoconnect = true;
 	details.selection_end = -1;
 	details.selected = -1;
@@ -132,6 +227,9 @@ int main(int argc, char** argv) {
 		return -1;
 	}
 	glfwMakeContextCurrent(window);
+	// Frames are only drawn on demand, vsync keeps bursts of them from
+	// running faster than the display can show them.
+	glfwSwapInterval(1);
 
 #ifdef PLATFORM_WINDOWS
 	GLFWimage icon = load_icon_image(101);
@@ -161,8 +259,35 @@ int main(int argc, char** argv) {
 
 	ui_set_theme();
 
+	// New log lines and device changes wake the main loop up through GLFW's
+	// event queue
+	logcat_wake_set(glfwPostEmptyEvent);
+	if (!device_finder_start(&device_finder, glfwPostEmptyEvent)) {
+		printf("Could not start device finder\n");
+		return 1;
+	}
+
+	TRACE_THREAD("main");
+
+	int32_t redraw_frames = 1;
 	while (!glfwWindowShouldClose(window)) {
-		glfwPollEvents();
+		// Sleep until there's input or new log lines. ImGui needs a couple
+		// of frames after an event for hover and layout to settle, so keep
+		// drawing for a few more before going back to sleep.
+		if (redraw_frames > 0) {
+			glfwPollEvents();
+			redraw_frames -= 1;
+		} else {
+			double timeout    = ui_wait_timeout();
+			double wait_start = glfwGetTime();
+			glfwWaitEventsTimeout(timeout);
+			if (glfwGetTime() - wait_start < timeout)
+				redraw_frames = 2;
+		}
+		logcat_wake_reset();
+
+		uint64_t frame_start = platform_time_ns();
+		TRACE_ZONE("frame");
 
 		glClearColor(0, 0, 0, 0);
 		glClear(GL_COLOR_BUFFER_BIT);
@@ -188,10 +313,23 @@ int main(int argc, char** argv) {
 
 		ImGui::Render();
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-		platform_sleep_ms(1);
+		perf_frame.frames   += 1;
+		perf_frame.frame_ns += platform_time_ns() - frame_start;
 		glfwSwapBuffers(window);
+
+		// Dragging and scrolling need continuous frames
+		if (ImGui::IsAnyMouseDown() || io.MouseWheel != 0 || io.MouseWheelH != 0)
+			redraw_frames = redraw_frames > 1 ? redraw_frames : 1;
 	}
 
+	// The ingest and tracker threads can still post events, so stop them
+	// before GLFW goes
+	logcat_thread_end    (&logcat_thread);
+	logcat_wake_set      (nullptr);
+	device_finder_destroy(&device_finder);
+	app_finder_destroy   (&app_finder);
+	details_search_stop  ();
+
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
@@ -199,8 +337,7 @@ int main(int argc, char** argv) {
 	glfwDestroyWindow(window);
 	glfwTerminate();
 
-	logcat_thread_end(&logcat_thread);
-	logcat_destroy   (&logcat);
+	logcat_destroy(&logcat);
 	return 0;
 }
 
@@ -208,16 +345,20 @@ int main(int argc, char** argv) {
 
 enum item_select_ {
 	item_select_none,
+	item_select_buffer,
 	item_select_pid,
+	item_select_app,
 	item_select_label,
 	item_select_text,
+	item_select_buffer_right,
 	item_select_pid_right,
+	item_select_app_right,
 	item_select_label_right,
 	item_select_text_right,
 };
 
-// Add a pid+label+text combo aligned to other label+value widgets
-item_select_ ui_log_item(uint16_t pid, const char* label, const char* text, bool selected, bool highlight_related) {
+// Add a buffer+pid+app+label+text combo aligned to other label+value widgets
+item_select_ ui_log_item(const char* buffer, uint16_t pid, const char* app, const char* label, const char* text, bool selected, bool highlight_related) {
 	ImGuiWindow* window = ImGui::GetCurrentWindow();
 	if (window->SkipItems)
 		return item_select_none;
@@ -225,8 +366,10 @@ item_select_ ui_log_item(uint16_t pid, const char* label, const char* text, bool
 	ImGuiContext& g = *GImGui;
 	const ImGuiStyle& style = g.Style;
 
-	// PID column (adjustable width)
-	const float pid_width = pid_column_width;
+	// PID and app columns (adjustable width), after a fixed buffer column
+	const float buffer_width = buffer_column_width;
+	const float pid_width    = pid_column_width;
+	const float app_width    = app_column_width;
 	char pid_str[16];
 	snprintf(pid_str, sizeof(pid_str), "%d", pid);
 
@@ -234,40 +377,66 @@ item_select_ ui_log_item(uint16_t pid, const char* label, const char* text, bool
 	ImVec2 label_size = label_full_size;
 	label_size.x = tag_column_width;
 
-	const ImRect pid_bb       (window->DC.CursorPos, window->DC.CursorPos + ImVec2(pid_width, label_size.y + style.FramePadding.y * 2));
-	const ImRect label_bb     (window->DC.CursorPos + ImVec2(pid_width, 0), window->DC.CursorPos + ImVec2(pid_width + label_size.x, label_size.y + style.FramePadding.y * 2));
-	const ImRect label_full_bb(window->DC.CursorPos + ImVec2(pid_width, 0), window->DC.CursorPos + ImVec2(pid_width + fmaxf(label_full_size.x + style.FramePadding.x, label_size.x), label_full_size.y + style.FramePadding.y * 2));
-	const ImRect total_bb     (window->DC.CursorPos, window->DC.CursorPos + ImVec2(ImGui::GetContentRegionAvail().x, style.FramePadding.y * 2) + ImVec2(pid_width, 0) + label_size);
+	const float  row_height = label_size.y + style.FramePadding.y * 2;
+	const ImVec2 origin       = window->DC.CursorPos + ImVec2(buffer_width, 0);
+	const ImRect buffer_bb    (window->DC.CursorPos, origin + ImVec2(0, row_height));
+	const ImRect pid_bb       (origin, origin + ImVec2(pid_width, row_height));
+	const ImRect app_bb       (origin + ImVec2(pid_width, 0), origin + ImVec2(pid_width + app_width, row_height));
+	const ImRect label_bb     (origin + ImVec2(pid_width + app_width, 0), origin + ImVec2(pid_width + app_width + label_size.x, row_height));
+	const ImRect label_full_bb(origin + ImVec2(pid_width + app_width, 0), origin + ImVec2(pid_width + app_width + fmaxf(label_full_size.x + style.FramePadding.x, label_size.x), label_full_size.y + style.FramePadding.y * 2));
+	const ImRect total_bb     (window->DC.CursorPos, window->DC.CursorPos + ImVec2(ImGui::GetContentRegionAvail().x, style.FramePadding.y * 2) + ImVec2(buffer_width + pid_width + app_width, 0) + label_size);
 	ImGui::ItemSize(total_bb, style.FramePadding.y);
 	if (!ImGui::ItemAdd(total_bb, 0))
 		return item_select_none;
 
-	bool hovered       = ImGui::IsItemHovered();
-	float mouse_x      = ImGui::GetMousePos().x;
-	bool pid_hovered   = hovered && (mouse_x < pid_bb.Max.x);
-	bool label_hovered = hovered && !pid_hovered && (mouse_x < label_bb.Max.x);
+	bool hovered        = ImGui::IsItemHovered();
+	float mouse_x       = ImGui::GetMousePos().x;
+	bool buffer_hovered = hovered && (mouse_x < buffer_bb.Max.x);
+	bool pid_hovered    = hovered && !buffer_hovered && (mouse_x < pid_bb.Max.x);
+	bool app_hovered   = hovered && !buffer_hovered && !pid_hovered && (mouse_x < app_bb.Max.x);
+	bool label_hovered = hovered && !buffer_hovered && !pid_hovered && !app_hovered && (mouse_x < label_bb.Max.x);
 
-	// Background for PID and label columns
-	ImGui::GetWindowDrawList()->AddRectFilled(ImVec2{0, pid_bb.Min.y}, label_bb.Max + ImVec2{0, style.ItemSpacing.y}, IM_COL32(30, 30, 30, 255));
+	// Background for PID, app and label columns
+	ImGui::GetWindowDrawList()->AddRectFilled(ImVec2{0, buffer_bb.Min.y}, label_bb.Max + ImVec2{0, style.ItemSpacing.y}, IM_COL32(30, 30, 30, 255));
 	if (highlight_related && !selected) ImGui::GetWindowDrawList()->AddRectFilled({0,total_bb.Min.y}, total_bb.Max, IM_COL32(60, 100, 80, 100));
 	if (hovered || selected) ImGui::GetWindowDrawList()->AddRect({0,total_bb.Min.y}, total_bb.Max, IM_COL32(255, 255, 255, 100));
 
 	// Render the main text
 	if (label_size.x > 0.0f) {
-		if (hovered && !label_hovered && !pid_hovered)
+		if (hovered && !label_hovered && !buffer_hovered && !pid_hovered && !app_hovered)
 			ImGui::GetWindowDrawList()->AddRectFilled(ImVec2(label_bb.Max.x, label_bb.Min.y), total_bb.Max, IM_COL32(50, 50, 50, 255));
 		ImGui::RenderText(ImVec2(label_bb.Max.x + style.ItemSpacing.x, label_bb.Min.y + style.FramePadding.y), text);
 	}
 
+	// Render the buffer, quieter than the rest since it's mostly "main"
+	if (buffer_hovered) {
+		ImGui::GetWindowDrawList()->AddRectFilled(ImVec2{0, buffer_bb.Min.y}, buffer_bb.Max, IM_COL32(50, 50, 50, 255));
+	}
+	ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyleColorVec4(ImGuiCol_TextDisabled));
+	ImGui::RenderTextClipped(buffer_bb.Min, buffer_bb.Max, buffer, nullptr, NULL, ImVec2(0.0f, 0.5f));
+	ImGui::PopStyleColor();
+
 	// Render the PID
 	if (pid_hovered) {
 		ImGui::GetWindowDrawList()->AddRectFilled(ImVec2{0, pid_bb.Min.y}, pid_bb.Max, IM_COL32(50, 50, 50, 255));
 	}
 	ImGui::RenderTextClipped(pid_bb.Min, pid_bb.Max, pid_str, nullptr, NULL, ImVec2(0.5f, 0.5f));
 
+	// Render the app, keeping the end of it since that's the part that
+	// tells packages apart
+	if (app_hovered) {
+		ImGui::GetWindowDrawList()->AddRectFilled(app_bb.Min, app_bb.Max, IM_COL32(50, 50, 50, 255));
+	}
+	const float app_max = app_bb.GetWidth() - style.FramePadding.x;
+	while (app[0] != '\0' && ImGui::CalcTextSize(app).x > app_max) {
+		const char *dot = strchr(app + 1, '.');
+		app = dot != nullptr ? dot : app + 1;
+	}
+	ImGui::RenderTextClipped(app_bb.Min, app_bb.Max, app, nullptr, NULL, ImVec2(0.0f, 0.5f));
+
 	// Render the label/tag
 	if (label_hovered) {
-		ImGui::GetWindowDrawList()->AddRectFilled(ImVec2{pid_bb.Max.x, label_full_bb.Min.y}, label_full_bb.Max, IM_COL32(50, 50, 50, 255));
+		ImGui::GetWindowDrawList()->AddRectFilled(ImVec2{app_bb.Max.x, label_full_bb.Min.y}, label_full_bb.Max, IM_COL32(50, 50, 50, 255));
 		ImGui::RenderTextClipped(label_full_bb.Min, label_full_bb.Max, label, NULL, NULL, ImVec2(0.0f, 0.5f));
 	} else {
 		ImGui::RenderTextClipped(label_bb.Min, label_bb.Max, label, nullptr, NULL, ImVec2(0.0f, 0.5f));
@@ -281,6 +450,11 @@ item_select_ ui_log_item(uint16_t pid, const char* label, const char* text, bool
 	ImRect pid_resize_bb(ImVec2(pid_bb.Max.x - resize_hover_width/2, pid_bb.Min.y), 
 	                     ImVec2(pid_bb.Max.x + resize_hover_width/2, pid_bb.Max.y));
 	bool pid_resize_hovered = pid_resize_bb.Contains(ImGui::GetMousePos());
+
+	// App column resize handle
+	ImRect app_resize_bb(ImVec2(app_bb.Max.x - resize_hover_width/2, app_bb.Min.y),
+	                     ImVec2(app_bb.Max.x + resize_hover_width/2, app_bb.Max.y));
+	bool app_resize_hovered = app_resize_bb.Contains(ImGui::GetMousePos());
 	
 	// Tag column resize handle  
 	ImRect tag_resize_bb(ImVec2(label_bb.Max.x - resize_hover_width/2, label_bb.Min.y),
@@ -295,6 +469,14 @@ item_select_ ui_log_item(uint16_t pid, const char* label, const char* text, bool
 			IM_COL32(150, 150, 150, 255));
 		ImGui::SetMouseCursor(ImGuiMouseCursor_ResizeEW);
 	}
+
+	if (app_resize_hovered || dragging_app_column) {
+		ImGui::GetWindowDrawList()->AddRectFilled(
+			ImVec2(app_bb.Max.x - resize_width/2, app_bb.Min.y),
+			ImVec2(app_bb.Max.x + resize_width/2, app_bb.Max.y),
+			IM_COL32(150, 150, 150, 255));
+		ImGui::SetMouseCursor(ImGuiMouseCursor_ResizeEW);
+	}
 	
 	if (tag_resize_hovered || dragging_tag_column) {
 		ImGui::GetWindowDrawList()->AddRectFilled(
@@ -310,6 +492,12 @@ item_select_ ui_log_item(uint16_t pid, const char* label, const char* text, bool
 		drag_start_x = ImGui::GetMousePos().x;
 		drag_start_width = pid_column_width;
 	}
+
+	if (app_resize_hovered && ImGui::IsMouseClicked(ImGuiMouseButton_Left)) {
+		dragging_app_column = true;
+		drag_start_x = ImGui::GetMousePos().x;
+		drag_start_width = app_column_width;
+	}
 	
 	if (tag_resize_hovered && ImGui::IsMouseClicked(ImGuiMouseButton_Left)) {
 		dragging_tag_column = true;
@@ -324,6 +512,14 @@ item_select_ ui_log_item(uint16_t pid, const char* label, const char* text, bool
 			dragging_pid_column = false;
 		}
 	}
+
+	if (dragging_app_column) {
+		float delta = ImGui::GetMousePos().x - drag_start_x;
+		app_column_width = fmaxf(20.0f, fminf(400.0f, drag_start_width + delta));
+		if (!ImGui::IsMouseDown(ImGuiMouseButton_Left)) {
+			dragging_app_column = false;
+		}
+	}
 	
 	if (dragging_tag_column) {
 		float delta = ImGui::GetMousePos().x - drag_start_x;
@@ -333,16 +529,21 @@ item_select_ ui_log_item(uint16_t pid, const char* label, const char* text, bool
 		}
 	}
 
-	bool left_clicked  = ImGui::IsItemClicked(ImGuiMouseButton_Left) && !pid_resize_hovered && !tag_resize_hovered;
-	bool right_clicked = ImGui::IsItemClicked(ImGuiMouseButton_Right) && !pid_resize_hovered && !tag_resize_hovered;
+	bool resize_hovered = pid_resize_hovered || app_resize_hovered || tag_resize_hovered;
+	bool left_clicked  = ImGui::IsItemClicked(ImGuiMouseButton_Left) && !resize_hovered;
+	bool right_clicked = ImGui::IsItemClicked(ImGuiMouseButton_Right) && !resize_hovered;
 
 	if (left_clicked) {
+		if (buffer_hovered) return item_select_buffer;
 		if (pid_hovered)   return item_select_pid;
+		if (app_hovered)   return item_select_app;
 		if (label_hovered) return item_select_label;
 		return item_select_text;
 	}
 	if (right_clicked) {
+		if (buffer_hovered) return item_select_buffer_right;
 		if (pid_hovered)   return item_select_pid_right;
+		if (app_hovered)   return item_select_app_right;
 		if (label_hovered) return item_select_label_right;
 		return item_select_text_right;
 	}
@@ -376,28 +577,66 @@ void step() {
 			ImGui::GetIO().FontGlobalScale = zoom_scale;
 		}
 	}
-
-	if (device_autoconnect && device_finder.state != device_finder_state_searching) { 
+	if (ImGui::IsKeyPressed(ImGuiKey_F12, false))
+		show_diagnostics = !show_diagnostics;
+	if (ImGui::IsKeyPressed(ImGuiKey_F11, false))
+		show_patterns = !show_patterns;
+
+	// Connect to the first device as soon as the tracker reports one, even
+	// if it gets plugged in after we start
+	if (device_finder_update(&device_finder) && device_autoconnect && device_finder.devices.count > 0) {
 		device_autoconnect = false;
-		if (device_finder.devices.count > 0) {
-			logcat_thread_end  (&logcat_thread);
-			logcat_thread_start(device_finder.devices[0].id, &logcat_thread, &logcat);
-		}
+		device_connect(device_finder.devices[0].id);
+	}
+	// Refresh the package list when we switch devices, or the log says
+	// something got installed or removed
+	static int32_t packages_seen = 0;
+	app_finder_update(&app_finder);
+	if (logcat_thread.run &&
+	    (strcmp(app_finder.device_id, logcat.src_id) != 0 || logcat_thread.packages_changed != packages_seen)) {
+		if (app_finder_start(&app_finder, logcat.src_id))
+			packages_seen = logcat_thread.packages_changed;
+	}
+	// Keep the device side filter in step with the filter window, but only
+	// once a filter is committed, not on every keystroke
+	logcat_filter_t device_filter = {};
+	bool            filter_ready  = !push_filters || details_device_filter(&details, &device_filter);
+	// A launched app's restarts are announced by another process, which a
+	// pid filter would leave out
+	if (logcat_thread.watch_package[0] != '\0' && device_filter.pid != 0)
+		device_filter = {};
+	if (logcat_thread.run && filter_ready &&
+	    memcmp(&device_filter, &logcat_thread.filter, sizeof(device_filter)) != 0) {
+		logcat_thread_filter(&logcat_thread, &device_filter);
 	}
 	window_filters();
 	window_details();
 	window_log();
+	if (show_diagnostics)
+		window_diagnostics();
+	if (show_patterns)
+		window_patterns();
 }
 
 ///////////////////////////////////////////
 
-array_t<int32_t> log_visible = {};
+struct log_row_t {
+	int64_t line;
+	bool    valid;
+};
+array_t<log_row_t> log_rows    = {};
+array_t<int64_t>   log_visible = {};
 void window_log() {
-	int32_t     filter_idx     = -1;
+	TRACE_ZONE("window_log");
+	int64_t     filter_idx     = -1;
 	const char *filter_text    = nullptr;
 	uint16_t    filter_pid     = 0;
 	bool        filter_promote = false;
 	bool        filter_tag     = false;
+	bool        filter_app     = false;
+	int32_t     filter_buffer  = -1;
+	char        filter_copy[4096+1]; // Line text is only ours while the lock is held
+	char        repeat_text[4096+32];
 
 	log_visible.clear();
 	details.selected_at = -1;
@@ -408,9 +647,12 @@ void window_log() {
 			const char *show_name = device_finder.state == device_finder_state_error ? "Error" : "Connect device...";
 			char show_name_buffer[128];
 			if (logcat_thread.run) {
+				// An unplugged device drops off the list while we wait for it
+				snprintf(show_name_buffer, sizeof(show_name_buffer), "%s - reconnecting", logcat.src_id);
+				if (!logcat_thread.connected) show_name = show_name_buffer;
 				for (int n = 0; n < device_finder.devices.count; n++) {
 					if (strcmp(logcat.src_id, device_finder.devices[n].id) == 0) {
-						snprintf(show_name_buffer, sizeof(show_name_buffer), "%s (%s)", device_finder.devices[n].model, device_finder.devices[n].id);
+						snprintf(show_name_buffer, sizeof(show_name_buffer), "%s (%s)%s", device_finder.devices[n].model, device_finder.devices[n].id, logcat_thread.connected ? "" : " - reconnecting");
 						show_name = show_name_buffer;
 						break;
 					}
@@ -418,76 +660,138 @@ void window_log() {
 			}
 			
 			ImGui::SetNextItemWidth(200);
-			static bool was_open = false;
 			if (ImGui::BeginCombo("##Connect to device", show_name)) {
-				if (was_open == false && device_finder.state == device_finder_state_finished) {
-					device_finder_start(&device_finder);
-				}
-				was_open = true;
-
 				// Loop through the items array and select the current item
 				for (int32_t n = 0; n < device_finder.devices.count; n++) {
 					snprintf(show_name_buffer, sizeof(show_name_buffer), "%s (%s)", device_finder.devices[n].model, device_finder.devices[n].id);
 					bool active = logcat_thread.run && strcmp(logcat.src_id, device_finder.devices[n].id) == 0;
-					if (ImGui::Selectable(show_name_buffer, active)) {
-						logcat_thread_end  (&logcat_thread);
-						logcat_thread_start(device_finder.devices[n].id, &logcat_thread, &logcat);
-					}
+					if (ImGui::Selectable(show_name_buffer, active))
+						device_connect(device_finder.devices[n].id);
 				}
 				ImGui::EndCombo();
-			} else {
-				was_open = false;
 			}
 		//}// else if ()
 		ImGui::SameLine();
 
 		ImGui::Checkbox("Pause", &logcat_thread.pause);
+		ImGui::SameLine();
+		ImGui::Checkbox("Collapse", &collapse_lines);
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Count lines that repeat one of the last few instead of keeping each.\nOnly affects lines that come in while it's on.");
+		ImGui::SameLine();
+		ImGui::Checkbox("Device filter", &push_filters);
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Only fetch lines the filters show, when they're a single PID or a few tags.\nTags then have to match exactly.");
+
+		// Every buffer gets captured, this just picks which ones to show
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(120);
+		int32_t buffers_on = 0;
+		for (int32_t b = logcat_buffer_main; b < logcat_buffer_count; b++)
+			if (buffers_shown & (1u << b)) buffers_on += 1;
+		char buffers_label[32];
+		if (buffers_on == logcat_buffer_count - 1) snprintf(buffers_label, sizeof(buffers_label), "All buffers");
+		else                                       snprintf(buffers_label, sizeof(buffers_label), "%d buffer%s", buffers_on, buffers_on == 1 ? "" : "s");
+		if (ImGui::BeginCombo("##Buffers", buffers_label)) {
+			for (int32_t b = logcat_buffer_main; b < logcat_buffer_count; b++) {
+				char item[64];
+				snprintf(item, sizeof(item), "%s (%lld)", logcat_buffer_name(b), (long long)logcat.buffer_lines[b].count);
+				bool shown = (buffers_shown & (1u << b)) != 0;
+				if (ImGui::Checkbox(item, &shown))
+					buffers_shown ^= 1u << b;
+			}
+			ImGui::EndCombo();
+		}
+
+		if (logcat_thread.backfilling) {
+			// logcat -g's sizes are only an estimate of what -d prints
+			size_t total    = logcat_thread.backfill_total;
+			float  progress = total > 0 ? (float)logcat_thread.backfill_bytes / total : 0;
+			if (progress > 0.99f) progress = 0.99f;
+			char overlay[64];
+			snprintf(overlay, sizeof(overlay), "History %.1f MB", logcat_thread.backfill_bytes / (1024.0 * 1024.0));
+			ImGui::SameLine();
+			ImGui::ProgressBar(progress, ImVec2(150, 0), overlay);
+		}
 
 		// App launcher UI
 		ImGui::SameLine();
 		ImGui::SetNextItemWidth(200);
-		static bool app_combo_was_open = false;
-		const char *app_show_name = app_finder.state == app_finder_state_searching ? "Loading..." :
-		                            (app_selected >= 0 && app_selected < app_finder.apps.count) ? app_finder.apps[app_selected].package :
+		const char *app_show_name = app_selected[0] != '\0' ? app_selected :
+		                            app_finder.state == app_finder_state_searching && app_finder.list.apps.count == 0 ? "Loading..." :
 		                            "Select app...";
-		if (ImGui::BeginCombo("##App", app_show_name)) {
-			// Start fetching apps when dropdown opens
-			if (!app_combo_was_open && logcat_thread.run) {
-				app_finder_start(&app_finder, logcat.src_id);
+		if (ImGui::BeginCombo("##App", app_show_name, ImGuiComboFlags_HeightLarge)) {
+			// Type to narrow the list down, Enter takes the first match
+			static char             app_filter[256];
+			static array_t<int32_t> app_matches = {};
+			if (ImGui::IsWindowAppearing()) {
+				app_filter[0] = '\0';
+				ImGui::SetKeyboardFocusHere();
 			}
-			app_combo_was_open = true;
+			ImGui::SetNextItemWidth(-FLT_MIN);
+			bool app_enter = ImGui::InputTextWithHint("##app_filter", "Type to filter", app_filter, sizeof(app_filter), ImGuiInputTextFlags_EnterReturnsTrue);
+			app_list_search(&app_finder.list, app_filter, &app_matches);
 
-			for (int32_t n = 0; n < app_finder.apps.count; n++) {
-				bool selected = (n == app_selected);
-				if (ImGui::Selectable(app_finder.apps[n].package, selected)) {
-					app_selected = n;
+			if (app_enter && app_matches.count > 0) {
+				snprintf(app_selected, sizeof(app_selected), "%s", app_finder.list.apps[app_matches[0]].package);
+				ImGui::CloseCurrentPopup();
+			}
+			ImGuiListClipper clipper;
+			clipper.Begin(app_matches.count);
+			while (clipper.Step()) {
+				for (int32_t i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+					const char *package  = app_finder.list.apps[app_matches[i]].package;
+					bool        selected = strcmp(package, app_selected) == 0;
+					if (ImGui::Selectable(package, selected)) {
+						snprintf(app_selected, sizeof(app_selected), "%s", package);
+					}
 				}
 			}
 			ImGui::EndCombo();
-		} else {
-			app_combo_was_open = false;
 		}
 
 		ImGui::SameLine();
-		bool can_run = app_selected >= 0 && app_selected < app_finder.apps.count &&
+		bool can_run = app_selected[0] != '\0' &&
 		               logcat_thread.run &&
-		               app_launcher.state != app_launcher_state_launching &&
-		               app_launcher.state != app_launcher_state_polling_pid;
+		               app_launcher.state != app_launcher_state_launching;
 		ImGui::BeginDisabled(!can_run);
 		if (ImGui::Button("Run")) {
 			// Clear log first
 			logcat_clear(&logcat);
-			// Start the app
-			app_launcher_start(&app_launcher, logcat.src_id, app_finder.apps[app_selected].package);
+			// Start the app, and follow its process as it starts and restarts
+			logcat_thread_watch(&logcat_thread, app_selected);
+			platform_mutex_lock(logcat.lines_mutex);
+			app_watch_starts = logcat_thread.watch_starts;
+			platform_mutex_unlock(logcat.lines_mutex);
+			app_launcher_start(&app_launcher, logcat.src_id, app_selected);
 		}
 		ImGui::EndDisabled();
 
-		// Check if launcher finished and got a PID
+		// The log announcing a new process beats asking the device for it
+		uint16_t app_pid = 0;
+		platform_mutex_lock(logcat.lines_mutex);
+		if (logcat_thread.watch_starts != app_watch_starts) {
+			app_watch_starts = logcat_thread.watch_starts;
+			app_pid          = (uint16_t)logcat_thread.watch_pid;
+		}
+		platform_mutex_unlock(logcat.lines_mutex);
+		// The launcher sets pid before it says it's finished
 		if (app_launcher.state == app_launcher_state_finished && app_launcher.pid != 0) {
-			// Put PID in the search buffer (not committed)
-			snprintf(pid_search, sizeof(pid_search), "%d", app_launcher.pid);
+			if (app_pid == 0) app_pid = app_launcher.pid;
 			app_launcher.pid = 0; // Consume the PID so we don't keep setting it
 		}
+		if (app_pid != 0 && app_pid != app_watch_pid) {
+			// Swap the old pid for the new one if it's been committed,
+			// otherwise put it in the search buffer (not committed)
+			bool swapped = false;
+			for (int32_t i = 0; i < details.pid_include.count && !swapped; i++) {
+				if (details.pid_include[i] != app_watch_pid) continue;
+				details.pid_include[i] = app_pid;
+				swapped = true;
+			}
+			if (!swapped) snprintf(pid_search, sizeof(pid_search), "%d", app_pid);
+			app_watch_pid = app_pid;
+		}
 
 		ImGui::SameLine();
 		ImGui::SeparatorEx(ImGuiSeparatorFlags_Vertical);
@@ -502,10 +806,7 @@ void window_log() {
 		ImGui::SameLine();
 		if (ImGui::Button("Trim ^")) {
 			platform_mutex_lock(logcat.lines_mutex);
-			for (int32_t i = 0; i < details.selected; i++) {
-				free(logcat.lines[0].line);
-				logcat.lines.remove(0);
-			}
+			logcat_trim(&logcat, details.selected > 0 ? details.selected : 0, logcat.lines.count - 1);
 			details.selected  = 0;
 			details.focus_idx = 0;
 			details.focus_at  = 0.5f;
@@ -514,11 +815,7 @@ void window_log() {
 		ImGui::SameLine();
 		if (ImGui::Button("Trim v")) {
 			platform_mutex_lock(logcat.lines_mutex);
-			int32_t count = logcat.lines.count;
-			for (int32_t i = details.selected+1; i < count; i++) {
-				free(logcat.lines[details.selected+1].line);
-				logcat.lines.remove(details.selected+1);
-			}
+			logcat_trim(&logcat, 0, details.selected);
 			details.focus_idx = details.selected;
 			details.focus_at  = 0.5f;
 			platform_mutex_unlock(logcat.lines_mutex);
@@ -532,28 +829,175 @@ void window_log() {
 		// Get the bounds of the visible area
 		float start      = ImGui::GetItemRectMin().y;
 		float scroll_max = ImGui::GetWindowContentRegionMax().y - ImGui::GetWindowContentRegionMin().y;
-		platform_mutex_lock(logcat.lines_mutex);
+		perf_lock(logcat.lines_mutex, perf_thread_ui);
+		// Ingest reads it under the lock, and a device switch resets it
+		logcat.collapse = collapse_lines;
+
+		// History got slotted in ahead of everything, so our line indices
+		// move with the lines, and the view stays where it was
+		if (logcat.prepended > 0) {
+			if (details.selected      >= 0) details.selected      += logcat.prepended;
+			if (details.selection_end >= 0) details.selection_end += logcat.prepended;
+			if (!was_at_end && details.center_idx >= 0) {
+				details.focus_idx = details.center_idx + logcat.prepended;
+				details.focus_at  = 0.5f;
+			}
+			logcat.prepended = 0;
+		}
 
 		// Cache selected line's PID/TID for highlighting
 		uint16_t selected_pid = 0;
 		uint16_t selected_tid = 0;
-		bool     has_selection = details.selected >= 0 && details.selected < (int32_t)logcat.lines.count;
+		bool     has_selection = details.selected >= 0 && details.selected < logcat.lines.count;
 		if (has_selection) {
 			selected_pid = logcat.lines[details.selected].pid;
 			selected_tid = logcat.lines[details.selected].tid;
 		}
 
 		// Compute selection range once for the loop
-		int32_t sel_start, sel_end;
+		int64_t sel_start, sel_end;
 		details_get_selection(&details, &sel_start, &sel_end);
 
 		// Track hovered line for drag selection
-		int32_t drag_hover_line = -1;
+		int64_t drag_hover_line = -1;
+
+		// Filter first, so the cost of filtering can be measured apart from
+		// the cost of drawing. The focus line always gets a row so we can
+		// scroll to where it would be, even if it's filtered out.
+		uint64_t filter_start = platform_time_ns();
+		details_match_apps    (&details);
+		details_match_fields  (&details);
+		details_match_patterns(&details);
+		details_match_terms   (&details);
+		details_match_query   (&details);
+		details_search_wake   ();
+		log_rows.clear();
+		bool all_buffers = true;
+		for (int32_t b = logcat_buffer_main; b < logcat_buffer_count; b++)
+			all_buffers = all_buffers && ((buffers_shown & (1u << b)) != 0 || logcat.buffer_lines[b].count == 0);
+
+		// Hidden buffers and levels are left out entirely, by merging the
+		// line lists of the shown ones, whichever of the two is shorter
+		const block_array_t<int64_t, 14> *sources[logcat_buffer_count + logcat_level_count];
+		int32_t source_count = 0;
+		int64_t level_total  = 0;
+		if (level_min > 1) {
+			sources[source_count++] = &logcat.level_lines[0];
+			for (int32_t l = level_min; l < logcat_level_count; l++)
+				sources[source_count++] = &logcat.level_lines[l];
+			for (int32_t s = 0; s < source_count; s++)
+				level_total += sources[s]->count;
+		}
+		if (!all_buffers) {
+			int64_t buffer_total = 0;
+			for (int32_t b = 0; b < logcat_buffer_count; b++)
+				if (b == logcat_buffer_none || (buffers_shown & (1u << b)) != 0) buffer_total += logcat.buffer_lines[b].count;
+			if (source_count == 0 || buffer_total < level_total) {
+				source_count = 0;
+				for (int32_t b = 0; b < logcat_buffer_count; b++)
+					if (b == logcat_buffer_none || (buffers_shown & (1u << b)) != 0) sources[source_count++] = &logcat.buffer_lines[b];
+			}
+		}
+
+		// F7 and F8 step to the next warning or error, Shift+ to the one
+		// before. In filter mode, or with Ctrl held, hidden lines are skipped.
+		int32_t jump_level = ImGui::IsKeyPressed(ImGuiKey_F7) ? 4 : ImGui::IsKeyPressed(ImGuiKey_F8) ? 5 : 0;
+		if (jump_level != 0) {
+			int32_t direction = ImGui::GetIO().KeyShift ? -1 : 1;
+			bool    filtered  = filter_mode || ImGui::GetIO().KeyCtrl;
+			int64_t from      = details.selected >= 0 ? details.selected : details.center_idx;
+			if (from < 0) from = direction > 0 ? -1 : logcat.lines.count;
+			int64_t to = logcat_level_next(&logcat, jump_level > level_min ? jump_level : level_min, from, direction);
+			while (to >= 0 && (!details_line_shown(&logcat.lines[to]) || (filtered && !details_is_valid(&details, to))))
+				to = logcat_level_next(&logcat, jump_level > level_min ? jump_level : level_min, to, direction);
+			if (to >= 0) {
+				details.selected      = to;
+				details.selection_end = -1;
+				details.focus_idx     = to;
+				details.focus_at      = 0.5f;
+			}
+		}
+
+		const logcat_id_list_t *only_lines = details_only_lines();
+		if (only_lines != nullptr) {
+			// One process or thread, straight from its own list of lines
+			TRACE_ZONE("details_is_valid rebuild thread");
+			int64_t focus = details.focus_idx; // Until it has its row
+			for (int64_t at = 0; at <= only_lines->count; at++) {
+				int64_t i = at < only_lines->count ? (*only_lines)[at] - logcat.line_base : INT64_MAX;
+				if (focus >= 0 && focus < i && focus < logcat.lines.count) {
+					log_rows.add({ focus, false });
+					focus = -1;
+				}
+				if (at == only_lines->count) break;
+				if (!details_line_shown(&logcat.lines[i]) && focus != i) continue;
 
-		for (size_t i = 0; i < logcat.lines.count; i++)
+				bool valid = details_is_valid(&details, i);
+				if (filter_mode && !valid && focus != i) continue;
+				if (focus == i) focus = -1;
+				log_rows.add({ i, valid });
+			}
+		} else if (filter_mode && details_terms_only(&details)) {
+			// Only lines the text and tag filters matched can show, so
+			// those are the only ones visited
+			TRACE_ZONE("details_is_valid rebuild terms");
+			int64_t focus = details.focus_idx; // Until it has its row
+			int64_t i     = bitmap_next(&details.term_rows, 0);
+			while (true) {
+				if (focus >= 0 && focus < logcat.lines.count && (i < 0 || focus < i)) {
+					log_rows.add({ focus, details_is_valid(&details, focus) });
+					focus = -1;
+				}
+				if (i < 0) break;
+
+				bool valid = details_is_valid(&details, i);
+				if (valid || focus == i) log_rows.add({ i, valid });
+				if (focus == i) focus = -1;
+				i = bitmap_next(&details.term_rows, i + 1);
+			}
+		} else if (source_count == 0) {
+			TRACE_ZONE("details_is_valid rebuild");
+			for (int64_t i = 0; i < logcat.lines.count; i++) {
+				bool valid = details_is_valid(&details, i);
+				if (filter_mode && !valid && details.focus_idx != i) continue;
+				log_rows.add({ i, valid });
+			}
+		} else {
+			// Hidden buffers and levels cost nothing however big they are
+			TRACE_ZONE("details_is_valid rebuild merged");
+			int64_t at[logcat_buffer_count + logcat_level_count] = {};
+			int64_t focus = details.focus_idx; // Until it has its row
+			while (true) {
+				int64_t i = INT64_MAX;
+				int32_t from = -1;
+				for (int32_t s = 0; s < source_count; s++) {
+					if (at[s] < sources[s]->count && (*sources[s])[at[s]] - logcat.line_base < i) {
+						i    = (*sources[s])[at[s]] - logcat.line_base;
+						from = s;
+					}
+				}
+				if (focus >= 0 && focus < i && focus < logcat.lines.count) {
+					log_rows.add({ focus, false });
+					focus = -1;
+				}
+				if (from == -1) break;
+				at[from] += 1;
+				// The other of buffers and levels still needs checking
+				if (!details_line_shown(&logcat.lines[i]) && focus != i) continue;
+
+				bool valid = details_is_valid(&details, i);
+				if (filter_mode && !valid && focus != i) continue;
+				if (focus == i) focus = -1;
+				log_rows.add({ i, valid });
+			}
+		}
+		perf_frame.filter_ns += platform_time_ns() - filter_start;
+
+		for (int32_t r = 0; r < log_rows.count; r++)
 		{
+			int64_t       i     = log_rows[r].line;
 			logcat_line_t line  = logcat.lines[i];
-			bool          valid = details_is_valid(&details, &line);
+			bool          valid = log_rows[r].valid;
 
 			// If this one matches focus, make sure we scroll to it.
 			if (details.focus_idx == i) {
@@ -578,12 +1022,23 @@ void window_log() {
 			if (!valid) color = ImVec4(color.x * 0.5f, color.y * 0.5f, color.z * 0.5f, color.w);
 
 			// Draw the line
-			bool highlight_related = highlight_pid && has_selection && (line.pid == selected_pid || line.tid == selected_tid);
 			// Only visible (valid) items can be part of selection in filter mode
-			bool in_selection = ((int32_t)i >= sel_start && (int32_t)i <= sel_end) && (!filter_mode || valid);
+			bool in_selection = (i >= sel_start && i <= sel_end) && (!filter_mode || valid);
+			// Rows off screen don't draw their text, so don't unpack it, or
+			// look for the selected line's thread in it
+			bool        on_screen = ImGui::IsRectVisible(ImVec2(1, ImGui::GetTextLineHeight() + ImGui::GetStyle().FramePadding.y * 2));
+			bool        highlight_related = on_screen && highlight_pid && has_selection && (line.pid == selected_pid || line.tid == selected_tid);
+			const char *text      = on_screen ? logcat_line_text(&logcat, &line) : "";
+			const char *row_text  = text;
+			if (on_screen && line.repeated) {
+				const logcat_repeat_t *repeat = logcat_line_repeat(&logcat, i);
+				snprintf(repeat_text, sizeof(repeat_text), "%s  \xC3\x97%lld", text, repeat != nullptr ? (long long)repeat->count : 1ll);
+				row_text = repeat_text;
+			}
 			ImGui::PushStyleColor(ImGuiCol_Text, color);
-			item_select_ select = ui_log_item(line.pid, logcat.tags[line.tag], line.line, in_selection, highlight_related);
+			item_select_ select = ui_log_item(logcat_buffer_name(line.buffer), line.pid, logcat_process_name(&logcat, line.pid), logcat.tags[line.tag], row_text, in_selection, highlight_related);
 			ImGui::PopStyleColor();
+			perf_frame.rows += 1;
 
 			// Track hovered line for drag selection
 			if (ImGui::IsItemHovered() && drag_selecting) {
@@ -603,17 +1058,23 @@ void window_log() {
 			// Schedule any line interaction for later, so it doesn't interfere
 			// with any focus logic for this frame.
 			if (select != item_select_none) {
-				bool is_left  = (select == item_select_pid || select == item_select_label || select == item_select_text);
-				bool is_right = (select == item_select_pid_right || select == item_select_label_right || select == item_select_text_right);
-
-				// Ctrl+Left Click = add to Match Any (include)
-				if      (ImGui::GetIO().KeyCtrl && select == item_select_pid  ) {filter_idx = i; filter_promote = true;  filter_pid = line.pid; }
+				bool is_left  = (select == item_select_buffer || select == item_select_pid || select == item_select_app || select == item_select_label || select == item_select_text);
+				bool is_right = (select == item_select_buffer_right || select == item_select_pid_right || select == item_select_app_right || select == item_select_label_right || select == item_select_text_right);
+				const char *app = logcat_process_name(&logcat, line.pid);
+				snprintf(filter_copy, sizeof(filter_copy), "%s", text);
+
+				// Ctrl+Left Click = add to Match Any (include), or only show that buffer
+				if      (ImGui::GetIO().KeyCtrl && select == item_select_buffer && line.buffer != logcat_buffer_none) {filter_idx = i; filter_promote = true;  filter_buffer = line.buffer; }
+				else if (ImGui::GetIO().KeyCtrl && select == item_select_pid  ) {filter_idx = i; filter_promote = true;  filter_pid = line.pid; }
+				else if (ImGui::GetIO().KeyCtrl && select == item_select_app && app[0] != '\0') {filter_idx = i; filter_promote = true;  filter_app = true; filter_text = app; }
 				else if (ImGui::GetIO().KeyCtrl && select == item_select_label) {filter_idx = i; filter_promote = true;  filter_tag = true;  filter_text = logcat.tags[line.tag]; }
-				else if (ImGui::GetIO().KeyCtrl && select == item_select_text ) {filter_idx = i; filter_promote = true;  filter_tag = false; filter_text = line.line;             }
-				// Ctrl+Right Click = add to Exclude Any
+				else if (ImGui::GetIO().KeyCtrl && select == item_select_text ) {filter_idx = i; filter_promote = true;  filter_tag = false; filter_text = filter_copy;           }
+				// Ctrl+Right Click = add to Exclude Any, or hide that buffer
+				else if (ImGui::GetIO().KeyCtrl && select == item_select_buffer_right && line.buffer != logcat_buffer_none) {filter_idx = i; filter_promote = false; filter_buffer = line.buffer; }
 				else if (ImGui::GetIO().KeyCtrl && select == item_select_pid_right  ) {filter_idx = i; filter_promote = false; filter_pid = line.pid; }
+				else if (ImGui::GetIO().KeyCtrl && select == item_select_app_right && app[0] != '\0') {filter_idx = i; filter_promote = false; filter_app = true; filter_text = app; }
 				else if (ImGui::GetIO().KeyCtrl && select == item_select_label_right) {filter_idx = i; filter_promote = false; filter_tag = true;  filter_text = logcat.tags[line.tag]; }
-				else if (ImGui::GetIO().KeyCtrl && select == item_select_text_right ) {filter_idx = i; filter_promote = false; filter_tag = false; filter_text = line.line;             }
+				else if (ImGui::GetIO().KeyCtrl && select == item_select_text_right ) {filter_idx = i; filter_promote = false; filter_tag = false; filter_text = filter_copy;           }
 				// Shift+Left Click = extend selection range
 				else if (ImGui::GetIO().KeyShift && is_left) {
 					if (details.selected < 0) {
@@ -634,7 +1095,7 @@ void window_log() {
 				// Right click without Ctrl = copy selection to clipboard
 				else if (is_right) {
 					// If no selection or clicked line is outside selection, select just this line
-					bool in_selection = ((int32_t)i >= sel_start && (int32_t)i <= sel_end);
+					bool in_selection = (i >= sel_start && i <= sel_end);
 					if (details.selected < 0 || !in_selection) {
 						details.selected = i;
 						details.selection_end = -1;
@@ -644,7 +1105,7 @@ void window_log() {
 				}
 			}
 		}
-		platform_mutex_unlock(logcat.lines_mutex);
+		perf_unlock(logcat.lines_mutex, perf_thread_ui);
 
 		// Handle drag selection
 		if (drag_selecting) {
@@ -689,7 +1150,7 @@ void window_log() {
 	details.focus_idx  = -1;
 	details.center_idx = log_visible.count > 0 ? log_visible[log_visible.count / 2] : -1;
 
-	if (filter_text != nullptr || filter_pid != 0) {
+	if (filter_text != nullptr || filter_pid != 0 || filter_buffer >= 0) {
 		if (details.selected_at >= 0 && details.selected_at <= 1) {
 			details.focus_idx = details.selected;
 			details.focus_at  = details.selected_at;
@@ -697,9 +1158,15 @@ void window_log() {
 			details.focus_idx = details.center_idx;
 			details.focus_at  = 0.5f;
 		}
-		if (filter_pid != 0) {
+		if (filter_buffer >= 0) {
+			if (filter_promote) buffers_shown  =   1u << filter_buffer;
+			else                buffers_shown &= ~(1u << filter_buffer);
+		} else if (filter_pid != 0) {
 			if (filter_promote) details.pid_include.insert(0, filter_pid);
 			else                details.pid_exclude.insert(0, filter_pid);
+		} else if (filter_app) {
+			if (filter_promote) details_promote_generic(&details.app_exclude, &details.app_include, filter_text, app_exclude);
+			else                details_promote_generic(&details.app_include, &details.app_exclude, filter_text, app_search);
 		} else if (filter_promote == true  && filter_tag == true ) details_promote_tag (&details, filter_text);
 		else if   (filter_promote == true  && filter_tag == false) details_promote_text(&details, filter_text);
 		else if   (filter_promote == false && filter_tag == true ) details_demote_tag  (&details, filter_text);
@@ -865,21 +1332,94 @@ bool ui_pid_list(const char *label, array_t<uint16_t> *list, char *buffer, size_
 
 ///////////////////////////////////////////
 
+// Templates get picked from the Templates and Selected windows, so this only
+// lists them for taking back out
+bool ui_pattern_list(const char *label, array_t<uint16_t> *list) {
+	if (list->count == 0) return false;
+
+	bool result = false;
+	ImGui::PushID(ImGui::GetID(label));
+	ImGui::TextDisabled("%s", label);
+	ImGui::Indent(10);
+	perf_lock(logcat.lines_mutex, perf_thread_ui);
+	for (int32_t i = 0; i < list->count; i++) {
+		ImGui::PushID(i);
+		if (ImGui::Button("-")) {
+			list->remove(i);
+			i--;
+			result = true;
+			ImGui::PopID();
+			continue;
+		}
+		ImGui::SameLine();
+		ImGui::Text("%s", pattern_text(&logcat.patterns, list->get(i)));
+		ImGui::PopID();
+	}
+	perf_unlock(logcat.lines_mutex, perf_thread_ui);
+	ImGui::Indent(-10);
+	ImGui::PopID();
+	return result;
+}
+
+///////////////////////////////////////////
+
 void window_filters() {
 	ImGui::Begin("Filters");
 
+	bool focus = false;
+	ImGui::SeparatorText("Query");
+	ImGui::PushItemWidth(-1);
+	if (ImGui::InputTextWithHint("##query", "level>=W and (tag:Activity or text~\"fail.*\")", query_text, sizeof(query_text))) {
+		// The search thread may be scanning the old one
+		perf_lock(logcat.lines_mutex, perf_thread_ui);
+		query_compile(&details.query, query_text);
+		perf_unlock(logcat.lines_mutex, perf_thread_ui);
+		focus = true;
+	}
+	ImGui::PopItemWidth();
+	if (details.query.error[0] != '\0')
+		ImGui::TextColored(ImVec4(1, 0.5f, 0.5f, 1), "%s", details.query.error);
+
+	ImGui::SeparatorText("Level");
+	const char *levels[] = { "Verbose and up", "Debug and up", "Info and up", "Warning and up", "Error and up", "Fatal" };
+	int32_t     level    = level_min - 1;
+	ImGui::PushItemWidth(-1);
+	if (ImGui::Combo("##level", &level, levels, IM_ARRAYSIZE(levels))) {
+		level_min = level + 1;
+		focus     = true;
+	}
+	ImGui::PopItemWidth();
+
+	if (only_pid >= 0) {
+		ImGui::SeparatorText(only_tid >= 0 ? "Thread" : "Process");
+		if (only_tid >= 0) ImGui::Text("Only %d %s, in %d %s", only_tid, logcat_thread_name(&logcat, (uint16_t)only_pid, (uint16_t)only_tid), only_pid, logcat_process_name(&logcat, (uint16_t)only_pid));
+		else               ImGui::Text("Only %d %s", only_pid, logcat_process_name(&logcat, (uint16_t)only_pid));
+		ImGui::SameLine();
+		if (ImGui::SmallButton("x##only")) {
+			only_pid = -1;
+			only_tid = -1;
+			focus    = true;
+		}
+	}
+
 	ImGui::SeparatorText("Match Any");
 
-	bool focus = false;
 	focus = ui_string_list("Text Match", &details.text_include, text_search, sizeof(text_search), &text_search_len) || focus;
+	if (details.search_scanned < details.search_total)
+		ImGui::TextDisabled("Searched %lld of %lld lines", (long long)details.search_scanned, (long long)details.search_total);
 	focus = ui_string_list("Tag Match",  &details.tag_include,  tag_search,  sizeof(tag_search ), &tag_search_len ) || focus;
 	focus = ui_pid_list   ("PID Match",  &details.pid_include,  pid_search,  sizeof(pid_search ), &pid_search_live ) || focus;
+	focus = ui_string_list("App Match",  &details.app_include,  app_search,  sizeof(app_search ), &app_search_len ) || focus;
+	focus = ui_string_list("Event Field Match, like time>100", &details.field_include, field_search, sizeof(field_search), &field_search_len) || focus;
+	focus = ui_pattern_list("Template Match", &details.pattern_include) || focus;
 
 	ImGui::SeparatorText("Exclude Any");
 
 	focus = ui_string_list("Text Exclude", &details.text_exclude, text_exclude, sizeof(text_exclude), &text_exclude_len) || focus;
 	focus = ui_string_list("Tag Exclude",  &details.tag_exclude,  tag_exclude,  sizeof(tag_exclude ), &tag_exclude_len ) || focus;
 	focus = ui_pid_list   ("PID Exclude",  &details.pid_exclude,  pid_exclude,  sizeof(pid_exclude ), &pid_exclude_live) || focus;
+	focus = ui_string_list("App Exclude",  &details.app_exclude,  app_exclude,  sizeof(app_exclude ), &app_exclude_len ) || focus;
+	focus = ui_pattern_list("Template Exclude", &details.pattern_exclude) || focus;
 
 	ImGui::SeparatorText("Mode");
 
@@ -907,14 +1447,36 @@ void window_filters() {
 		for (int32_t i = 0; i < details.text_include.count; i++)
 			if (details.text_include[i] != text_search)
 				free(details.text_include[i]);
+		for (int32_t i = 0; i < details.app_exclude.count; i++)
+			if (details.app_exclude[i] != app_exclude)
+				free(details.app_exclude[i]);
+		for (int32_t i = 0; i < details.app_include.count; i++)
+			if (details.app_include[i] != app_search)
+				free(details.app_include[i]);
+		for (int32_t i = 0; i < details.field_include.count; i++)
+			if (details.field_include[i] != field_search)
+				free(details.field_include[i]);
 		details.text_include.clear();
 		details.tag_include .clear();
 		details.text_exclude.clear();
 		details.tag_exclude .clear();
 		details.pid_include .clear();
 		details.pid_exclude .clear();
+		details.app_include .clear();
+		details.app_exclude .clear();
+		details.field_include.clear();
+		details.pattern_include.clear();
+		details.pattern_exclude.clear();
 		pid_search_live  = 0;
 		pid_exclude_live = 0;
+		buffers_shown    = ~0u;
+		level_min        = 1;
+		only_pid         = -1;
+		only_tid         = -1;
+		query_text[0]    = '\0';
+		perf_lock(logcat.lines_mutex, perf_thread_ui);
+		query_free(&details.query);
+		perf_unlock(logcat.lines_mutex, perf_thread_ui);
 		focus = true;
 	}
 
@@ -936,7 +1498,10 @@ void window_filters() {
 void window_details() {
 	ImGui::Begin("Selected");
 
-	if (details.selected >= 0 && details.selected < logcat.lines.count ) {
+	// Backfill can slot lines in ahead of the selection at any time, so the
+	// line, and the names and text it points at, are read under the lock
+	perf_lock(logcat.lines_mutex, perf_thread_ui);
+	if (details.selected >= 0 && details.selected < logcat.lines.count) {
 		logcat_line_t line = logcat.lines[details.selected];
 
 		const char *severity = "";
@@ -952,12 +1517,48 @@ void window_details() {
 			default:  severity = ""; break;
 		}
 		
-		ImGui::LabelText("Process ID", "%d", line.pid);
-		ImGui::LabelText("Thread ID", "%d", line.tid);
+		ImGui::LabelText("Process ID", "%d %s", line.pid, logcat_process_name(&logcat, line.pid));
+		ImGui::LabelText("Thread ID", "%d %s", line.tid, logcat_thread_name(&logcat, line.pid, line.tid));
 		ImGui::LabelText("Severity", "%s", severity);
 		ImGui::LabelText("Time", "%d-%d %d:%d:%d.%d", line.month, line.day, line.hour, line.minute, line.second, line.millisecond);
+		ImGui::LabelText("Buffer", "%s", logcat_buffer_name(line.buffer));
 		ImGui::InputText("Tag", logcat.tags[line.tag], strlen(logcat.tags[line.tag]) + 1, ImGuiInputTextFlags_ReadOnly | ImGuiInputTextFlags_CallbackAlways, ui_select_all_callback);
-		ImGui::TextWrapped("%s", line.line);
+
+		// Collapsed copies only kept when the first and latest came
+		const logcat_repeat_t *repeat = line.repeated ? logcat_line_repeat(&logcat, details.selected) : nullptr;
+		if (repeat != nullptr) {
+			const logcat_line_t &last    = repeat->last;
+			double               seconds = (last.time - line.time) / 1000.0;
+			ImGui::LabelText("Repeated", "%lld times", (long long)repeat->count);
+			ImGui::LabelText("Last",     "%d-%d %d:%d:%d.%d", last.month, last.day, last.hour, last.minute, last.second, last.millisecond);
+			if (seconds > 0) ImGui::LabelText("Rate", "%.1f/s", (repeat->count - 1) / seconds);
+		}
+		ImGui::TextWrapped("%s", logcat_line_text(&logcat, &line));
+		bool like_this = false;
+		if (line.pattern != pattern_none) {
+			ImGui::TextDisabled("Template: %s", pattern_text(&logcat.patterns, line.pattern));
+			if (ImGui::SmallButton("Hide lines like this")) {
+				details_toggle_pattern(&details.pattern_exclude, line.pattern);
+				like_this = true;
+			}
+			ImGui::SameLine();
+			if (ImGui::SmallButton("Only lines like this")) {
+				details_toggle_pattern(&details.pattern_include, line.pattern);
+				like_this = true;
+			}
+		}
+		// Numbers decoded from an event's payload, these are what the
+		// event field filters test
+		const logcat_field_t *fields;
+		int32_t field_count = logcat_line_fields(&logcat, details.selected, &fields);
+		for (int32_t f = 0; f < field_count; f++)
+			ImGui::LabelText(logcat.field_names[fields[f].name], "%g", fields[f].value);
+		perf_unlock(logcat.lines_mutex, perf_thread_ui);
+		// Keep the line in view while the filter changes around it
+		if (like_this) {
+			details.focus_idx = details.selected;
+			details.focus_at  = 0.5f;
+		}
 
 		ImGui::Separator();
 
@@ -970,7 +1571,46 @@ void window_details() {
 			details.selected = -1;
 		ImGui::SameLine();
 		ImGui::Checkbox("Highlight PID", &highlight_pid);
+
+		// Same thread and same process, from their own lists of lines
+		ImGui::SeparatorText("Thread");
+		int64_t step_to = -1;
+		perf_lock(logcat.lines_mutex, perf_thread_ui);
+		if (logcat.pid_lines != nullptr) {
+			const logcat_id_list_t *thread_lines  = &logcat.tid_lines[line.tid];
+			const logcat_id_list_t *process_lines = &logcat.pid_lines[line.pid];
+			ImGui::Text("%lld lines from this thread, %lld from its process", (long long)thread_lines->count, (long long)process_lines->count);
+			if (ImGui::SmallButton("< Thread"))  step_to = details_step(&details, thread_lines, -1);
+			ImGui::SameLine();
+			if (ImGui::SmallButton("Thread >"))  step_to = details_step(&details, thread_lines,  1);
+			ImGui::SameLine();
+			if (ImGui::SmallButton("< Process")) step_to = details_step(&details, process_lines, -1);
+			ImGui::SameLine();
+			if (ImGui::SmallButton("Process >")) step_to = details_step(&details, process_lines,  1);
+		}
+		perf_unlock(logcat.lines_mutex, perf_thread_ui);
+		bool only = false;
+		if (ImGui::SmallButton(only_tid == line.tid ? "All threads" : "Only this thread")) {
+			only_pid = only_tid == line.tid ? -1 : line.pid;
+			only_tid = only_tid == line.tid ? -1 : line.tid;
+			only     = true;
+		}
+		ImGui::SameLine();
+		if (ImGui::SmallButton(only_pid == line.pid && only_tid < 0 ? "All processes" : "Only this process")) {
+			only_pid = only_pid == line.pid && only_tid < 0 ? -1 : line.pid;
+			only_tid = -1;
+			only     = true;
+		}
+		if (step_to >= 0) {
+			details.selected      = step_to;
+			details.selection_end = -1;
+		}
+		if (step_to >= 0 || only) {
+			details.focus_idx = details.selected;
+			details.focus_at  = 0.5f;
+		}
 	} else {
+		perf_unlock(logcat.lines_mutex, perf_thread_ui);
 		ImGui::Text("No line selected");
 	}
 
@@ -979,36 +1619,673 @@ void window_details() {
 
 ///////////////////////////////////////////
 
-bool details_is_valid(const details_t *details, const logcat_line_t *line) {
+void window_diagnostics() {
+	static perf_rates_t rates = {};
+	perf_sample(&rates);
+
+	ImGui::SetNextWindowSize(ImVec2(360, 0), ImGuiCond_FirstUseEver);
+	ImGui::Begin("Diagnostics", &show_diagnostics);
+
+	ImGui::SeparatorText("Ingest");
+	ImGui::LabelText("Lines/sec",   "%.0f",     rates.lines_per_sec);
+	ImGui::LabelText("Read/sec",    "%.1f KiB", rates.bytes_per_sec / 1024.0);
+	ImGui::LabelText("Parse",       "%.0f ns/line", rates.parse_ns_per_line);
+	ImGui::LabelText("Pipe queue",  "%d bytes", perf.queue_bytes.load(std::memory_order_relaxed));
+
+	ImGui::SeparatorText("Lock");
+	const char *thread_names[perf_thread_max] = { "Ingest", "UI" };
+	for (int32_t i = 0; i < perf_thread_max; i++) {
+		ImGui::LabelText(thread_names[i], "wait %.1fus hold %.1fus (%.1f%%)", rates.lock_wait_us[i], rates.lock_hold_us[i], rates.lock_held_pct[i]);
+	}
+
+	ImGui::SeparatorText("Frame");
+	ImGui::LabelText("Frames/sec", "%.0f",      rates.frames_per_sec);
+	ImGui::LabelText("Frame CPU",  "%.2f ms",   rates.frame_ms);
+	ImGui::LabelText("Filter",     "%.2f ms",   rates.filter_ms);
+	ImGui::LabelText("Rows",       "%.0f/frame", rates.rows_per_frame);
+
+	ImGui::SeparatorText("Memory");
+	platform_mutex_lock(logcat.lines_mutex);
+	size_t lines_bytes = logcat.lines.memory() + logcat.repeats.memory();
+	size_t index_bytes = 0;
+	for (int32_t b = 0; b < logcat_buffer_count; b++) index_bytes += logcat.buffer_lines[b].memory();
+	for (int32_t l = 0; l < logcat_level_count;  l++) index_bytes += logcat.level_lines [l].memory();
+	for (int32_t id = 0; id <= UINT16_MAX && logcat.pid_lines != nullptr; id++)
+		index_bytes += logcat.pid_lines[id].memory() + logcat.tid_lines[id].memory();
+	size_t tags_bytes  = (size_t)logcat.tags .capacity * sizeof(char*);
+	for (int32_t i = 0; i < logcat.tags.count; i++)
+		tags_bytes += strlen(logcat.tags[i]) + 1;
+	int64_t line_count = logcat.lines.count;
+	int64_t repeat_copies = logcat.repeat_copies;
+	size_t  text_bytes = logcat.text_bytes;
+	size_t  hot_bytes     = 0;
+	size_t  packed_bytes  = logcat.packed_bytes;
+	size_t  packed_max    = logcat.packed_max;
+	size_t  spilled_bytes = 0;
+	int32_t packed_count  = 0;
+	int32_t spilled_count = 0;
+	for (int32_t i = 0; i < logcat.segments.count; i++) {
+		const logcat_segment_t &segment = logcat.segments[i];
+		if (segment.text   != nullptr) hot_bytes += segment.text_size;
+		if (segment.packed != nullptr) packed_count += 1;
+		if (segment.spilled) {
+			spilled_bytes += segment.packed_size;
+			spilled_count += 1;
+		}
+	}
+	int32_t  segment_count = logcat.segments.count;
+	uint64_t spill_size    = logcat.spill_size;
+	// The search thread fills terms in too
+	int32_t  terms_count   = details.terms.count;
+	size_t   terms_bytes   = 0;
+	for (int32_t t = 0; t < details.terms.count; t++)
+		terms_bytes += bitmap_memory(&details.terms[t].lines);
+	platform_mutex_unlock(logcat.lines_mutex);
+	ImGui::LabelText("Lines", "%lld, %.1f MiB", (long long)line_count, lines_bytes / (1024.0 * 1024.0));
+	ImGui::LabelText("Repeats", "%lld copies counted", (long long)repeat_copies);
+	ImGui::LabelText("Indices", "%.1f MiB", index_bytes / (1024.0 * 1024.0));
+	ImGui::LabelText("Text",  "%.1f MiB",     text_bytes  / (1024.0 * 1024.0));
+	ImGui::LabelText("Packed", "%d/%d segments, %.1f/%.0f MiB", packed_count, segment_count, packed_bytes / (1024.0 * 1024.0), packed_max / (1024.0 * 1024.0));
+	ImGui::LabelText("Spilled", "%d segments, %.1f MiB (file %.1f MiB)", spilled_count, spilled_bytes / (1024.0 * 1024.0), spill_size / (1024.0 * 1024.0));
+	ImGui::LabelText("Unpacked", "%.1f MiB", hot_bytes / (1024.0 * 1024.0));
+	ImGui::LabelText("Tags",  "%.1f KiB",     tags_bytes  / 1024.0);
+
+	ImGui::LabelText("Filter terms", "%d cached, %.1f KiB", terms_count, terms_bytes / 1024.0);
+
+#ifdef LOGPANTHER_TRACE
+	ImGui::Separator();
+	if (ImGui::Button("Save trace...")) {
+		char filename[512] = {};
+		if (platform_file_dialog_save(filename, sizeof(filename), "Save Trace"))
+			trace_save(filename);
+	}
+#endif
+
+	ImGui::End();
+}
+
+///////////////////////////////////////////
+
+// Every message template with how many lines it has, busiest first, and
+// how fast they're coming in
+void window_patterns() {
+	static array_t<uint16_t> order       = {};
+	static array_t<int64_t>  lines_prev  = {};
+	static array_t<float>    rates       = {};
+	static double            sampled_at  = 0;
+
+	ImGui::SetNextWindowSize(ImVec2(600, 400), ImGuiCond_FirstUseEver);
+	ImGui::Begin("Templates", &show_patterns);
+
+	perf_lock(logcat.lines_mutex, perf_thread_ui);
+	const array_t<pattern_t> &patterns = logcat.patterns.patterns;
+
+	// Rates and order only change once a second, so rows hold still
+	// long enough to click
+	double now = platform_time_ns() / 1000000000.0;
+	if (now - sampled_at >= 1.0 || order.count != patterns.count) {
+		double seconds = sampled_at > 0 ? now - sampled_at : 0;
+		sampled_at = now;
+		while (lines_prev.count < patterns.count) lines_prev.add(0);
+		while (rates     .count < patterns.count) rates     .add(0);
+		order.clear();
+		for (int32_t p = 1; p < patterns.count; p++) {
+			// Trims and clears take lines back, that's not a rate
+			if (seconds > 0) rates[p] = patterns[p].lines > lines_prev[p] ? (float)((patterns[p].lines - lines_prev[p]) / seconds) : 0;
+			lines_prev[p] = patterns[p].lines;
+			if (patterns[p].lines > 0) order.add((uint16_t)p);
+		}
+		qsort(order.data, order.count, sizeof(uint16_t), [](const void *a, const void *b) {
+			int64_t lines_a = logcat.patterns.patterns[*(const uint16_t*)a].lines;
+			int64_t lines_b = logcat.patterns.patterns[*(const uint16_t*)b].lines;
+			return lines_a < lines_b ? 1 : lines_a > lines_b ? -1 : 0;
+		});
+	}
+
+	ImGui::Text("%d templates", patterns.count > 0 ? patterns.count - 1 : 0);
+	bool changed = false;
+	if (ImGui::BeginTable("##templates", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable)) {
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableSetupColumn("Lines",    ImGuiTableColumnFlags_WidthFixed, 80);
+		ImGui::TableSetupColumn("Per sec",  ImGuiTableColumnFlags_WidthFixed, 60);
+		ImGui::TableSetupColumn("Hide/Only", ImGuiTableColumnFlags_WidthFixed, 90);
+		ImGui::TableSetupColumn("Template", ImGuiTableColumnFlags_WidthStretch);
+		ImGui::TableHeadersRow();
+
+		ImGuiListClipper clipper;
+		clipper.Begin(order.count);
+		while (clipper.Step()) {
+			for (int32_t row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+				uint16_t pattern = order[row];
+				bool     hidden  = false;
+				bool     only    = false;
+				for (int32_t i = 0; i < details.pattern_exclude.count; i++) hidden = hidden || details.pattern_exclude[i] == pattern;
+				for (int32_t i = 0; i < details.pattern_include.count; i++) only   = only   || details.pattern_include[i] == pattern;
+
+				ImGui::PushID(pattern);
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("%lld", (long long)patterns[pattern].lines);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", rates[pattern]);
+				ImGui::TableNextColumn();
+				if (ImGui::Checkbox("##hide", &hidden)) { details_toggle_pattern(&details.pattern_exclude, pattern); changed = true; }
+				if (ImGui::IsItemHovered()) ImGui::SetTooltip("Hide lines like this");
+				ImGui::SameLine();
+				if (ImGui::Checkbox("##only", &only))   { details_toggle_pattern(&details.pattern_include, pattern); changed = true; }
+				if (ImGui::IsItemHovered()) ImGui::SetTooltip("Show lines like this");
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(pattern_text(&logcat.patterns, pattern));
+				ImGui::PopID();
+			}
+		}
+		ImGui::EndTable();
+	}
+	perf_unlock(logcat.lines_mutex, perf_thread_ui);
+	ImGui::End();
+
+	if (changed) {
+		details.focus_idx = details.center_idx;
+		details.focus_at  = 0.5f;
+	}
+}
+
+///////////////////////////////////////////
+
+// Whether line's buffer, level and thread are shown, which goes before any
+// filter
+bool details_line_shown(const logcat_line_t *line) {
+	int32_t level = logcat_severity_level(line->severity);
+	return (line->buffer == logcat_buffer_none || (buffers_shown & (1u << line->buffer)) != 0) &&
+		(level == 0 || level >= level_min) &&
+		(only_pid < 0 || line->pid == only_pid) &&
+		(only_tid < 0 || line->tid == only_tid);
+}
+
+///////////////////////////////////////////
+
+// The lines of the one thread or process shown, or null when they all are.
+// Expects the lines mutex to be held.
+const logcat_id_list_t *details_only_lines() {
+	if (logcat.pid_lines == nullptr) return nullptr;
+	if (only_tid >= 0) return &logcat.tid_lines[only_tid];
+	if (only_pid >= 0) return &logcat.pid_lines[only_pid];
+	return nullptr;
+}
+
+///////////////////////////////////////////
+
+// The line after or before the selected one in list, one of logcat.pid_lines
+// or tid_lines, that the log shows, or -1. Where it lands is kept in
+// step_at, so stepping again doesn't search. Expects the lines mutex to be
+// held.
+int64_t details_step(details_t *details, const logcat_id_list_t *list, int32_t direction) {
+	int64_t selected = logcat.line_base + details->selected;
+	int64_t at       = details->step_at;
+	if (at < 0 || at >= list->count || (*list)[at] != selected)
+		at = logcat_index_find(&logcat, list, details->selected);
+	if      (direction < 0) at -= 1;
+	else if (at < list->count && (*list)[at] == selected) at += 1;
+
+	for (; at >= 0 && at < list->count; at += direction) {
+		int64_t i = (*list)[at] - logcat.line_base;
+		if (filter_mode ? details_is_valid(details, i) : details_line_shown(&logcat.lines[i])) {
+			details->step_at = at;
+			return i;
+		}
+	}
+	return -1;
+}
+
+///////////////////////////////////////////
+
+bool details_is_valid(const details_t *details, int64_t line_idx) {
+	const logcat_line_t *line = &logcat.lines[line_idx];
+	if (!details_line_shown(line))
+		return false;
+
+	// App filters were matched against every name up front, so lines just
+	// look theirs up
+	uint16_t app = logcat.pid_names != nullptr ? logcat.pid_names[line->pid] : 0;
+
 	// Return false if any of the excludes match
-	for (int32_t i = 0; i < details->tag_exclude.count; i++)
-		if (strstr(logcat.tags[line->tag], details->tag_exclude[i]) != nullptr)
-			return false;
-	for (int32_t i = 0; i < details->text_exclude.count; i++)
-		if (strstr(line->line, details->text_exclude[i]) != nullptr)
-			return false;
+	if (app < details->app_exclude_names.count && details->app_exclude_names[app])
+		return false;
+	if (line->pattern < details->pattern_exclude_ids.count && details->pattern_exclude_ids[line->pattern])
+		return false;
+	if (bitmap_has(&details->term_exclude, line_idx))
+		return false;
 	for (int32_t i = 0; i < details->pid_exclude.count; i++)
 		if (line->pid == details->pid_exclude[i])
 			return false;
+	if (details->query.code.count > 0 && !query_eval(&details->query, &logcat, line_idx))
+		return false;
 
 	// Return true if any of the includes match
-	for (int32_t i = 0; i < details->tag_include.count; i++)
-		if (strstr(logcat.tags[line->tag], details->tag_include[i]) != nullptr)
-			return true;
-	for (int32_t i = 0; i < details->text_include.count; i++)
-		if (strstr(line->line, details->text_include[i]) != nullptr)
-			return true;
+	if (bitmap_has(&details->term_include, line_idx))
+		return true;
 	for (int32_t i = 0; i < details->pid_include.count; i++)
 		if (line->pid == details->pid_include[i])
 			return true;
+	if (app < details->app_include_names.count && details->app_include_names[app])
+		return true;
+	if (line->pattern < details->pattern_include_ids.count && details->pattern_include_ids[line->pattern])
+		return true;
+	if (details->field_tests.count > 0) {
+		const logcat_field_t *fields;
+		int32_t field_count = logcat_line_fields(&logcat, line_idx, &fields);
+		for (int32_t i = 0; i < details->field_tests.count; i++) {
+			const details_field_t &test = details->field_tests[i];
+			if (test.tag != -1 && test.tag != line->tag) continue;
+			for (int32_t f = 0; f < field_count; f++) {
+				if (fields[f].name != test.name) continue;
+				double value = fields[f].value;
+				switch (test.op) {
+				case '<': if (value <  test.value) return true; break;
+				case '>': if (value >  test.value) return true; break;
+				case 'l': if (value <= test.value) return true; break;
+				case 'g': if (value >= test.value) return true; break;
+				case '=': if (value == test.value) return true; break;
+				case '!': if (value != test.value) return true; break;
+				}
+			}
+		}
+	}
 
 	// If there are no includes at all, then all lines that got this far pass
-	return details->tag_include.count == 0 && details->text_include.count == 0 && details->pid_include.count == 0;
+	return details->tag_include.count == 0 && details->text_include.count == 0 && details->pid_include.count == 0 && details->app_include.count == 0 && details->field_include.count == 0 && details->pattern_include.count == 0;
+}
+
+///////////////////////////////////////////
+
+// Templates are a single compare per line, by id
+void details_match_patterns(details_t *details) {
+	details->pattern_include_ids.clear();
+	details->pattern_exclude_ids.clear();
+	for (int32_t i = 0; i < details->pattern_include.count; i++) {
+		uint16_t pattern = details->pattern_include[i];
+		while (details->pattern_include_ids.count <= pattern) details->pattern_include_ids.add(false);
+		details->pattern_include_ids[pattern] = true;
+	}
+	for (int32_t i = 0; i < details->pattern_exclude.count; i++) {
+		uint16_t pattern = details->pattern_exclude[i];
+		while (details->pattern_exclude_ids.count <= pattern) details->pattern_exclude_ids.add(false);
+		details->pattern_exclude_ids[pattern] = true;
+	}
+}
+
+///////////////////////////////////////////
+
+// Adds pattern to list, or takes it back out if it's there
+void details_toggle_pattern(array_t<uint16_t> *list, uint16_t pattern) {
+	for (int32_t i = 0; i < list->count; i++) {
+		if (list->get(i) != pattern) continue;
+		list->remove(i);
+		return;
+	}
+	list->add(pattern);
+}
+
+///////////////////////////////////////////
+
+// Works out which of logcat's process names each app filter matches, so
+// details_is_valid has no string work for them. The names have every
+// thread's in them too, thousands on a busy device, so it's skipped when
+// there are no app filters. Expects the lines mutex to be held.
+void details_match_apps(details_t *details) {
+	details->app_include_names.clear();
+	details->app_exclude_names.clear();
+	if (details->app_include.count + details->app_exclude.count == 0) return;
+	for (int32_t n = 0; n < logcat.names.count; n++) {
+		bool include = false;
+		bool exclude = false;
+		for (int32_t i = 0; i < details->app_include.count && !include && n > 0; i++)
+			include = strstr(logcat.names[n], details->app_include[i]) != nullptr;
+		for (int32_t i = 0; i < details->app_exclude.count && !exclude && n > 0; i++)
+			exclude = strstr(logcat.names[n], details->app_exclude[i]) != nullptr;
+		details->app_include_names.add(include);
+		details->app_exclude_names.add(exclude);
+	}
 }
 
 ///////////////////////////////////////////
 
-void details_get_selection(const details_t *details, int32_t *out_start, int32_t *out_end) {
+// Parses the field filters into tests, once a frame rather than per line.
+// Expects the lines mutex to be held.
+void details_match_fields(details_t *details) {
+	details->field_tests.clear();
+	for (int32_t i = 0; i < details->field_include.count; i++) {
+		const char *text = details->field_include[i];
+		size_t      len  = strcspn(text, "<>=!");
+		if (len == 0 || text[len] == '\0') continue;
+
+		details_field_t test = {};
+		const char *op = text + len;
+		test.op = op[0];
+		if      (op[0] == '<' && op[1] == '=') { test.op = 'l'; op++; }
+		else if (op[0] == '>' && op[1] == '=') { test.op = 'g'; op++; }
+		else if (op[0] == '!' && op[1] == '=') {                op++; }
+		else if (op[0] == '=' && op[1] == '=') {                op++; }
+		test.value = atof(op + 1);
+
+		// "tag.name", or just the name for any event that has it
+		char name[128];
+		snprintf(name, sizeof(name), "%.*s", (int)len, text);
+		while (len > 0 && name[len - 1] == ' ') name[--len] = '\0';
+		char *dot = strrchr(name, '.');
+		test.tag = -1;
+		if (dot != nullptr) {
+			*dot     = '\0';
+			test.tag = -2; // An event we haven't seen
+			for (int32_t t = 0; t < logcat.tags.count; t++)
+				if (strcmp(logcat.tags[t], name) == 0) test.tag = t;
+		}
+		test.name = logcat_find_field(&logcat, dot != nullptr ? dot + 1 : name);
+		details->field_tests.add(test);
+	}
+}
+
+///////////////////////////////////////////
+
+// The part of the filters logcat can apply on the device: a single pid, or a
+// handful of tags, and nothing else included. Excludes are cheap to leave to
+// us. Returns false while a filter is still being typed.
+bool details_device_filter(const details_t *details, logcat_filter_t *out_filter) {
+	*out_filter = {};
+	if (pid_search_live != 0) return false;
+	for (int32_t i = 0; i < details->tag_include.count; i++)
+		if (details->tag_include[i] == tag_search) return false;
+
+	for (int32_t i = 0; i < details->app_include.count; i++)
+		if (details->app_include[i] == app_search) return false;
+
+	if (details->text_include.count > 0 || details->app_include.count > 0 || details->field_include.count > 0 || details->pattern_include.count > 0) return true;
+	if (details->pid_include.count == 1 && details->tag_include.count == 0) {
+		out_filter->pid = details->pid_include[0];
+	} else if (details->pid_include.count == 0 && details->tag_include.count > 0 &&
+	           details->tag_include.count <= (int32_t)(sizeof(out_filter->tags) / sizeof(out_filter->tags[0]))) {
+		out_filter->tag_count = details->tag_include.count;
+		for (int32_t i = 0; i < details->tag_include.count; i++)
+			strncpy(out_filter->tags[i], details->tag_include[i], sizeof(out_filter->tags[i]) - 1);
+	}
+	return true;
+}
+
+///////////////////////////////////////////
+
+// Text and tag filters each keep a bitmap of the lines they match, so a
+// frame only tests them on lines that are new since the last one, and
+// combining them is a few ORs. A filter that's just been added is the only
+// one that scans, and taking one away, or putting it back soon after,
+// scans nothing. Expects the lines mutex to be held.
+void details_match_terms(details_t *details) {
+	if (details->terms_moved != logcat.lines_moved) {
+		// Tags go on clear too
+		for (int32_t t = 0; t < details->terms.count; t++) {
+			bitmap_clear(&details->terms[t].lines);
+			details->terms[t].tags.clear();
+			details->terms[t].scanned = 0;
+		}
+		details->terms_moved = logcat.lines_moved;
+	}
+	for (int32_t t = 0; t < details->terms.count; t++)
+		details->terms[t].used = false;
+
+	bitmap_clear(&details->term_include);
+	bitmap_clear(&details->term_exclude);
+	const array_t<char*> *lists[] = { &details->tag_include, &details->text_include, &details->tag_exclude, &details->text_exclude };
+	for (int32_t l = 0; l < 4; l++) {
+		bitmap_t *combined = l < 2 ? &details->term_include : &details->term_exclude;
+		for (int32_t i = 0; i < lists[l]->count; i++)
+			bitmap_or(combined, &details_term(details, lists[l]->get(i), l % 2 == 0)->lines);
+	}
+
+	// The least recently used go once there are too many
+	for (int32_t t = 0; t < details->terms.count && details->terms.count > details_terms_max; ) {
+		if (details->terms[t].used) { t++; continue; }
+		free(details->terms[t].text);
+		bitmap_free(&details->terms[t].lines);
+		details->terms[t].tags.free();
+		details->terms.remove(t);
+	}
+
+	bitmap_clear(&details->term_rows);
+	if (details_terms_only(details)) {
+		bitmap_or    (&details->term_rows, &details->term_include);
+		bitmap_andnot(&details->term_rows, &details->term_exclude);
+	}
+
+	details->search_total   = logcat.lines.count;
+	details->search_scanned = logcat.lines.count;
+	for (int32_t t = 0; t < details->terms.count; t++) {
+		const details_term_t &term = details->terms[t];
+		if (term.used && term.scanned < details->search_scanned)
+			details->search_scanned = term.scanned;
+	}
+}
+
+///////////////////////////////////////////
+
+// The query's text and regex tests keep their matches like text terms do,
+// so they catch up on new lines here and leave a fresh query's scan to the
+// search thread. Expects the lines mutex to be held, after
+// details_match_terms.
+void details_match_query(details_t *details) {
+	query_bind(&details->query, &logcat);
+	int64_t scanned = query_scanned(&details->query);
+	if (scanned < logcat.lines.count && logcat.lines.count - scanned <= details_search_sync) {
+		query_scan(&details->query, &logcat, logcat.lines.count);
+		scanned = logcat.lines.count;
+	}
+	if (scanned < details->search_scanned)
+		details->search_scanned = scanned;
+}
+
+///////////////////////////////////////////
+
+// Whether the query's text tests are behind, for the search thread. Expects
+// the lines mutex to be held.
+bool details_query_behind(const details_t *details) {
+	if (details->query.lines_moved != logcat.lines_moved) return false; // The UI hasn't caught up
+	return query_scanned(&details->query) < logcat.lines.count;
+}
+
+///////////////////////////////////////////
+
+// The term for text, made if it's new. It only tests lines right away when
+// it's a few behind, like with the lines that came in since the last frame,
+// and otherwise the search thread tests them a slice at a time while their
+// lines show up as they're found.
+details_term_t *details_term(details_t *details, const char *text, bool tag) {
+	details_term_t term = {};
+	for (int32_t t = 0; t < details->terms.count; t++) {
+		if (details->terms[t].tag != tag || strcmp(details->terms[t].text, text) != 0) continue;
+		term = details->terms[t];
+		details->terms.remove(t);
+		break;
+	}
+	if (term.text == nullptr) {
+		term.text = strdup(text);
+		term.tag  = tag;
+	}
+
+	if (term.scanned < logcat.lines.count && logcat.lines.count - term.scanned <= details_search_sync)
+		details_term_scan(details, &term, logcat.lines.count);
+	term.used = true;
+	details->terms.add(term);
+	return &details->terms.last();
+}
+
+///////////////////////////////////////////
+
+// Tests a term on its lines up to to. Text that has another cached term's
+// text in it can only match lines that one did, which is what typing a
+// filter out one letter at a time does, so only those get looked at.
+// Expects the lines mutex to be held.
+void details_term_scan(details_t *details, details_term_t *ref_term, int64_t to) {
+	TRACE_ZONE("details_term_scan");
+	if (ref_term->tag) {
+		// Tags are few, so each is tested once rather than per line
+		for (int32_t t = ref_term->tags.count; t < logcat.tags.count; t++)
+			ref_term->tags.add(strstr(logcat.tags[t], ref_term->text) != nullptr);
+		for (int64_t i = ref_term->scanned; i < to; i++)
+			if (ref_term->tags[logcat.lines[i].tag])
+				bitmap_add(&ref_term->lines, i);
+		ref_term->scanned = to;
+		return;
+	}
+
+	const details_term_t *narrow = nullptr;
+	for (int32_t t = 0; t < details->terms.count; t++) {
+		const details_term_t &from = details->terms[t];
+		if (&from == ref_term || from.tag || from.scanned < to || strstr(ref_term->text, from.text) == nullptr) continue;
+		if (narrow == nullptr || from.lines.count < narrow->lines.count) narrow = &from;
+	}
+
+	if (narrow != nullptr) {
+		for (int64_t i = bitmap_next(&narrow->lines, ref_term->scanned); i >= 0 && i < to; i = bitmap_next(&narrow->lines, i + 1))
+			if (strstr(logcat_line_text(&logcat, &logcat.lines[i]), ref_term->text) != nullptr)
+				bitmap_add(&ref_term->lines, i);
+	} else {
+		for (int64_t i = ref_term->scanned; i < to; i++)
+			if (strstr(logcat_line_text(&logcat, &logcat.lines[i]), ref_term->text) != nullptr)
+				bitmap_add(&ref_term->lines, i);
+	}
+	ref_term->scanned = to;
+}
+
+///////////////////////////////////////////
+
+// The term the search thread should work on, the most recently used
+// one that's behind. A term whose filter was typed over isn't used any more,
+// so its search stops there. Expects the lines mutex to be held.
+details_term_t *details_term_behind(details_t *details) {
+	if (details->terms_moved != logcat.lines_moved) return nullptr; // The UI hasn't caught up
+	for (int32_t t = details->terms.count - 1; t >= 0; t--) {
+		details_term_t &term = details->terms[t];
+		if (term.used && term.scanned < logcat.lines.count) return &term;
+	}
+	return nullptr;
+}
+
+///////////////////////////////////////////
+
+// Tests terms in the background, in order from the first line, so the
+// UI never scans more than a frame's worth of new lines. It only holds the
+// lines mutex for a slice at a time, and wakes the UI up to show what it's
+// found so far. Once there's nothing left to scan it ends, and
+// details_search_wake starts another when there is.
+int details_search_thread(void *) {
+	TRACE_THREAD("details_search_thread");
+
+	uint64_t woke_at = 0;
+	while (search_run) {
+		platform_mutex_lock(logcat.lines_mutex);
+		details_term_t *term  = details_term_behind(&details);
+		bool            query = term == nullptr && details_query_behind(&details);
+		if (term == nullptr && !query) {
+			// Under the mutex, so the UI can't see it idle before it is
+			search_busy = false;
+			platform_mutex_unlock(logcat.lines_mutex);
+			break;
+		}
+		uint64_t        start = platform_time_ns();
+		while (term != nullptr && term->scanned < logcat.lines.count && platform_time_ns() - start < details_search_slice_ns) {
+			int64_t to = term->scanned + 1024 < logcat.lines.count ? term->scanned + 1024 : logcat.lines.count;
+			details_term_scan(&details, term, to);
+		}
+		// Then the query, once the terms are done
+		while (query && query_scanned(&details.query) < logcat.lines.count && platform_time_ns() - start < details_search_slice_ns) {
+			int64_t from = query_scanned(&details.query);
+			query_scan(&details.query, &logcat, from + 1024 < logcat.lines.count ? from + 1024 : logcat.lines.count);
+		}
+		bool done = (term != nullptr && term->scanned == logcat.lines.count) ||
+		            (query && query_scanned(&details.query) >= logcat.lines.count);
+		platform_mutex_unlock(logcat.lines_mutex);
+
+		uint64_t now = platform_time_ns();
+		if (done || now - woke_at > 30 * 1000 * 1000) {
+			glfwPostEmptyEvent();
+			woke_at = now;
+		}
+		// Lets the UI and ingest threads have the mutex between slices
+		platform_sleep_ms(1);
+	}
+	return 0;
+}
+
+///////////////////////////////////////////
+
+// Starts the search thread if a term or the query has lines it hasn't
+// got to, and it isn't already on them. Expects the lines mutex to be held.
+void details_search_wake() {
+	if (search_busy) return;
+	if (details_term_behind(&details) == nullptr && !details_query_behind(&details)) return;
+
+	// The last one has let go of the mutex, and is all but done
+	if (search_thread != nullptr) platform_thread_join(search_thread);
+	search_busy   = true;
+	search_thread = platform_thread_create(details_search_thread, nullptr);
+	if (search_thread == nullptr) search_busy = false;
+}
+
+///////////////////////////////////////////
+
+// Stops the search thread and waits for it, so nothing holds on to the
+// lines mutex. Expects the lines mutex not to be held.
+void details_search_stop() {
+	search_run = false;
+	if (search_thread != nullptr) platform_thread_join(search_thread);
+	search_thread = nullptr;
+	search_busy   = false;
+	search_run    = true;
+}
+
+///////////////////////////////////////////
+
+// Drops everything kept by line index, for when the log is replaced. Its
+// lines_moved starts over then, so these could look current. Template
+// filters go too, the new log numbers its templates from scratch.
+void details_forget_lines(details_t *details) {
+	for (int32_t t = 0; t < details->terms.count; t++) {
+		free(details->terms[t].text);
+		bitmap_free(&details->terms[t].lines);
+		details->terms[t].tags.free();
+	}
+	details->terms.clear();
+	details->terms_moved = 0;
+	bitmap_clear(&details->term_include);
+	bitmap_clear(&details->term_exclude);
+	bitmap_clear(&details->term_rows);
+	query_compile(&details->query, query_text);
+	details->pattern_include.clear();
+	details->pattern_exclude.clear();
+}
+
+///////////////////////////////////////////
+
+// Follows another device's log in place of the current one. That replaces
+// the log data, lines mutex and all, so the search thread has to stop first.
+void device_connect(const char *device_id) {
+	details_search_stop();
+	logcat_thread_end  (&logcat_thread);
+	logcat_thread_start(device_id, &logcat_thread, &logcat);
+	details_forget_lines(&details);
+}
+
+///////////////////////////////////////////
+
+// Whether text and tag filters are the only includes, so only lines in
+// term_rows can pass and the rest needn't be looked at
+bool details_terms_only(const details_t *details) {
+	return details->tag_include.count + details->text_include.count > 0 &&
+		details->pid_include.count == 0 && details->app_include.count == 0 &&
+		details->field_include.count == 0 && details->pattern_include.count == 0;
+}
+
+///////////////////////////////////////////
+
+void details_get_selection(const details_t *details, int64_t *out_start, int64_t *out_end) {
 	if (details->selection_end < 0 || details->selected < 0) {
 		// No range selection, just the current line
 		*out_start = details->selected;
@@ -1019,8 +2296,8 @@ void details_get_selection(const details_t *details, int32_t *out_start, int32_t
 	}
 }
 
-void details_copy_selection(const details_t *details, const logcat_data_t *data, bool filter_active) {
-	int32_t start, end;
+void details_copy_selection(const details_t *details, logcat_data_t *data, bool filter_active) {
+	int64_t start, end;
 	details_get_selection(details, &start, &end);
 
 	if (start < 0 || end < 0 || start >= data->lines.count) return;
@@ -1028,13 +2305,13 @@ void details_copy_selection(const details_t *details, const logcat_data_t *data,
 
 	// Calculate required buffer size (only for valid lines when filtering)
 	size_t total_size = 0;
-	for (int32_t i = start; i <= end; i++) {
+	for (int64_t i = start; i <= end; i++) {
 		const logcat_line_t &line = data->lines[i];
 		// Skip filtered items
-		if (filter_active && !details_is_valid(details, &line)) continue;
+		if (filter_active && !details_is_valid(details, i)) continue;
 		// Format: "PID  TID S TAG: TEXT\n"
 		// Approximate max: 30 + tag_len + line_len
-		total_size += 32 + strlen(data->tags[line.tag]) + strlen(line.line);
+		total_size += 32 + strlen(data->tags[line.tag]) + strlen(logcat_line_text(data, &line));
 	}
 	if (total_size == 0) return; // Nothing to copy
 	total_size += 1; // null terminator
@@ -1043,16 +2320,16 @@ void details_copy_selection(const details_t *details, const logcat_data_t *data,
 	if (!buffer) return;
 
 	char *ptr = buffer;
-	for (int32_t i = start; i <= end; i++) {
+	for (int64_t i = start; i <= end; i++) {
 		const logcat_line_t &line = data->lines[i];
 		// Skip filtered items
-		if (filter_active && !details_is_valid(details, &line)) continue;
+		if (filter_active && !details_is_valid(details, i)) continue;
 		int written;
 		if (line.severity == 0) {
-			written = sprintf(ptr, "%s\n", line.line);
+			written = sprintf(ptr, "%s\n", logcat_line_text(data, &line));
 		} else {
 			written = sprintf(ptr, "%d %d %c %s: %s\n",
-				line.pid, line.tid, line.severity, data->tags[line.tag], line.line);
+				line.pid, line.tid, line.severity, data->tags[line.tag], logcat_line_text(data, &line));
 		}
 		ptr += written;
 	}
@@ -1132,6 +2409,23 @@ const char *_strcasestr(const char *haystack, const char *needle) {
 
 ///////////////////////////////////////////
 
+// How long the main loop can sleep for when nothing is happening. Background
+// work that doesn't wake the UI itself gets polled a bit more often.
+double ui_wait_timeout() {
+	if (app_finder   .state == app_finder_state_searching    ||
+	    logcat_thread.backfilling                            ||
+	    app_launcher .state == app_launcher_state_launching)
+		return 0.1;
+	if (show_diagnostics || show_patterns)
+		return 0.5;
+	// Blinking text cursor
+	if (ImGui::GetIO().WantTextInput)
+		return 0.5;
+	return 2.0;
+}
+
+///////////////////////////////////////////
+
 void ui_set_theme() {
 	ImGui::GetStyle().FrameRounding = 8;
 	ImGui::GetStyle().FramePadding  = {8, 4};
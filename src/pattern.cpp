@@ -0,0 +1,236 @@
+#include "pattern.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+///////////////////////////////////////////
+
+const uint32_t pattern_param      = 0;
+// Word ids past this can't be told apart in group keys, that's a lot of words
+const uint32_t pattern_key_mask   = (1u << 28) - 1;
+
+uint64_t pattern_hash       (const char *start, int32_t length);
+uint32_t pattern_word       (pattern_tree_t *ref_tree, const char *start, int32_t length);
+int32_t  pattern_group      (pattern_tree_t *ref_tree, uint64_t key);
+void     pattern_table_grow (int32_t **ref_table, int32_t *ref_size, int32_t count, uint64_t (*hash)(const pattern_tree_t *, int32_t), const pattern_tree_t *tree);
+uint64_t pattern_vocab_hash (const pattern_tree_t *tree, int32_t id);
+uint64_t pattern_group_hash (const pattern_tree_t *tree, int32_t group);
+
+///////////////////////////////////////////
+
+uint64_t pattern_hash(const char *start, int32_t length) {
+	uint64_t hash = 14695981039346656037ull;
+	for (int32_t i = 0; i < length; i++) {
+		hash ^= (uint8_t)start[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+///////////////////////////////////////////
+
+uint64_t pattern_vocab_hash(const pattern_tree_t *tree, int32_t id) {
+	const char *word = &tree->vocab[tree->vocab_at[id]];
+	return pattern_hash(word, (int32_t)strlen(word));
+}
+
+uint64_t pattern_group_hash(const pattern_tree_t *tree, int32_t group) {
+	return tree->groups[group].key * 0x9E3779B97F4A7C15ull;
+}
+
+///////////////////////////////////////////
+
+// Both tables hold index + 1 and stay at most half full, so a probe always
+// finds an empty slot
+void pattern_table_grow(int32_t **ref_table, int32_t *ref_size, int32_t count, uint64_t (*hash)(const pattern_tree_t *, int32_t), const pattern_tree_t *tree) {
+	if (count * 2 < *ref_size) return;
+
+	int32_t  size  = *ref_size < 1024 ? 1024 : *ref_size * 2;
+	int32_t *table = (int32_t*)calloc(size, sizeof(int32_t));
+	for (int32_t i = 0; i < count; i++) {
+		uint32_t at = (uint32_t)hash(tree, i) & (size - 1);
+		while (table[at] != 0) at = (at + 1) & (size - 1);
+		table[at] = i + 1;
+	}
+	free(*ref_table);
+	*ref_table = table;
+	*ref_size  = size;
+}
+
+///////////////////////////////////////////
+
+uint32_t pattern_word(pattern_tree_t *ref_tree, const char *start, int32_t length) {
+	if (ref_tree->vocab_at.count == 0) {
+		ref_tree->vocab_at.add(0);
+		for (const char *c = "<*>"; ; c++) {
+			ref_tree->vocab.add(*c);
+			if (*c == '\0') break;
+		}
+	}
+
+	uint64_t hash = pattern_hash(start, length);
+	uint32_t mask = ref_tree->vocab_table_size - 1;
+	if (ref_tree->vocab_table != nullptr) {
+		for (uint32_t at = (uint32_t)hash & mask; ref_tree->vocab_table[at] != 0; at = (at + 1) & mask) {
+			int32_t     id   = ref_tree->vocab_table[at] - 1;
+			const char *word = &ref_tree->vocab[ref_tree->vocab_at[id]];
+			if (strncmp(word, start, length) == 0 && word[length] == '\0')
+				return (uint32_t)id;
+		}
+	}
+
+	int32_t id = ref_tree->vocab_at.count;
+	ref_tree->vocab_at.add(ref_tree->vocab.count);
+	for (int32_t i = 0; i < length; i++)
+		ref_tree->vocab.add(start[i]);
+	ref_tree->vocab.add('\0');
+
+	pattern_table_grow(&ref_tree->vocab_table, &ref_tree->vocab_table_size, ref_tree->vocab_at.count, pattern_vocab_hash, ref_tree);
+	mask = ref_tree->vocab_table_size - 1;
+	uint32_t at = (uint32_t)hash & mask;
+	while (ref_tree->vocab_table[at] != 0) at = (at + 1) & mask;
+	ref_tree->vocab_table[at] = id + 1;
+	return (uint32_t)id;
+}
+
+///////////////////////////////////////////
+
+int32_t pattern_group(pattern_tree_t *ref_tree, uint64_t key) {
+	uint64_t hash = key * 0x9E3779B97F4A7C15ull;
+	uint32_t mask = ref_tree->group_table_size - 1;
+	if (ref_tree->group_table != nullptr) {
+		for (uint32_t at = (uint32_t)hash & mask; ref_tree->group_table[at] != 0; at = (at + 1) & mask) {
+			int32_t group = ref_tree->group_table[at] - 1;
+			if (ref_tree->groups[group].key == key) return group;
+		}
+	}
+
+	int32_t group = ref_tree->groups.count;
+	ref_tree->groups.add({ key, pattern_none });
+	pattern_table_grow(&ref_tree->group_table, &ref_tree->group_table_size, ref_tree->groups.count, pattern_group_hash, ref_tree);
+	mask = ref_tree->group_table_size - 1;
+	uint32_t at = (uint32_t)hash & mask;
+	while (ref_tree->group_table[at] != 0) at = (at + 1) & mask;
+	ref_tree->group_table[at] = group + 1;
+	return group;
+}
+
+///////////////////////////////////////////
+
+uint16_t pattern_match(pattern_tree_t *ref_tree, const char *text, int64_t count) {
+	if (ref_tree->patterns.count == 0)
+		ref_tree->patterns.add({});
+
+	// Split into words, parameters and all
+	uint32_t    words[pattern_max_words];
+	int32_t     word_count = 0;
+	const char *c          = text;
+	while (true) {
+		while (*c == ' ' || *c == '\t' || *c == '\n' || *c == '\r') c++;
+		if (*c == '\0') break;
+
+		const char *start = c;
+		bool        param = false;
+		while (*c != '\0' && *c != ' ' && *c != '\t' && *c != '\n' && *c != '\r') {
+			param = param || (*c >= '0' && *c <= '9') || *c == '/';
+			c++;
+		}
+		if (word_count == pattern_max_words) break;
+		int32_t length = (int32_t)(c - start);
+		param = param || (length == 3 && memcmp(start, "<*>", 3) == 0);
+		words[word_count++] = param ? pattern_param : pattern_word(ref_tree, start, length);
+	}
+
+	uint64_t key   = (uint64_t)word_count;
+	if (word_count > 0) key |= (uint64_t)(words[0] & pattern_key_mask) << 8;
+	if (word_count > 1) key |= (uint64_t)(words[1] & pattern_key_mask) << 36;
+	int32_t  group = pattern_group(ref_tree, key);
+
+	// The template sharing the most words, at least half of them, giving up
+	// on each as soon as it can't beat the best so far
+	int32_t best       = pattern_none;
+	int32_t best_same  = (word_count + 1) / 2 - 1;
+	for (int32_t p = ref_tree->groups[group].first; p != pattern_none; p = ref_tree->patterns[p].next) {
+		const uint32_t *pattern_words = &ref_tree->words[ref_tree->patterns[p].words];
+		int32_t         misses_max    = word_count - best_same - 1;
+		int32_t         misses        = 0;
+		for (int32_t w = 0; w < word_count && misses <= misses_max; w++)
+			if (pattern_words[w] != words[w] && pattern_words[w] != pattern_param) misses++;
+		if (misses > misses_max) continue;
+		best      = p;
+		best_same = word_count - misses;
+		if (misses == 0) break;
+	}
+
+	if (best != pattern_none) {
+		pattern_t &pattern       = ref_tree->patterns[best];
+		uint32_t  *pattern_words = &ref_tree->words[pattern.words];
+		for (int32_t w = 0; w < word_count; w++) {
+			if (pattern_words[w] == words[w] || pattern_words[w] == pattern_param) continue;
+			pattern_words[w] = pattern_param;
+			free(pattern.text);
+			pattern.text = nullptr;
+		}
+		pattern.lines += count;
+		return (uint16_t)best;
+	}
+
+	if (ref_tree->patterns.count > pattern_max)
+		return pattern_none;
+	pattern_t pattern = {};
+	pattern.words      = ref_tree->words.count;
+	pattern.word_count = word_count;
+	pattern.next       = ref_tree->groups[group].first;
+	pattern.lines      = count;
+	for (int32_t w = 0; w < word_count; w++)
+		ref_tree->words.add(words[w]);
+	ref_tree->groups[group].first = ref_tree->patterns.count;
+	ref_tree->patterns.add(pattern);
+	return (uint16_t)(ref_tree->patterns.count - 1);
+}
+
+///////////////////////////////////////////
+
+const char *pattern_text(pattern_tree_t *ref_tree, uint16_t pattern_idx) {
+	if (pattern_idx == pattern_none || pattern_idx >= ref_tree->patterns.count) return "";
+
+	pattern_t &pattern = ref_tree->patterns[pattern_idx];
+	if (pattern.text != nullptr) return pattern.text;
+
+	size_t size = 1;
+	for (int32_t w = 0; w < pattern.word_count; w++)
+		size += strlen(&ref_tree->vocab[ref_tree->vocab_at[ref_tree->words[pattern.words + w]]]) + 1;
+	pattern.text = (char*)malloc(size);
+	char *at = pattern.text;
+	for (int32_t w = 0; w < pattern.word_count; w++) {
+		const char *word   = &ref_tree->vocab[ref_tree->vocab_at[ref_tree->words[pattern.words + w]]];
+		size_t      length = strlen(word);
+		if (w > 0) *at++ = ' ';
+		memcpy(at, word, length);
+		at += length;
+	}
+	*at = '\0';
+	return pattern.text;
+}
+
+///////////////////////////////////////////
+
+void pattern_tree_reset(pattern_tree_t *ref_tree) {
+	for (int32_t p = 0; p < ref_tree->patterns.count; p++)
+		ref_tree->patterns[p].lines = 0;
+}
+
+///////////////////////////////////////////
+
+void pattern_tree_free(pattern_tree_t *ref_tree) {
+	for (int32_t p = 0; p < ref_tree->patterns.count; p++)
+		free(ref_tree->patterns[p].text);
+	ref_tree->patterns.free();
+	ref_tree->words   .free();
+	ref_tree->groups  .free();
+	ref_tree->vocab   .free();
+	ref_tree->vocab_at.free();
+	free(ref_tree->group_table);
+	free(ref_tree->vocab_table);
+	*ref_tree = {};
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+// Sorts log messages into templates as they come in, the way Drain does.
+// A message is split into words on spaces, and any word with a digit or a
+// '/' in it, numbers, hex, ids and paths, is a parameter. Templates are
+// grouped by word count and first two words, and a message goes to the
+// template in its group that it shares the most words with. If it shares at
+// least half, the words that differ become parameters, <*>, otherwise it
+// starts a template of its own.
+//
+//	pattern_tree_t tree = {};
+//	uint16_t a = pattern_match(&tree, "took 12 ms to draw", 1);
+//	uint16_t b = pattern_match(&tree, "took 3 ms to draw",  1); // a == b
+//	printf("%s\n", pattern_text(&tree, a)); // "took <*> ms to draw"
+//	pattern_tree_free(&tree);
+
+#include <stdint.h>
+
+#include "array.h"
+
+///////////////////////////////////////////
+
+// What text gets when there's no room for another template
+const uint16_t pattern_none      = 0;
+const int32_t  pattern_max       = UINT16_MAX;
+// Words past this many are left out
+const int32_t  pattern_max_words = 64;
+
+struct pattern_t {
+	int32_t  words;      // Where its word ids start in pattern_tree_t::words
+	int32_t  word_count; // Up to pattern_max_words
+	int32_t  next;       // The next one in its group, pattern_none at the end
+	int64_t  lines;      // Messages that matched it, less any taken back
+	char    *text;       // Made by pattern_text, and dropped when it changes
+};
+
+struct pattern_group_t {
+	uint64_t key;   // Word count and first two word ids
+	int32_t  first; // Newest template in the group
+};
+
+struct pattern_tree_t {
+	array_t<pattern_t>       patterns;  // 0 is pattern_none
+	array_t<uint32_t>        words;     // Each template's word ids, back to back
+	array_t<pattern_group_t> groups;
+	int32_t                 *group_table; // Open addressing, group index + 1
+	int32_t                  group_table_size;
+
+	// Every word seen, id 0 is <*>
+	array_t<char>            vocab;      // Back to back, each with a terminator
+	array_t<int32_t>         vocab_at;   // Where each id's word starts
+	int32_t                 *vocab_table; // Open addressing, id + 1
+	int32_t                  vocab_table_size;
+};
+
+// Which template text belongs to, adding count to its lines. count can be
+// 0 to only look it up. Text from pattern_text matches its own template.
+uint16_t    pattern_match    (pattern_tree_t *ref_tree, const char *text, int64_t count);
+// The template with <*> for its parameters, good until the template changes
+const char *pattern_text     (pattern_tree_t *ref_tree, uint16_t pattern);
+// Zeroes every template's lines, but keeps the templates
+void        pattern_tree_reset(pattern_tree_t *ref_tree);
+void        pattern_tree_free(pattern_tree_t *ref_tree);
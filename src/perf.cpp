@@ -0,0 +1,83 @@
+#include "perf.h"
+
+///////////////////////////////////////////
+
+perf_counters_t       perf       = {};
+perf_frame_counters_t perf_frame = {};
+
+// When the current thread took its lock, for measuring hold time
+thread_local uint64_t perf_lock_start = 0;
+
+const uint64_t perf_sample_ns = 500000000;
+
+///////////////////////////////////////////
+
+void perf_lock(platform_mutex_t mutex, perf_thread_ thread) {
+	uint64_t start = platform_time_ns();
+	platform_mutex_lock(mutex);
+	perf_lock_start = platform_time_ns();
+
+	perf.locks[thread].wait_ns.fetch_add(perf_lock_start - start, std::memory_order_relaxed);
+	perf.locks[thread].count  .fetch_add(1,                       std::memory_order_relaxed);
+}
+
+///////////////////////////////////////////
+
+void perf_unlock(platform_mutex_t mutex, perf_thread_ thread) {
+	uint64_t held = platform_time_ns() - perf_lock_start;
+	platform_mutex_unlock(mutex);
+
+	perf.locks[thread].hold_ns.fetch_add(held, std::memory_order_relaxed);
+}
+
+///////////////////////////////////////////
+
+bool perf_sample(perf_rates_t *ref_rates) {
+	struct snapshot_t {
+		uint64_t time_ns;
+		uint64_t lines, bytes, parse_ns;
+		uint64_t wait_ns[perf_thread_max], hold_ns[perf_thread_max], locks[perf_thread_max];
+		perf_frame_counters_t frame;
+	};
+	static snapshot_t prev = {};
+
+	uint64_t now = platform_time_ns();
+	if (now - prev.time_ns < perf_sample_ns) return false;
+
+	snapshot_t curr = {};
+	curr.time_ns  = now;
+	curr.lines    = perf.lines   .load(std::memory_order_relaxed);
+	curr.bytes    = perf.bytes   .load(std::memory_order_relaxed);
+	curr.parse_ns = perf.parse_ns.load(std::memory_order_relaxed);
+	curr.frame    = perf_frame;
+	for (int32_t i = 0; i < perf_thread_max; i++) {
+		curr.wait_ns[i] = perf.locks[i].wait_ns.load(std::memory_order_relaxed);
+		curr.hold_ns[i] = perf.locks[i].hold_ns.load(std::memory_order_relaxed);
+		curr.locks  [i] = perf.locks[i].count  .load(std::memory_order_relaxed);
+	}
+
+	// The first sample has nothing to compare against
+	if (prev.time_ns != 0) {
+		double seconds = (now - prev.time_ns) / 1000000000.0;
+		uint64_t lines  = curr.lines        - prev.lines;
+		uint64_t frames = curr.frame.frames - prev.frame.frames;
+
+		perf_rates_t rates = {};
+		rates.lines_per_sec     = lines / seconds;
+		rates.bytes_per_sec     = (curr.bytes - prev.bytes) / seconds;
+		rates.parse_ns_per_line = lines > 0 ? (double)(curr.parse_ns - prev.parse_ns) / lines : 0;
+		for (int32_t i = 0; i < perf_thread_max; i++) {
+			uint64_t locks = curr.locks[i] - prev.locks[i];
+			rates.lock_wait_us [i] = locks > 0 ? (curr.wait_ns[i] - prev.wait_ns[i]) / 1000.0 / locks : 0;
+			rates.lock_hold_us [i] = locks > 0 ? (curr.hold_ns[i] - prev.hold_ns[i]) / 1000.0 / locks : 0;
+			rates.lock_held_pct[i] = (curr.hold_ns[i] - prev.hold_ns[i]) / 10000000.0 / seconds;
+		}
+		rates.frames_per_sec = frames / seconds;
+		rates.frame_ms       = frames > 0 ? (curr.frame.frame_ns  - prev.frame.frame_ns ) / 1000000.0 / frames : 0;
+		rates.filter_ms      = frames > 0 ? (curr.frame.filter_ns - prev.frame.filter_ns) / 1000000.0 / frames : 0;
+		rates.rows_per_frame = frames > 0 ? (double)(curr.frame.rows - prev.frame.rows) / frames : 0;
+		*ref_rates = rates;
+	}
+	prev = curr;
+	return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+// Cheap always-on performance counters, shown in the diagnostics window.
+
+#include <stdint.h>
+#include <atomic>
+
+#include "platform.h"
+
+///////////////////////////////////////////
+
+enum perf_thread_ {
+	perf_thread_ingest,
+	perf_thread_ui,
+	perf_thread_max
+};
+
+struct alignas(64) perf_lock_stats_t {
+	std::atomic<uint64_t> wait_ns;
+	std::atomic<uint64_t> hold_ns;
+	std::atomic<uint64_t> count;
+};
+
+// Running totals that only ever grow, written from any thread. The ingest
+// thread batches its additions per pipe read, so these are touched a few
+// times per 4kb of log rather than per line.
+struct perf_counters_t {
+	std::atomic<uint64_t> lines;
+	std::atomic<uint64_t> bytes;
+	std::atomic<uint64_t> parse_ns;
+	std::atomic<int32_t>  queue_bytes; // Unread bytes in the pipe at the last read
+	perf_lock_stats_t     locks[perf_thread_max];
+};
+
+// Totals for the UI thread, which is the only one that touches these.
+struct perf_frame_counters_t {
+	uint64_t frames;
+	uint64_t frame_ns;
+	uint64_t filter_ns;
+	uint64_t rows;
+};
+
+// Averages over the last sample window.
+struct perf_rates_t {
+	double lines_per_sec;
+	double bytes_per_sec;
+	double parse_ns_per_line;
+	double lock_wait_us  [perf_thread_max];
+	double lock_hold_us  [perf_thread_max];
+	double lock_held_pct [perf_thread_max];
+	double frame_ms;
+	double filter_ms;
+	double rows_per_frame;
+	double frames_per_sec;
+};
+
+extern perf_counters_t       perf;
+extern perf_frame_counters_t perf_frame;
+
+void perf_lock   (platform_mutex_t mutex, perf_thread_ thread);
+void perf_unlock (platform_mutex_t mutex, perf_thread_ thread);
+bool perf_sample (perf_rates_t *ref_rates);
@@ -1,7 +1,8 @@
 #pragma once
 
 // Platform abstraction layer for cross-platform support
-// Handles threading, process management, synchronization, and file dialogs
+// Handles threading, process management, synchronization, sockets, temp
+// files, and file dialogs
 
 #include <stdint.h>
 
@@ -23,6 +24,8 @@ typedef void* platform_thread_t;
 typedef void* platform_mutex_t;
 typedef void* platform_process_t;
 typedef void* platform_pipe_t;
+typedef void* platform_socket_t;
+typedef void* platform_file_t;
 
 ///////////////////////////////////////////
 // Thread management
@@ -39,6 +42,12 @@ void platform_thread_join(platform_thread_t thread);
 // Sleep for specified milliseconds
 void platform_sleep_ms(int milliseconds);
 
+///////////////////////////////////////////
+// Time
+
+// Monotonic time in nanoseconds, only useful for measuring durations
+uint64_t platform_time_ns();
+
 ///////////////////////////////////////////
 // Mutex/Synchronization
 
@@ -63,8 +72,10 @@ struct platform_process_result_t {
     bool               success;
 };
 
-// Start a process and capture its stdout
-platform_process_result_t platform_process_start(const char* command);
+// Start a process and capture its stdout and stderr. args is a nullptr
+// terminated argv array, args[0] is the executable and gets searched for on
+// the PATH. No shell is involved, so arguments don't need any quoting.
+platform_process_result_t platform_process_start(const char* const* args);
 
 // Check if process is still running
 bool platform_process_is_running(platform_process_t process);
@@ -88,6 +99,54 @@ int32_t platform_pipe_peek(platform_pipe_t pipe);
 // Close a pipe
 void platform_pipe_close(platform_pipe_t pipe);
 
+///////////////////////////////////////////
+// Sockets
+
+// Open a TCP connection, returns nullptr on failure
+platform_socket_t platform_socket_connect(const char* host, uint16_t port);
+
+// Send all of data, returns false if the connection failed
+bool platform_socket_send(platform_socket_t socket, const void* data, int32_t size);
+
+// Wait up to timeout_ms for data (-1 waits forever) and read what's there.
+// Returns number of bytes read, 0 on timeout, -1 once the connection is closed
+int32_t platform_socket_recv(platform_socket_t socket, void* buffer, int32_t buffer_size, int32_t timeout_ms);
+
+// Check how many bytes are available to read without blocking
+int32_t platform_socket_peek(platform_socket_t socket);
+
+// Close the connection
+void platform_socket_close(platform_socket_t socket);
+
+///////////////////////////////////////////
+// Temp files
+
+// A read only view of part of a file
+struct platform_map_t {
+    const void* data;
+    void*       base; // Where the view starts, data rounded down to what the OS maps by
+    uint64_t    size;
+};
+
+// Create an empty file in the temp folder, that gets deleted once it's
+// closed or the app exits, however it exits. Returns nullptr on failure.
+platform_file_t platform_temp_file_create();
+
+// Write all of data to the end of the file, returns false if it couldn't
+bool platform_file_append(platform_file_t file, const void* data, int32_t size);
+
+// Map size bytes from offset for reading, returns false on failure
+bool platform_file_map(platform_file_t file, uint64_t offset, int32_t size, platform_map_t* out_map);
+
+// Let go of a view from platform_file_map
+void platform_file_unmap(platform_map_t* ref_map);
+
+// Hint that a range is about to be read, so the OS can start reading it in
+void platform_file_prefetch(platform_file_t file, uint64_t offset, uint64_t size);
+
+// Close (and so delete) a temp file
+void platform_file_close(platform_file_t file);
+
 ///////////////////////////////////////////
 // File dialogs
 
@@ -100,3 +159,10 @@ bool platform_file_dialog_save(char* filename_buffer, int32_t buffer_size, const
 
 // Set the current working directory to the executable's directory
 void platform_set_working_dir_to_exe();
+
+///////////////////////////////////////////
+// Cache files
+
+// Path for a file in log-panther's per-user cache folder, creating the
+// folder if needed. Returns false if there's nowhere to put it.
+bool platform_cache_path(char* path_buffer, int32_t buffer_size, const char* filename);
@@ -12,6 +12,17 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <errno.h>
+#include <time.h>
+#include <spawn.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+extern char **environ;
 
 ///////////////////////////////////////////
 // Thread management
@@ -54,6 +65,15 @@ void platform_sleep_ms(int milliseconds) {
     usleep(milliseconds * 1000);
 }
 
+///////////////////////////////////////////
+// Time
+
+uint64_t platform_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
 ///////////////////////////////////////////
 // Mutex/Synchronization
 
@@ -87,48 +107,48 @@ struct platform_process_data_t {
     int stdout_pipe_fd;
 };
 
-platform_process_result_t platform_process_start(const char* command) {
+platform_process_result_t platform_process_start(const char* const* args) {
     platform_process_result_t result = {};
 
     platform_process_data_t* proc_data = (platform_process_data_t*)malloc(sizeof(platform_process_data_t));
     proc_data->pid = -1;
     proc_data->stdout_pipe_fd = -1;
 
+    // Close-on-exec, so concurrently spawned children don't inherit each
+    // other's pipes and hold them open.
     int pipe_fds[2];
-    if (pipe(pipe_fds) == -1) {
+    if (pipe2(pipe_fds, O_CLOEXEC) == -1) {
         free(proc_data);
         result.success = false;
         return result;
     }
 
-    pid_t pid = fork();
-    if (pid == -1) {
-        // Fork failed
+    // Redirect stdout and stderr to the pipe. dup2 clears close-on-exec on
+    // the new descriptors.
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDERR_FILENO);
+
+    // posix_spawn uses vfork-style cloning, rather than fork copying our
+    // page tables, which gets slow once we're holding a lot of log. adb is
+    // run directly instead of through a shell.
+    pid_t pid;
+    int   err = posix_spawnp(&pid, args[0], &actions, nullptr, (char* const*)args, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipe_fds[1]); // Close write end
+
+    if (err != 0) {
         close(pipe_fds[0]);
-        close(pipe_fds[1]);
         free(proc_data);
         result.success = false;
         return result;
     }
 
-    if (pid == 0) {
-        // Child process
-        close(pipe_fds[0]); // Close read end
-
-        // Redirect stdout and stderr to pipe
-        dup2(pipe_fds[1], STDOUT_FILENO);
-        dup2(pipe_fds[1], STDERR_FILENO);
-        close(pipe_fds[1]);
-
-        // Execute command using shell
-        execl("/bin/sh", "sh", "-c", command, (char*)nullptr);
-
-        // If execl returns, it failed
-        exit(1);
-    }
-
-    // Parent process
-    close(pipe_fds[1]); // Close write end
+    // Give the pipe more room than the 64kb default, so a chatty device
+    // doesn't block on us while we're busy. This can fail when over the
+    // system's pipe-max-size, which is fine.
+    fcntl(pipe_fds[0], F_SETPIPE_SZ, 1024 * 1024);
 
     // Set read end to non-blocking
     int flags = fcntl(pipe_fds[0], F_GETFL, 0);
@@ -156,7 +176,9 @@ bool platform_process_is_running(platform_process_t process) {
         // Process is still running
         return true;
     } else if (result == proc_data->pid) {
-        // Process has exited
+        // Process has exited, and is reaped. Forget the pid so terminate
+        // can't signal some other process that reuses it.
+        proc_data->pid = -1;
         return false;
     } else {
         // Error or invalid pid
@@ -231,6 +253,97 @@ void platform_pipe_close(platform_pipe_t pipe) {
     close(fd);
 }
 
+///////////////////////////////////////////
+// Sockets
+
+struct platform_socket_data_t {
+    int fd;
+};
+
+platform_socket_t platform_socket_connect(const char* host, uint16_t port) {
+    char port_str[8];
+    snprintf(port_str, sizeof(port_str), "%u", port);
+
+    addrinfo hints = {};
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addrs = nullptr;
+    if (getaddrinfo(host, port_str, &hints, &addrs) != 0)
+        return nullptr;
+
+    int fd = -1;
+    for (addrinfo* addr = addrs; addr != nullptr; addr = addr->ai_next) {
+        fd = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC, addr->ai_protocol);
+        if (fd == -1) continue;
+        if (connect(fd, addr->ai_addr, addr->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+    if (fd == -1) return nullptr;
+
+    // Requests are tiny, don't let Nagle sit on them
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    platform_socket_data_t* data = (platform_socket_data_t*)malloc(sizeof(platform_socket_data_t));
+    data->fd = fd;
+    return data;
+}
+
+bool platform_socket_send(platform_socket_t socket, const void* data, int32_t size) {
+    if (socket == nullptr) return false;
+
+    int fd = ((platform_socket_data_t*)socket)->fd;
+    int32_t sent = 0;
+    while (sent < size) {
+        ssize_t result = send(fd, (const char*)data + sent, size - sent, MSG_NOSIGNAL);
+        if (result == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        sent += (int32_t)result;
+    }
+    return true;
+}
+
+int32_t platform_socket_recv(platform_socket_t socket, void* buffer, int32_t buffer_size, int32_t timeout_ms) {
+    if (socket == nullptr) return -1;
+
+    int fd = ((platform_socket_data_t*)socket)->fd;
+    pollfd poll_fd = {};
+    poll_fd.fd     = fd;
+    poll_fd.events = POLLIN;
+    int ready = poll(&poll_fd, 1, timeout_ms);
+    if (ready == 0) return 0;
+    if (ready == -1) return errno == EINTR ? 0 : -1;
+
+    ssize_t bytes_read = recv(fd, buffer, buffer_size, MSG_DONTWAIT);
+    if (bytes_read == -1)
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+    if (bytes_read == 0)
+        return -1; // Closed by the other end
+
+    return (int32_t)bytes_read;
+}
+
+int32_t platform_socket_peek(platform_socket_t socket) {
+    if (socket == nullptr) return -1;
+
+    int available = 0;
+    if (ioctl(((platform_socket_data_t*)socket)->fd, FIONREAD, &available) == -1)
+        return 0;
+    return available;
+}
+
+void platform_socket_close(platform_socket_t socket) {
+    if (socket == nullptr) return;
+
+    platform_socket_data_t* data = (platform_socket_data_t*)socket;
+    close(data->fd);
+    free(data);
+}
+
 ///////////////////////////////////////////
 // File dialogs
 
@@ -309,4 +422,87 @@ void platform_set_working_dir_to_exe() {
     }
 }
 
+///////////////////////////////////////////
+// Temp files
+
+platform_file_t platform_temp_file_create() {
+    const char* tmp = getenv("TMPDIR");
+    if (tmp == nullptr || tmp[0] == '\0') tmp = "/tmp";
+
+    // O_TMPFILE never has a name, otherwise unlink it straight away
+    int fd = open(tmp, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/log-panther-XXXXXX", tmp);
+        fd = mkostemp(path, O_CLOEXEC);
+        if (fd == -1) return nullptr;
+        unlink(path);
+    }
+    return (platform_file_t)(intptr_t)fd;
+}
+
+bool platform_file_append(platform_file_t file, const void* data, int32_t size) {
+    if (file == nullptr) return false;
+
+    int         fd = (int)(intptr_t)file;
+    const char* at = (const char*)data;
+    while (size > 0) {
+        ssize_t written = write(fd, at, size);
+        if (written == -1 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        at   += written;
+        size -= (int32_t)written;
+    }
+    return true;
+}
+
+bool platform_file_map(platform_file_t file, uint64_t offset, int32_t size, platform_map_t* out_map) {
+    *out_map = {};
+    if (file == nullptr) return false;
+
+    static const uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t start = offset - offset % page;
+    uint64_t len   = offset - start + size;
+    void*    base  = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, (int)(intptr_t)file, (off_t)start);
+    if (base == MAP_FAILED) return false;
+
+    out_map->base = base;
+    out_map->size = len;
+    out_map->data = (const char*)base + (offset - start);
+    return true;
+}
+
+void platform_file_unmap(platform_map_t* ref_map) {
+    if (ref_map->base != nullptr) munmap(ref_map->base, ref_map->size);
+    *ref_map = {};
+}
+
+void platform_file_prefetch(platform_file_t file, uint64_t offset, uint64_t size) {
+    if (file == nullptr) return;
+    posix_fadvise((int)(intptr_t)file, (off_t)offset, (off_t)size, POSIX_FADV_WILLNEED);
+}
+
+void platform_file_close(platform_file_t file) {
+    if (file == nullptr) return;
+    close((int)(intptr_t)file);
+}
+
+///////////////////////////////////////////
+
+bool platform_cache_path(char* path_buffer, int32_t buffer_size, const char* filename) {
+    // $XDG_CACHE_HOME, or ~/.cache when that isn't set
+    char        dir[PATH_MAX];
+    const char* xdg  = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if      (xdg  != nullptr && xdg[0]  != '\0') snprintf(dir, sizeof(dir), "%s", xdg);
+    else if (home != nullptr && home[0] != '\0') snprintf(dir, sizeof(dir), "%s/.cache", home);
+    else return false;
+
+    mkdir(dir, 0755);
+    strncat(dir, "/log-panther", sizeof(dir) - strlen(dir) - 1);
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) return false;
+
+    return snprintf(path_buffer, buffer_size, "%s/%s", dir, filename) < buffer_size;
+}
+
 #endif // PLATFORM_LINUX
@@ -3,10 +3,13 @@
 #ifdef PLATFORM_WINDOWS
 
 #define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
 #include <windows.h>
 #include <commdlg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define GLFW_EXPOSE_NATIVE_WIN32
 #include <GLFW/glfw3.h>
@@ -63,6 +66,21 @@ void platform_sleep_ms(int milliseconds) {
     Sleep(milliseconds);
 }
 
+///////////////////////////////////////////
+// Time
+
+uint64_t platform_time_ns() {
+    static LARGE_INTEGER frequency = {};
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    uint64_t seconds   = counter.QuadPart / frequency.QuadPart;
+    uint64_t remainder = counter.QuadPart % frequency.QuadPart;
+    return seconds * 1000000000ULL + remainder * 1000000000ULL / frequency.QuadPart;
+}
+
 ///////////////////////////////////////////
 // Mutex/Synchronization
 
@@ -96,7 +114,42 @@ struct platform_process_data_t {
     HANDLE stdout_read;
 };
 
-platform_process_result_t platform_process_start(const char* command) {
+// Joins an argv array into a CreateProcess command line, quoting following
+// the rules CommandLineToArgvW uses to split it back up.
+static char* command_line_from_args(const char* const* args) {
+    size_t size = 1;
+    for (int32_t i = 0; args[i] != nullptr; i++)
+        size += strlen(args[i]) * 2 + 3;
+
+    char* result = (char*)malloc(size);
+    char* at     = result;
+    for (int32_t i = 0; args[i] != nullptr; i++) {
+        const char* arg = args[i];
+        if (i > 0) *at++ = ' ';
+        if (arg[0] != '\0' && strpbrk(arg, " \t\"") == nullptr) {
+            strcpy(at, arg);
+            at += strlen(arg);
+            continue;
+        }
+
+        *at++ = '"';
+        int32_t slashes = 0;
+        for (const char* c = arg; *c != '\0'; c++) {
+            if (*c == '\\') { slashes++; *at++ = '\\'; continue; }
+            if (*c == '"') {
+                for (int32_t s = 0; s < slashes + 1; s++) *at++ = '\\';
+            }
+            slashes = 0;
+            *at++ = *c;
+        }
+        for (int32_t s = 0; s < slashes; s++) *at++ = '\\';
+        *at++ = '"';
+    }
+    *at = '\0';
+    return result;
+}
+
+platform_process_result_t platform_process_start(const char* const* args) {
     platform_process_result_t result = {};
 
     platform_process_data_t* proc_data = (platform_process_data_t*)malloc(sizeof(platform_process_data_t));
@@ -120,7 +173,7 @@ platform_process_result_t platform_process_start(const char* command) {
     start_info.dwFlags |= STARTF_USESTDHANDLES;
 
     // CreateProcess requires non-const command string
-    char* cmd_copy = _strdup(command);
+    char* cmd_copy = command_line_from_args(args);
 
     BOOL success = CreateProcess(
         NULL,
@@ -215,6 +268,100 @@ void platform_pipe_close(platform_pipe_t pipe) {
     CloseHandle((HANDLE)pipe);
 }
 
+///////////////////////////////////////////
+// Sockets
+
+struct platform_socket_data_t {
+    SOCKET socket;
+};
+
+platform_socket_t platform_socket_connect(const char* host, uint16_t port) {
+    static bool wsa_started = false;
+    if (!wsa_started) {
+        WSADATA wsa_data;
+        if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) return nullptr;
+        wsa_started = true;
+    }
+
+    char port_str[8];
+    snprintf(port_str, sizeof(port_str), "%u", port);
+
+    addrinfo hints = {};
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    addrinfo* addrs = nullptr;
+    if (getaddrinfo(host, port_str, &hints, &addrs) != 0)
+        return nullptr;
+
+    SOCKET s = INVALID_SOCKET;
+    for (addrinfo* addr = addrs; addr != nullptr; addr = addr->ai_next) {
+        s = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+        if (s == INVALID_SOCKET) continue;
+        if (connect(s, addr->ai_addr, (int)addr->ai_addrlen) == 0) break;
+        closesocket(s);
+        s = INVALID_SOCKET;
+    }
+    freeaddrinfo(addrs);
+    if (s == INVALID_SOCKET) return nullptr;
+
+    // Requests are tiny, don't let Nagle sit on them
+    BOOL one = TRUE;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+
+    platform_socket_data_t* data = (platform_socket_data_t*)malloc(sizeof(platform_socket_data_t));
+    data->socket = s;
+    return data;
+}
+
+bool platform_socket_send(platform_socket_t socket, const void* data, int32_t size) {
+    if (socket == nullptr) return false;
+
+    SOCKET s = ((platform_socket_data_t*)socket)->socket;
+    int32_t sent = 0;
+    while (sent < size) {
+        int result = send(s, (const char*)data + sent, size - sent, 0);
+        if (result == SOCKET_ERROR) return false;
+        sent += result;
+    }
+    return true;
+}
+
+int32_t platform_socket_recv(platform_socket_t socket, void* buffer, int32_t buffer_size, int32_t timeout_ms) {
+    if (socket == nullptr) return -1;
+
+    SOCKET s = ((platform_socket_data_t*)socket)->socket;
+    WSAPOLLFD poll_fd = {};
+    poll_fd.fd     = s;
+    poll_fd.events = POLLRDNORM;
+    int ready = WSAPoll(&poll_fd, 1, timeout_ms);
+    if (ready == 0) return 0;
+    if (ready == SOCKET_ERROR) return -1;
+
+    int bytes_read = recv(s, (char*)buffer, buffer_size, 0);
+    if (bytes_read <= 0)
+        return -1; // Closed by the other end, or failed
+
+    return (int32_t)bytes_read;
+}
+
+int32_t platform_socket_peek(platform_socket_t socket) {
+    if (socket == nullptr) return -1;
+
+    u_long available = 0;
+    if (ioctlsocket(((platform_socket_data_t*)socket)->socket, FIONREAD, &available) != 0)
+        return 0;
+    return (int32_t)available;
+}
+
+void platform_socket_close(platform_socket_t socket) {
+    if (socket == nullptr) return;
+
+    platform_socket_data_t* data = (platform_socket_data_t*)socket;
+    closesocket(data->socket);
+    free(data);
+}
+
 ///////////////////////////////////////////
 // File dialogs
 
@@ -248,4 +395,94 @@ void platform_set_working_dir_to_exe() {
     }
 }
 
+///////////////////////////////////////////
+// Temp files
+
+platform_file_t platform_temp_file_create() {
+    char dir [MAX_PATH];
+    char path[MAX_PATH];
+    if (GetTempPathA(MAX_PATH, dir) == 0)                  return nullptr;
+    if (GetTempFileNameA(dir, "lpt", 0, path) == 0)        return nullptr;
+
+    // Delete on close covers crashes too, the handle closes with the process
+    HANDLE handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, CREATE_ALWAYS,
+                                FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        DeleteFileA(path);
+        return nullptr;
+    }
+    return handle;
+}
+
+bool platform_file_append(platform_file_t file, const void* data, int32_t size) {
+    if (file == nullptr) return false;
+
+    LARGE_INTEGER zero = {};
+    if (!SetFilePointerEx((HANDLE)file, zero, NULL, FILE_END)) return false;
+
+    const char* at = (const char*)data;
+    while (size > 0) {
+        DWORD written = 0;
+        if (!WriteFile((HANDLE)file, at, (DWORD)size, &written, NULL) || written == 0) return false;
+        at   += written;
+        size -= (int32_t)written;
+    }
+    return true;
+}
+
+bool platform_file_map(platform_file_t file, uint64_t offset, int32_t size, platform_map_t* out_map) {
+    *out_map = {};
+    if (file == nullptr) return false;
+
+    // Views have to start on the allocation granularity, usually 64kb
+    static uint64_t granularity = 0;
+    if (granularity == 0) {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        granularity = info.dwAllocationGranularity;
+    }
+    uint64_t start = offset - offset % granularity;
+    uint64_t len   = offset - start + size;
+
+    // The view keeps the mapping alive, so its handle can go right away
+    HANDLE mapping = CreateFileMappingA((HANDLE)file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) return false;
+    void* base = MapViewOfFile(mapping, FILE_MAP_READ, (DWORD)(start >> 32), (DWORD)(start & 0xFFFFFFFF), (SIZE_T)len);
+    CloseHandle(mapping);
+    if (base == NULL) return false;
+
+    out_map->base = base;
+    out_map->size = len;
+    out_map->data = (const char*)base + (offset - start);
+    return true;
+}
+
+void platform_file_unmap(platform_map_t* ref_map) {
+    if (ref_map->base != nullptr) UnmapViewOfFile(ref_map->base);
+    *ref_map = {};
+}
+
+void platform_file_prefetch(platform_file_t file, uint64_t offset, uint64_t size) {
+    // Faults on a mapped view already read in clusters of pages around
+    // them, and there's no cheaper way to ask without mapping it first
+}
+
+void platform_file_close(platform_file_t file) {
+    if (file == nullptr) return;
+    CloseHandle((HANDLE)file);
+}
+
+///////////////////////////////////////////
+
+bool platform_cache_path(char* path_buffer, int32_t buffer_size, const char* filename) {
+    char  dir[MAX_PATH];
+    DWORD len = GetEnvironmentVariableA("LOCALAPPDATA", dir, MAX_PATH);
+    if (len == 0 || len >= MAX_PATH) return false;
+
+    strncat(dir, "\\log-panther", sizeof(dir) - strlen(dir) - 1);
+    if (!CreateDirectoryA(dir, NULL) && GetLastError() != ERROR_ALREADY_EXISTS) return false;
+
+    return snprintf(path_buffer, buffer_size, "%s\\%s", dir, filename) < buffer_size;
+}
+
 #endif // PLATFORM_WINDOWS
@@ -0,0 +1,655 @@
+#include "query.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+
+///////////////////////////////////////////
+
+enum query_field_ {
+	query_field_text, // Also what a test without a field looks at
+	query_field_tag,
+	query_field_app,
+	query_field_pid,
+	query_field_tid,
+	query_field_level,
+	query_field_time,
+};
+
+enum query_node_ {
+	query_node_test,
+	query_node_and,
+	query_node_or,
+	query_node_not,
+};
+
+// The parsed query, before it's flattened into instructions
+struct query_node_t {
+	uint8_t      kind;  // query_node_
+	query_inst_t test;  // For query_node_test
+	int32_t      first; // First child, -1 if none
+	int32_t      next;  // Next sibling, -1 at the end
+	int32_t      cost;  // Roughly how long it takes on a line
+};
+
+struct query_parser_t {
+	const char            *at;
+	query_t               *query;
+	array_t<query_node_t>  nodes;
+	bool                   failed;
+};
+
+int32_t query_parse_or   (query_parser_t *ref_parser);
+int32_t query_parse_and  (query_parser_t *ref_parser);
+int32_t query_parse_not  (query_parser_t *ref_parser);
+int32_t query_parse_test (query_parser_t *ref_parser);
+bool    query_parse_value(query_parser_t *ref_parser, char *out_value, size_t value_size);
+bool    query_parse_time (const char *text, int64_t *out_ms);
+int32_t query_fail       (query_parser_t *ref_parser, const char *format, ...);
+bool    query_keyword    (query_parser_t *ref_parser, const char *word);
+void    query_skip_space (query_parser_t *ref_parser);
+int32_t query_node       (query_parser_t *ref_parser, uint8_t kind, int32_t cost);
+int32_t query_add_string (query_t *ref_query, const char *text);
+void    query_emit       (query_parser_t *ref_parser, int32_t node);
+
+bool    query_regex_here      (const char *regex, const char *text);
+int32_t query_regex_atom      (const char *regex);
+bool    query_regex_atom_match(const char *regex, char c);
+void    query_regex_literal   (const char *regex, char *out_literal, size_t literal_size);
+
+///////////////////////////////////////////
+
+int32_t query_fail(query_parser_t *ref_parser, const char *format, ...) {
+	if (!ref_parser->failed) {
+		va_list args;
+		va_start(args, format);
+		vsnprintf(ref_parser->query->error, sizeof(ref_parser->query->error), format, args);
+		va_end(args);
+	}
+	ref_parser->failed = true;
+	return -1;
+}
+
+///////////////////////////////////////////
+
+void query_skip_space(query_parser_t *ref_parser) {
+	while (isspace((uint8_t)*ref_parser->at)) ref_parser->at++;
+}
+
+///////////////////////////////////////////
+
+// Takes word if it's next in any case, and not just the start of a longer one
+bool query_keyword(query_parser_t *ref_parser, const char *word) {
+	size_t len = 0;
+	while (word[len] != '\0') {
+		if (tolower((uint8_t)ref_parser->at[len]) != word[len]) return false;
+		len++;
+	}
+	char after = ref_parser->at[len];
+	if (isalnum((uint8_t)word[0]) && (isalnum((uint8_t)after) || after == '_')) return false;
+	ref_parser->at += len;
+	return true;
+}
+
+///////////////////////////////////////////
+
+int32_t query_node(query_parser_t *ref_parser, uint8_t kind, int32_t cost) {
+	query_node_t node = {};
+	node.kind  = kind;
+	node.first = -1;
+	node.next  = -1;
+	node.cost  = cost;
+	return ref_parser->nodes.add(node);
+}
+
+///////////////////////////////////////////
+
+int32_t query_add_string(query_t *ref_query, const char *text) {
+	query_string_t string = {};
+	string.text = strdup(text);
+	return ref_query->strings.add(string);
+}
+
+///////////////////////////////////////////
+
+bool query_compile(query_t *ref_query, const char *text) {
+	query_free(ref_query);
+
+	query_parser_t parser = {};
+	parser.at    = text;
+	parser.query = ref_query;
+	query_skip_space(&parser);
+	if (*parser.at == '\0') return true;
+
+	int32_t root = query_parse_or(&parser);
+	query_skip_space(&parser);
+	if (!parser.failed && *parser.at != '\0')
+		query_fail(&parser, *parser.at == ')' ? "Unmatched )" : "Unexpected \"%.16s\"", parser.at);
+	if (!parser.failed)
+		query_emit(&parser, root);
+	parser.nodes.free();
+
+	if (parser.failed) {
+		char error[sizeof(ref_query->error)];
+		memcpy(error, ref_query->error, sizeof(error));
+		query_free(ref_query);
+		memcpy(ref_query->error, error, sizeof(error));
+		return false;
+	}
+	return true;
+}
+
+///////////////////////////////////////////
+
+int32_t query_parse_or(query_parser_t *ref_parser) {
+	int32_t first = query_parse_and(ref_parser);
+	query_skip_space(ref_parser);
+	if (ref_parser->failed || !(query_keyword(ref_parser, "or") || query_keyword(ref_parser, "||")))
+		return first;
+
+	int32_t result = query_node(ref_parser, query_node_or, 0);
+	int32_t last   = first;
+	ref_parser->nodes[result].first = first;
+	ref_parser->nodes[result].cost  = ref_parser->nodes[first].cost;
+	do {
+		int32_t next = query_parse_and(ref_parser);
+		if (ref_parser->failed) return -1;
+		ref_parser->nodes[last  ].next  = next;
+		ref_parser->nodes[result].cost += ref_parser->nodes[next].cost;
+		last = next;
+		query_skip_space(ref_parser);
+	} while (query_keyword(ref_parser, "or") || query_keyword(ref_parser, "||"));
+	return result;
+}
+
+///////////////////////////////////////////
+
+// Tests one after another are and-ed, with or without the "and"
+int32_t query_parse_and(query_parser_t *ref_parser) {
+	int32_t first = query_parse_not(ref_parser);
+	if (ref_parser->failed) return -1;
+
+	int32_t result = -1;
+	int32_t last   = first;
+	while (true) {
+		query_skip_space(ref_parser);
+		const char *before = ref_parser->at;
+		if (*ref_parser->at == '\0' || *ref_parser->at == ')' || query_keyword(ref_parser, "or") || query_keyword(ref_parser, "||")) {
+			ref_parser->at = before;
+			break;
+		}
+		if (!query_keyword(ref_parser, "and")) query_keyword(ref_parser, "&&");
+
+		int32_t next = query_parse_not(ref_parser);
+		if (ref_parser->failed) return -1;
+		if (result == -1) {
+			result = query_node(ref_parser, query_node_and, ref_parser->nodes[first].cost);
+			ref_parser->nodes[result].first = first;
+		}
+		ref_parser->nodes[last  ].next  = next;
+		ref_parser->nodes[result].cost += ref_parser->nodes[next].cost;
+		last = next;
+	}
+	return result == -1 ? first : result;
+}
+
+///////////////////////////////////////////
+
+int32_t query_parse_not(query_parser_t *ref_parser) {
+	query_skip_space(ref_parser);
+	if (!query_keyword(ref_parser, "not") && !(ref_parser->at[0] == '!' && ref_parser->at[1] != '=' && query_keyword(ref_parser, "!")))
+		return query_parse_test(ref_parser);
+
+	int32_t child = query_parse_not(ref_parser);
+	if (ref_parser->failed) return -1;
+	int32_t result = query_node(ref_parser, query_node_not, ref_parser->nodes[child].cost);
+	ref_parser->nodes[result].first = child;
+	return result;
+}
+
+///////////////////////////////////////////
+
+int32_t query_parse_test(query_parser_t *ref_parser) {
+	query_skip_space(ref_parser);
+	if (*ref_parser->at == '\0') return query_fail(ref_parser, "Expected a test at the end");
+	if (*ref_parser->at == ')')  return query_fail(ref_parser, "Expected a test before )");
+
+	if (*ref_parser->at == '(') {
+		ref_parser->at++;
+		int32_t result = query_parse_or(ref_parser);
+		query_skip_space(ref_parser);
+		if (ref_parser->failed) return -1;
+		if (*ref_parser->at != ')') return query_fail(ref_parser, "Missing )");
+		ref_parser->at++;
+		return result;
+	}
+
+	// A field and an operator, or it's just text to look for
+	const char *start    = ref_parser->at;
+	const char *fields[] = { "text", "tag", "app", "pid", "tid", "level", "time" };
+	int32_t     field    = -1;
+	for (int32_t i = 0; i < (int32_t)(sizeof(fields) / sizeof(fields[0])) && field == -1; i++)
+		if (query_keyword(ref_parser, fields[i])) field = i;
+	query_skip_space(ref_parser);
+	const char *ops[] = { "==", "!=", ">=", "<=", ":", "~", "=", ">", "<", "in" };
+	const char *op    = nullptr;
+	for (int32_t i = 0; i < (int32_t)(sizeof(ops) / sizeof(ops[0])) && field != -1 && op == nullptr; i++) {
+		if (strcmp(ops[i], "in") == 0 && field != query_field_time) continue;
+		if (query_keyword(ref_parser, ops[i])) op = ops[i];
+	}
+	if (op == nullptr) {
+		ref_parser->at = start;
+		field = query_field_text;
+		op    = ":";
+	}
+
+	query_skip_space(ref_parser);
+	bool    negate = strcmp(op, "!=") == 0;
+	int32_t result = query_node(ref_parser, query_node_test, 0);
+	query_inst_t &test = ref_parser->nodes[result].test;
+	char value[256];
+
+	if (strcmp(op, "in") == 0) {
+		// time in [from, to]
+		if (*ref_parser->at != '[') return query_fail(ref_parser, "Expected [ after time in");
+		ref_parser->at++;
+		char from[32], to[32];
+		int32_t read = 0;
+		if (sscanf(ref_parser->at, " %31[0-9:.] , %31[0-9:.] ]%n", from, to, &read) < 2 || read == 0)
+			return query_fail(ref_parser, "Expected time in [hh:mm:ss, hh:mm:ss]");
+		ref_parser->at += read;
+		test.op     = query_op_range;
+		test.column = query_column_time;
+		if (!query_parse_time(from, &test.low) || !query_parse_time(to, &test.high))
+			return query_fail(ref_parser, "Times look like hh:mm, hh:mm:ss or hh:mm:ss.mmm");
+		ref_parser->nodes[result].cost = 1;
+		return result;
+	}
+	if (!query_parse_value(ref_parser, value, sizeof(value))) return -1;
+
+	bool regex = strcmp(op, "~") == 0;
+	if (regex && field != query_field_text)
+		return query_fail(ref_parser, "Only text can match a regex");
+	if (field == query_field_text || field == query_field_tag || field == query_field_app) {
+		if (op[0] == '<' || op[0] == '>')
+			return query_fail(ref_parser, "%s can't be compared with %s", fields[field], op);
+		test.arg = query_add_string(ref_parser->query, value);
+		if (regex) {
+			int32_t open = 0;
+			for (const char *c = value; *c != '\0'; c++) {
+				if (*c == '\\' && c[1] != '\0') c++;
+				else if (*c == '[') open = 1;
+				else if (*c == ']') open = 0;
+			}
+			if (open) return query_fail(ref_parser, "Missing ] in regex");
+			char literal[256];
+			query_regex_literal(value, literal, sizeof(literal));
+			ref_parser->query->strings[test.arg].literal = strdup(literal);
+			test.op = query_op_regex;
+			ref_parser->nodes[result].cost = 20;
+		} else if (field == query_field_text) {
+			test.op = query_op_text;
+			ref_parser->nodes[result].cost = 10;
+		} else {
+			test.op = field == query_field_tag ? query_op_tag : query_op_app;
+			ref_parser->nodes[result].cost = 2;
+		}
+	} else {
+		int64_t number = 0;
+		test.op = query_op_range;
+		if (field == query_field_level) {
+			test.column = query_column_level;
+			number      = logcat_severity_level((uint8_t)toupper((uint8_t)value[0]));
+			if (number == 0) return query_fail(ref_parser, "Levels are V, D, I, W, E or F");
+		} else if (field == query_field_time) {
+			test.column = query_column_time;
+			if (!query_parse_time(value, &number))
+				return query_fail(ref_parser, "Times look like hh:mm, hh:mm:ss or hh:mm:ss.mmm");
+		} else {
+			test.column = field == query_field_pid ? query_column_pid : query_column_tid;
+			char *end;
+			number = strtoll(value, &end, 10);
+			if (*end != '\0') return query_fail(ref_parser, "%s needs a number", fields[field]);
+		}
+		test.low  = INT64_MIN;
+		test.high = INT64_MAX;
+		if      (strcmp(op, "<" ) == 0) test.high = number - 1;
+		else if (strcmp(op, "<=") == 0) test.high = number;
+		else if (strcmp(op, ">" ) == 0) test.low  = number + 1;
+		else if (strcmp(op, ">=") == 0) test.low  = number;
+		else { test.low = number; test.high = number; }
+		ref_parser->nodes[result].cost = 1;
+	}
+
+	if (!negate) return result;
+	int32_t not_node = query_node(ref_parser, query_node_not, ref_parser->nodes[result].cost);
+	ref_parser->nodes[not_node].first = result;
+	return not_node;
+}
+
+///////////////////////////////////////////
+
+// A quoted string, or everything up to a space or a )
+bool query_parse_value(query_parser_t *ref_parser, char *out_value, size_t value_size) {
+	size_t      len = 0;
+	const char *at  = ref_parser->at;
+	if (*at == '"') {
+		at++;
+		while (*at != '"') {
+			if (*at == '\0') { query_fail(ref_parser, "Missing closing \""); return false; }
+			if (*at == '\\' && at[1] == '"') at++;
+			if (len + 1 < value_size) out_value[len++] = *at;
+			at++;
+		}
+		at++;
+	} else {
+		while (*at != '\0' && !isspace((uint8_t)*at) && *at != ')') {
+			if (len + 1 < value_size) out_value[len++] = *at;
+			at++;
+		}
+	}
+	out_value[len]  = '\0';
+	ref_parser->at  = at;
+	if (len == 0) { query_fail(ref_parser, "Expected a value"); return false; }
+	return true;
+}
+
+///////////////////////////////////////////
+
+// hh:mm, hh:mm:ss or hh:mm:ss.mmm, to ms since midnight
+bool query_parse_time(const char *text, int64_t *out_ms) {
+	int32_t hour = 0, minute = 0, second = 0, millisecond = 0, read = 0;
+	if (sscanf(text, "%d:%d%n", &hour, &minute, &read) < 2) return false;
+	text += read;
+	if (*text == ':') {
+		if (sscanf(text, ":%d%n", &second, &read) < 1) return false;
+		text += read;
+		if (*text == '.') {
+			if (sscanf(text, ".%d%n", &millisecond, &read) < 1) return false;
+			text += read;
+		}
+	}
+	if (*text != '\0' || hour > 23 || minute > 59 || second > 59 || millisecond > 999) return false;
+	*out_ms = ((hour * 60ll + minute) * 60 + second) * 1000 + millisecond;
+	return true;
+}
+
+///////////////////////////////////////////
+
+// Flattens node into instructions. An and stops at its first false child,
+// an or at its first true one, and either tries its children cheapest
+// first.
+void query_emit(query_parser_t *ref_parser, int32_t node_idx) {
+	query_t           *query = ref_parser->query;
+	const query_node_t node  = ref_parser->nodes[node_idx];
+	if (node.kind == query_node_test) {
+		query->code.add(node.test);
+		return;
+	}
+	if (node.kind == query_node_not) {
+		query_emit(ref_parser, node.first);
+		query_inst_t inst = {};
+		inst.op = query_op_not;
+		query->code.add(inst);
+		return;
+	}
+
+	array_t<int32_t> children = {};
+	for (int32_t c = node.first; c != -1; c = ref_parser->nodes[c].next) {
+		int32_t at = children.count;
+		while (at > 0 && ref_parser->nodes[children[at - 1]].cost > ref_parser->nodes[c].cost) at--;
+		children.insert(at, c);
+	}
+	array_t<int32_t> jumps = {};
+	for (int32_t i = 0; i < children.count; i++) {
+		if (i > 0) {
+			query_inst_t jump = {};
+			jump.op = node.kind == query_node_and ? query_op_jump_false : query_op_jump_true;
+			jumps.add(query->code.add(jump));
+		}
+		query_emit(ref_parser, children[i]);
+	}
+	for (int32_t i = 0; i < jumps.count; i++)
+		query->code[jumps[i]].arg = query->code.count;
+	children.free();
+	jumps   .free();
+}
+
+///////////////////////////////////////////
+
+void query_bind(query_t *ref_query, const logcat_data_t *data) {
+	bool moved   = ref_query->lines_moved != data->lines_moved;
+	bool restart = moved || ref_query->names_moved != data->names_moved;
+	ref_query->lines_moved = data->lines_moved;
+	ref_query->names_moved = data->names_moved;
+	for (int32_t i = 0; i < ref_query->strings.count && moved; i++) {
+		bitmap_clear(&ref_query->strings[i].lines);
+		ref_query->strings[i].scanned = 0;
+	}
+	for (int32_t i = 0; i < ref_query->code.count; i++) {
+		const query_inst_t &inst = ref_query->code[i];
+		if (inst.op != query_op_tag && inst.op != query_op_app) continue;
+
+		const array_t<char*> &names  = inst.op == query_op_tag ? data->tags : data->names;
+		query_string_t       &string = ref_query->strings[inst.arg];
+		if (restart || string.matches.count > names.count) string.matches.clear();
+		for (int32_t n = string.matches.count; n < names.count; n++)
+			string.matches.add(strstr(names[n], string.text) != nullptr);
+	}
+}
+
+///////////////////////////////////////////
+
+void query_scan(query_t *ref_query, logcat_data_t *ref_data, int64_t to) {
+	for (int32_t i = 0; i < ref_query->code.count; i++) {
+		const query_inst_t &inst = ref_query->code[i];
+		if (inst.op != query_op_text && inst.op != query_op_regex) continue;
+
+		query_string_t &string = ref_query->strings[inst.arg];
+		for (int64_t l = string.scanned; l < to; l++) {
+			const char *text = logcat_line_text(ref_data, &ref_data->lines[l]);
+			bool        match = inst.op == query_op_text
+				? strstr(text, string.text) != nullptr
+				: strstr(text, string.literal) != nullptr && query_regex_match(string.text, text);
+			if (match) bitmap_add(&string.lines, l);
+		}
+		if (string.scanned < to) string.scanned = to;
+	}
+}
+
+///////////////////////////////////////////
+
+int64_t query_scanned(const query_t *query) {
+	int64_t result = INT64_MAX;
+	for (int32_t i = 0; i < query->code.count; i++) {
+		const query_inst_t &inst = query->code[i];
+		if ((inst.op == query_op_text || inst.op == query_op_regex) && query->strings[inst.arg].scanned < result)
+			result = query->strings[inst.arg].scanned;
+	}
+	return result;
+}
+
+///////////////////////////////////////////
+
+bool query_eval(const query_t *query, const logcat_data_t *data, int64_t line_idx) {
+	const logcat_line_t *line   = &data->lines[line_idx];
+	bool                 result = true;
+	for (int32_t pc = 0; pc < query->code.count; pc++) {
+		const query_inst_t &inst = query->code[pc];
+		switch (inst.op) {
+		case query_op_range: {
+			int64_t value = 0;
+			switch (inst.column) {
+			case query_column_level: value = logcat_severity_level(line->severity); break;
+			case query_column_pid:   value = line->pid; break;
+			case query_column_tid:   value = line->tid; break;
+			case query_column_time:  value = ((line->hour * 60ll + line->minute) * 60 + line->second) * 1000 + line->millisecond; break;
+			}
+			result = value >= inst.low && value <= inst.high;
+		} break;
+		case query_op_tag: {
+			const array_t<bool> &matches = query->strings[inst.arg].matches;
+			result = line->tag < matches.count && matches[line->tag];
+		} break;
+		case query_op_app: {
+			const array_t<bool> &matches = query->strings[inst.arg].matches;
+			uint16_t             app     = data->pid_names != nullptr ? data->pid_names[line->pid] : 0;
+			result = app < matches.count && matches[app];
+		} break;
+		case query_op_text:
+		case query_op_regex:
+			result = bitmap_has(&query->strings[inst.arg].lines, line_idx);
+			break;
+		case query_op_not:        result = !result; break;
+		case query_op_jump_false: if (!result) pc = inst.arg - 1; break;
+		case query_op_jump_true:  if ( result) pc = inst.arg - 1; break;
+		}
+	}
+	return result;
+}
+
+///////////////////////////////////////////
+
+void query_free(query_t *ref_query) {
+	for (int32_t i = 0; i < ref_query->strings.count; i++) {
+		free(ref_query->strings[i].text);
+		free(ref_query->strings[i].literal);
+		ref_query->strings[i].matches.free();
+		bitmap_free(&ref_query->strings[i].lines);
+	}
+	ref_query->strings.free();
+	ref_query->code   .free();
+	*ref_query = {};
+}
+
+///////////////////////////////////////////
+
+// How many characters of regex the next single character test takes up
+int32_t query_regex_atom(const char *regex) {
+	if (regex[0] == '\\' && regex[1] != '\0') return 2;
+	if (regex[0] != '[') return 1;
+
+	const char *at = regex + 1;
+	if (*at == '^') at++;
+	if (*at == ']') at++;
+	while (*at != '\0' && *at != ']') {
+		if (*at == '\\' && at[1] != '\0') at++;
+		at++;
+	}
+	return *at == ']' ? (int32_t)(at - regex) + 1 : 1;
+}
+
+///////////////////////////////////////////
+
+bool query_regex_atom_match(const char *regex, char c) {
+	switch (regex[0]) {
+	case '.': return true;
+	case '\\':
+		switch (regex[1]) {
+		case 'd': return  isdigit((uint8_t)c);
+		case 'D': return !isdigit((uint8_t)c);
+		case 'w': return  isalnum((uint8_t)c) || c == '_';
+		case 'W': return !isalnum((uint8_t)c) && c != '_';
+		case 's': return  isspace((uint8_t)c);
+		case 'S': return !isspace((uint8_t)c);
+		default:  return c == regex[1];
+		}
+	case '[': {
+		int32_t size = query_regex_atom(regex);
+		if (size == 1) return c == '[';
+
+		const char *at     = regex + 1;
+		const char *end    = regex + size - 1;
+		bool        negate = *at == '^';
+		if (negate) at++;
+		bool found = false;
+		for (bool first = true; at < end; first = false) {
+			if (*at == '\\' && at + 1 < end) {
+				char escaped[3] = { '\\', at[1], '\0' };
+				found = found || query_regex_atom_match(escaped, c);
+				at += 2;
+			} else if (at + 2 < end && at[1] == '-') {
+				found = found || (c >= at[0] && c <= at[2]);
+				at += 3;
+			} else {
+				found = found || c == *at || (first && *at == ']' && c == ']');
+				at += 1;
+			}
+		}
+		return found != negate;
+	}
+	default: return c == regex[0];
+	}
+}
+
+///////////////////////////////////////////
+
+bool query_regex_here(const char *regex, const char *text) {
+	while (true) {
+		if (regex[0] == '\0') return true;
+		if (regex[0] == '$' && regex[1] == '\0') return *text == '\0';
+
+		int32_t atom  = query_regex_atom(regex);
+		char    quant = regex[atom];
+		if (quant == '*' || quant == '+' || quant == '?') {
+			// As many as will match, backing off one at a time
+			int32_t most  = quant == '?' ? 1 : INT32_MAX;
+			int32_t least = quant == '+' ? 1 : 0;
+			int32_t count = 0;
+			while (count < most && text[count] != '\0' && query_regex_atom_match(regex, text[count])) count++;
+			for (; count >= least; count--)
+				if (query_regex_here(regex + atom + 1, text + count)) return true;
+			return false;
+		}
+		if (*text == '\0' || !query_regex_atom_match(regex, *text)) return false;
+		regex += atom;
+		text  += 1;
+	}
+}
+
+///////////////////////////////////////////
+
+bool query_regex_match(const char *regex, const char *text) {
+	if (regex[0] == '^') return query_regex_here(regex + 1, text);
+	do {
+		if (query_regex_here(regex, text)) return true;
+	} while (*text++ != '\0');
+	return false;
+}
+
+///////////////////////////////////////////
+
+// The longest run of plain characters every match has to have, so lines
+// without it can be skipped with a strstr
+void query_regex_literal(const char *regex, char *out_literal, size_t literal_size) {
+	char    run[256];
+	size_t  run_len  = 0;
+	size_t  best_len = 0;
+	out_literal[0] = '\0';
+	if (regex[0] == '^') regex++;
+	while (true) {
+		int32_t atom  = *regex != '\0' ? query_regex_atom(regex) : 0;
+		char    quant = *regex != '\0' ? regex[atom] : '\0';
+		char    plain = '\0';
+		if      (atom == 1 && strchr(".[$*+?", regex[0]) == nullptr) plain = regex[0];
+		else if (atom == 2 && regex[0] == '\\' && strchr("dDwWsS", regex[1]) == nullptr) plain = regex[1];
+		else if (atom == 1 && regex[0] == '[') plain = '[';
+
+		bool optional = quant == '*' || quant == '?';
+		if (plain != '\0' && !optional && run_len + 1 < sizeof(run))
+			run[run_len++] = plain;
+		// A repeat or anything that isn't plain ends the run
+		if (plain == '\0' || optional || quant == '+' || *regex == '\0') {
+			if (run_len > best_len && run_len < literal_size) {
+				memcpy(out_literal, run, run_len);
+				out_literal[run_len] = '\0';
+				best_len = run_len;
+			}
+			run_len = 0;
+		}
+		if (*regex == '\0') break;
+		regex += atom + (quant == '*' || quant == '+' || quant == '?' ? 1 : 0);
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+// Filter queries, like
+//
+//	level>=W and (tag:ActivityManager or text~"fail.*code [0-9]+") and not pid:1234
+//
+// compiled to a short list of instructions that tests one line at a time.
+// A query is predicates joined with and, or, not (also &&, ||, !) and
+// parentheses, and predicates next to each other are and-ed together:
+//
+//	tag:Name           the tag has Name in it
+//	app:Name           the process name has Name in it
+//	text:word, word,   the text has word in it, quotes for spaces
+//	"some words"
+//	text~regex         the text matches regex, see query_regex_match
+//	pid:N, tid:N       also with =, !=, <, <=, >, >=
+//	level>=W           V D I W E F, with the same comparisons as pid
+//	time in [10:00, 10:05:30.250]   time of day, also time>=10:00 and so on
+//
+// Both sides of an and or an or are sorted by how much they cost, so the
+// number compares run first, the tag and app lookups next, and the text
+// tests last. Those unpack the text, so rather than run per frame they each
+// keep a bitmap of the lines they match, filled in by query_scan.
+
+#include <stdint.h>
+
+#include "array.h"
+#include "bitmap.h"
+#include "logdata.h"
+
+///////////////////////////////////////////
+
+enum query_op_ {
+	query_op_range,      // Is a number from the line in [low, high]
+	query_op_tag,        // Looks up the line's tag in a table of matches
+	query_op_app,        // Same, for the process name
+	query_op_text,       // Substring of the text
+	query_op_regex,      // Regex on the text
+	query_op_not,
+	query_op_jump_false, // Skips to target when the result so far is false
+	query_op_jump_true,
+};
+
+enum query_column_ {
+	query_column_level, // See logcat_severity_level
+	query_column_pid,
+	query_column_tid,
+	query_column_time,  // Time of day in ms
+};
+
+struct query_inst_t {
+	uint8_t op;     // query_op_
+	uint8_t column; // query_column_, for query_op_range
+	int32_t arg;    // Jump target, or index into query_t::strings
+	int64_t low;
+	int64_t high;
+};
+
+// Text a tag, app, text or regex test uses. Tag and app tests find out
+// which names match up front, in query_bind, and text and regex tests which
+// lines do, in query_scan.
+struct query_string_t {
+	char          *text;
+	char          *literal; // For regex, text the line has to have for it to match at all
+	array_t<bool>  matches; // By logcat.tags or logcat.names index
+	bitmap_t       lines;   // Lines the text or regex matched, of the first scanned
+	int64_t        scanned;
+};
+
+struct query_t {
+	array_t<query_inst_t>   code;
+	array_t<query_string_t> strings;
+	int32_t                 lines_moved; // logcat.lines_moved when the names were matched and lines scanned, tags go on clear
+	int32_t                 names_moved; // Same for logcat.names_moved
+	char                    error[128];  // Why it didn't compile
+};
+
+// Replaces what's in ref_query. An empty query has no code and matches
+// everything, false means it didn't parse and error says why.
+bool    query_compile(query_t *ref_query, const char *text);
+// Catches the tag and app tests up with names that are new since the last
+// call, and starts the text scans over when the lines have moved. Expects
+// the lines mutex to be held.
+void    query_bind   (query_t *ref_query, const logcat_data_t *data);
+// Runs the text and regex tests on the lines up to to that they haven't
+// seen yet. Expects the lines mutex to be held, and query_bind to be
+// caught up.
+void    query_scan   (query_t *ref_query, logcat_data_t *ref_data, int64_t to);
+// Lines the slowest text or regex test has seen, INT64_MAX without any
+int64_t query_scanned(const query_t *query);
+// Text and regex tests fail on lines query_scan hasn't got to yet. Expects
+// the lines mutex to be held, and query_bind to be caught up.
+bool    query_eval   (const query_t *query, const logcat_data_t *data, int64_t line);
+void    query_free   (query_t *ref_query);
+
+// Regex with . [] [^] ^ $ * + ? and \d \w \s, anywhere in text. No
+// alternation or groups, an or in the query does that.
+bool query_regex_match(const char *regex, const char *text);
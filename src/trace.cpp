@@ -0,0 +1,124 @@
+#include "trace.h"
+
+#ifdef LOGPANTHER_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+///////////////////////////////////////////
+
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE (1 << 18)
+#endif
+
+struct trace_event_t {
+	const char *name;
+	uint64_t    start_ns;
+	uint64_t    end_ns;
+};
+
+// Each thread records into its own ring, so recording never takes a lock.
+// Only the owning thread writes, and it publishes events by bumping head.
+// Rings are never freed, a ring from a thread that exited gets reused by
+// the next new thread.
+struct trace_ring_t {
+	trace_event_t         events[TRACE_RING_SIZE];
+	std::atomic<uint64_t> head;
+	std::atomic<bool>     in_use;
+	int32_t               thread_id;
+	char                  thread_name[32];
+	trace_ring_t         *next;
+};
+
+std::atomic<trace_ring_t*> trace_rings     = nullptr;
+std::atomic<int32_t>       trace_thread_id = 0;
+
+///////////////////////////////////////////
+
+trace_ring_t *trace_ring_acquire() {
+	for (trace_ring_t *ring = trace_rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next) {
+		bool expected = false;
+		if (ring->in_use.compare_exchange_strong(expected, true)) {
+			ring->thread_name[0] = '\0';
+			return ring;
+		}
+	}
+
+	trace_ring_t *ring = (trace_ring_t*)calloc(1, sizeof(trace_ring_t));
+	ring->in_use    = true;
+	ring->thread_id = trace_thread_id.fetch_add(1) + 1;
+	ring->next      = trace_rings.load(std::memory_order_relaxed);
+	while (!trace_rings.compare_exchange_weak(ring->next, ring, std::memory_order_release)) {}
+	return ring;
+}
+
+// Hands the ring back when its thread exits
+struct trace_ring_owner_t {
+	trace_ring_t *ring;
+	~trace_ring_owner_t() { if (ring != nullptr) ring->in_use.store(false); }
+};
+thread_local trace_ring_owner_t trace_ring_owner = {};
+
+///////////////////////////////////////////
+
+inline trace_ring_t *trace_ring() {
+	if (trace_ring_owner.ring == nullptr)
+		trace_ring_owner.ring = trace_ring_acquire();
+	return trace_ring_owner.ring;
+}
+
+///////////////////////////////////////////
+
+void trace_record(const char *name, uint64_t start_ns, uint64_t end_ns) {
+	trace_ring_t *ring = trace_ring();
+	uint64_t      head = ring->head.load(std::memory_order_relaxed);
+
+	trace_event_t *evt = &ring->events[head % TRACE_RING_SIZE];
+	evt->name     = name;
+	evt->start_ns = start_ns;
+	evt->end_ns   = end_ns;
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+///////////////////////////////////////////
+
+void trace_thread_name(const char *name) {
+	trace_ring_t *ring = trace_ring();
+	strncpy(ring->thread_name, name, sizeof(ring->thread_name) - 1);
+}
+
+///////////////////////////////////////////
+
+bool trace_save(const char *filename) {
+	FILE *fp = fopen(filename, "w");
+	if (fp == nullptr) return false;
+
+	fprintf(fp, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (trace_ring_t *ring = trace_rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next) {
+		if (ring->thread_name[0] != '\0') {
+			fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", ring->thread_id, ring->thread_name);
+			first = false;
+		}
+
+		// The owning thread keeps writing while we read. Skip the oldest
+		// part of the ring, and afterwards drop anything it overwrote.
+		uint64_t head  = ring->head.load(std::memory_order_acquire);
+		uint64_t start = head > TRACE_RING_SIZE - 1024 ? head - (TRACE_RING_SIZE - 1024) : 0;
+		for (uint64_t i = start; i < head; i++) {
+			trace_event_t evt = ring->events[i % TRACE_RING_SIZE];
+			if (ring->head.load(std::memory_order_acquire) >= i + TRACE_RING_SIZE) continue;
+
+			fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",\n",
+				evt.name, ring->thread_id, evt.start_ns / 1000.0, (evt.end_ns - evt.start_ns) / 1000.0);
+			first = false;
+		}
+	}
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+	return true;
+}
+
+#endif // LOGPANTHER_TRACE
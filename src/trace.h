@@ -0,0 +1,42 @@
+#pragma once
+
+// Scoped timing zones that can be saved as a chrome://tracing (or Perfetto)
+// JSON file. Build with LOGPANTHER_TRACE defined to turn them on, otherwise
+// the macros compile to nothing.
+//
+//	void do_work() {
+//		TRACE_ZONE("do_work");
+//		...
+//	}
+
+#include <stdint.h>
+
+#include "platform.h"
+
+///////////////////////////////////////////
+
+#ifdef LOGPANTHER_TRACE
+
+void trace_record     (const char *name, uint64_t start_ns, uint64_t end_ns);
+void trace_thread_name(const char *name);
+bool trace_save       (const char *filename);
+
+struct trace_zone_t {
+	const char *name;
+	uint64_t    start_ns;
+
+	trace_zone_t (const char *zone_name) { name = zone_name; start_ns = platform_time_ns(); }
+	~trace_zone_t()                      { trace_record(name, start_ns, platform_time_ns()); }
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b)  TRACE_CONCAT_(a, b)
+#define TRACE_ZONE(name)    trace_zone_t TRACE_CONCAT(trace_zone_, __LINE__)(name)
+#define TRACE_THREAD(name)  trace_thread_name(name)
+
+#else
+
+#define TRACE_ZONE(name)
+#define TRACE_THREAD(name)
+
+#endif
@@ -0,0 +1,110 @@
+/* backfill-check
+
+	Attaches to a device the way log-panther does, waits for the history
+	from before it attached to be merged in, and checks those lines made it
+	into every index: their buffer's and level's lists, so hiding a buffer
+	or stepping with F7 still reaches them, and their pid's and tid's. Events
+	also need their fields decoded once the layouts are in. Meant to run
+	against fake-adb's stand-in server:
+
+		ANDROID_ADB_SERVER_PORT=5038 ./fake-adb start-server
+		ANDROID_ADB_SERVER_PORT=5038 ./backfill-check [serial]
+
+	Exits with 1 if anything is missing.
+*/
+
+#include <stdio.h>
+
+#include "../src/logdata.h"
+
+///////////////////////////////////////////
+
+// Lines of data that list doesn't have, where kind is what the lines
+// should share with it
+template <int32_t bits>
+int64_t check_list(const logcat_data_t *data, const block_array_t<int64_t, bits> *list, int64_t *ref_seen, bool (*belongs)(const logcat_line_t *, int32_t), int32_t kind) {
+	int64_t bad = 0;
+	for (int64_t a = 0; a < list->count; a++) {
+		int64_t i = (*list)[a] - data->line_base;
+		if (i < 0 || i >= data->lines.count || !belongs(&data->lines[i], kind) || (a > 0 && (*list)[a] <= (*list)[a - 1])) bad++;
+	}
+	*ref_seen += list->count;
+	return bad;
+}
+
+bool in_buffer(const logcat_line_t *line, int32_t buffer) { return line->buffer == buffer; }
+bool in_level (const logcat_line_t *line, int32_t level)  { return logcat_severity_level(line->severity) == level; }
+bool in_pid   (const logcat_line_t *line, int32_t pid)    { return line->pid == pid; }
+bool in_tid   (const logcat_line_t *line, int32_t tid)    { return line->tid == tid; }
+
+///////////////////////////////////////////
+
+int main(int argc, char **argv) {
+	logcat_data_t   data   = {};
+	logcat_thread_t thread = {};
+	logcat_create(&data);
+	if (logcat_thread_start(argc > 1 ? argv[1] : "", &thread, &data) < 0) {
+		printf("Couldn't start logcat\n");
+		return 1;
+	}
+	while (thread.backfilling)
+		platform_sleep_ms(10);
+	// The event layouts come in on the names thread
+	platform_sleep_ms(500);
+	logcat_thread_end(&thread);
+
+	int64_t lines = data.lines.count;
+	int64_t bad   = 0;
+	int64_t buffer_seen = 0, level_seen = 0, pid_seen = 0, tid_seen = 0;
+	for (int32_t b = 0; b < logcat_buffer_count; b++)
+		bad += check_list(&data, &data.buffer_lines[b], &buffer_seen, in_buffer, b);
+	for (int32_t l = 0; l < logcat_level_count; l++)
+		bad += check_list(&data, &data.level_lines[l], &level_seen, in_level, l);
+	for (int32_t id = 0; id <= UINT16_MAX && data.pid_lines != nullptr; id++) {
+		bad += check_list(&data, &data.pid_lines[id], &pid_seen, in_pid, id);
+		bad += check_list(&data, &data.tid_lines[id], &tid_seen, in_tid, id);
+	}
+	printf("%lld lines, %lld of them history. Indexed by buffer %lld, level %lld, pid %lld, tid %lld\n",
+		(long long)lines, (long long)data.prepended, (long long)buffer_seen, (long long)level_seen, (long long)pid_seen, (long long)tid_seen);
+	if (buffer_seen != lines || level_seen != lines || pid_seen != lines || tid_seen != lines) bad++;
+
+	// F7 from the top has to land on the first warning, history or not
+	int64_t first_warning = -1;
+	for (int64_t i = 0; i < lines && first_warning < 0; i++)
+		if (logcat_severity_level(data.lines[i].severity) >= 4) first_warning = i;
+	int64_t jump = logcat_level_next(&data, 4, -1, 1);
+	printf("First warning at %lld, F7 lands on %lld\n", (long long)first_warning, (long long)jump);
+	if (jump != first_warning) bad++;
+
+	// Every event with a layout gets fields, history included. Whether a
+	// tag has one shows in any of its lines having fields.
+	array_t<bool> tag_decoded = {};
+	for (int32_t t = 0; t < data.tags.count; t++)
+		tag_decoded.add(false);
+	for (int64_t i = 0; i < lines; i++) {
+		const logcat_field_t *fields;
+		if (data.lines[i].buffer == logcat_buffer_events && logcat_line_fields(&data, i, &fields) > 0)
+			tag_decoded[data.lines[i].tag] = true;
+	}
+	int64_t events = 0, history_events = 0, missing = 0, history_missing = 0;
+	for (int64_t i = 0; i < lines; i++) {
+		const logcat_line_t &line = data.lines[i];
+		if (line.buffer != logcat_buffer_events || !tag_decoded[line.tag]) continue;
+		const logcat_field_t *fields;
+		bool has = logcat_line_fields(&data, i, &fields) > 0;
+		events  += 1;
+		missing += !has;
+		if (i < data.prepended) {
+			history_events  += 1;
+			history_missing += !has;
+		}
+	}
+	tag_decoded.free();
+	printf("%lld events have layouts, %lld of them from history. Without fields: %lld, %lld from history\n",
+		(long long)events, (long long)history_events, (long long)missing, (long long)history_missing);
+	if (missing > 0) bad++;
+
+	logcat_destroy(&data);
+	printf(bad == 0 ? "OK\n" : "FAILED\n");
+	return bad == 0 ? 0 : 1;
+}
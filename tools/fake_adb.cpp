@@ -0,0 +1,1026 @@
+/* fake-adb
+
+	A stand-in for the adb executable that synthesizes logcat output, so
+	log-panther's ingest path can be load tested without any hardware. Point
+	log-panther at it with:
+
+		LOGPANTHER_ADB=/path/to/fake-adb ./log-panther
+
+	The fake device's log is a pure function of time: line k is always logged
+	at the same moment with the same pid, tag and text, and ends with " #k".
+	Separate invocations (live tail, `-d` dumps, `-T` resumes) therefore agree
+	with each other, and any gap in the #k sequence seen by the reader is a
+	dropped line. Timestamps are the wall clock time the line was generated,
+	so "now - line time" on the reader side is ingest latency.
+
+	Generator settings come from environment variables:
+
+		FAKE_ADB_RATE            lines/sec outside of bursts       (1000)
+		FAKE_ADB_BURST_RATE      lines/sec during a burst          (0, off)
+		FAKE_ADB_BURST_MS        length of each burst              (200)
+		FAKE_ADB_BURST_PERIOD_MS time between burst starts         (5000)
+		FAKE_ADB_TAGS            tag cardinality                   (64)
+		FAKE_ADB_PIDS            concurrently running processes    (16)
+		FAKE_ADB_CHURN           process restarts/sec, all pids    (0.2)
+		FAKE_ADB_LEN             mean message length, exponential  (80)
+		FAKE_ADB_LEN_MAX         longest message length            (1000)
+		FAKE_ADB_HISTORY         lines in the device ring buffer   (10000)
+		FAKE_ADB_LINES           exit after this many lines        (0, never)
+		FAKE_ADB_DEVICES         number of fake devices            (1)
+		FAKE_ADB_HOTPLUG_MS      unplug/replug the last device this often (0, off)
+		FAKE_ADB_SEED            changes tag names and message text (0)
+
+	Supported commands:
+
+		fake-adb devices [-l]
+		fake-adb track-devices [-l]
+		fake-adb [-s serial] logcat [-b buffer[,buffer]|all] [-D] [-d] [-B] [-T count|'MM-DD hh:mm:ss.mmm'] [--pid=N] [TAG:V ... *:S]
+		fake-adb [-s serial] logcat -g
+		fake-adb [-s serial] shell pm list packages
+		fake-adb [-s serial] shell ps -A -T -o PID,TID,NAME,CMD
+		fake-adb [-s serial] shell cat /system/etc/event-log-tags
+		fake-adb [-s serial] shell pidof <package>
+		fake-adb [-s serial] shell monkey -p <package> ...
+		fake-adb start-server | kill-server | version
+		fake-adb server
+
+	`server` runs a stand-in adb server in the foreground, speaking the host
+	protocol on port ANDROID_ADB_SERVER_PORT (5037), and `start-server` starts
+	one in the background if nothing is listening there yet. log-panther talks
+	to it the same as a real adb server:
+
+		ANDROID_ADB_SERVER_PORT=5038 LOGPANTHER_ADB=/path/to/fake-adb ./log-panther
+
+	It handles host:version, host:devices[-l], host:track-devices[-l],
+	host:kill, and
+	host:transport[-any] followed by shell:<command> for any of the shell
+	commands above. Each connection is served by its own forked process, and
+	the generator settings are the ones the server was started with.
+
+	Lines are spread over the main, system, radio, events and crash buffers.
+	Events buffer lines are a few real events, printed the way logcat prints
+	them, "[field,field,...]", and laid out as the device's event-log-tags
+	says.
+	Like logcat, only main, system and crash are read without -b, so the #k
+	sequence only has no gaps with -b all. Reading more than one buffer
+	prints logcat's "beginning of" banners, and -D its "switch to" ones.
+
+	When the reader can't keep up and falls more than FAKE_ADB_HISTORY lines
+	behind, the oldest unread lines are skipped, the same as a device's ring
+	buffer overflowing.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/prctl.h>
+
+///////////////////////////////////////////
+
+struct fake_config_t {
+	double   rate;
+	double   burst_rate;
+	double   burst_ms;
+	double   burst_period_ms;
+	int32_t  tags;
+	int32_t  pids;
+	double   churn;
+	double   len_mean;
+	int32_t  len_max;
+	int64_t  history;
+	int64_t  lines;
+	int32_t  devices;
+	double   hotplug_ms;
+	uint64_t seed;
+};
+
+// logcat's log ids, in its order
+enum fake_buffer_ {
+	fake_buffer_main,
+	fake_buffer_radio,
+	fake_buffer_events,
+	fake_buffer_system,
+	fake_buffer_crash,
+	fake_buffer_stats,
+	fake_buffer_security,
+	fake_buffer_kernel,
+	fake_buffer_count,
+};
+const char *buffer_names[fake_buffer_count] = { "main", "radio", "events", "system", "crash", "stats", "security", "kernel" };
+
+// The part of /system/etc/event-log-tags for the events we log
+const char *event_log_tags =
+	"# The entries in this file map a sparse set of log tag numbers to tag names.\n"
+	"2718 e\n"
+	"20003 dvm_lock_sample (process|3),(main|1|5),(thread|3),(time|1|3),(file|3),(line|1|5),(ownerfile|3),(ownerline|1|5),(sample_percent|1|6)\n"
+	"2722 battery_level (level|1|6),(voltage|1|1),(temperature|1|1)\n"
+	"30014 am_proc_start (User|1|5),(PID|1|5),(UID|1|5),(Process Name|3),(Type|3),(Component|3)\n"
+	"52004 binder_sample (descriptor|3),(method_num|1|5),(time|1|3),(blocking_package|3),(sample_percent|1|6)\n";
+
+struct fake_line_t {
+	double      time_ms;
+	int32_t     buffer;
+	int32_t     pid;
+	int32_t     tid;
+	char        severity;
+	const char *tag;
+	char        text[4096];
+	int32_t     text_len;
+};
+
+///////////////////////////////////////////
+
+fake_config_t config    = {};
+int32_t       serving   = 0; // Device a server connection is for, 1 based
+char          text_pool[1 << 16];
+char        (*tag_names)[64];
+int32_t       out_pos   = 0;
+char          out_buffer[1 << 16];
+
+///////////////////////////////////////////
+
+double   env_number (const char *name, double default_value);
+void     fake_setup ();
+uint64_t hash_u64   (uint64_t x);
+double   lines_at   (double time_ms);
+double   line_time  (int64_t k);
+int32_t  slot_pid   (int32_t slot, double time_ms);
+void     line_make  (int64_t k, fake_line_t *out_line);
+void     out_write  (const void *data, int32_t size);
+void     out_flush  ();
+void     out_line   (const fake_line_t *line, bool binary);
+double   now_ms     ();
+void     sleep_ms   (double ms);
+int32_t  devices_now ();
+int32_t  devices_text(bool long_format, char *out_text, int32_t text_size);
+int      cmd_track_devices(int fd, bool long_format);
+int      cmd_devices(bool long_format);
+int      cmd_logcat (int argc, char **argv);
+int      cmd_shell  (int argc, char **argv);
+int32_t  split_command(char *command, char **out_argv, int32_t max_args);
+int32_t  server_port();
+int      cmd_server (bool background);
+int      cmd_kill_server();
+void     server_connection(int fd);
+
+///////////////////////////////////////////
+
+int main(int argc, char **argv) {
+	signal(SIGPIPE, SIG_IGN);
+	fake_setup();
+
+	// Skip over adb's global options, only -s matters to us
+	int32_t at = 1;
+	while (at < argc && argv[at][0] == '-') {
+		if (strcmp(argv[at], "-s") == 0 && at + 1 < argc) sscanf(argv[at + 1], "FAKE%d", &serving);
+		if (strcmp(argv[at], "-s") == 0 || strcmp(argv[at], "-t") == 0 ||
+		    strcmp(argv[at], "-H") == 0 || strcmp(argv[at], "-P") == 0) at += 2;
+		else at += 1;
+	}
+	if (at >= argc) {
+		fprintf(stderr, "fake-adb: no command\n");
+		return 1;
+	}
+
+	const char *cmd = argv[at];
+	if ((strcmp(cmd, "logcat") == 0 || strcmp(cmd, "shell") == 0) && serving > devices_now()) {
+		fprintf(stderr, "adb: device 'FAKE%04d' not found\n", serving);
+		return 1;
+	}
+	if      (strcmp(cmd, "devices") == 0) return cmd_devices(at + 1 < argc && strcmp(argv[at + 1], "-l") == 0);
+	else if (strcmp(cmd, "track-devices") == 0) return cmd_track_devices(STDOUT_FILENO, at + 1 < argc && strcmp(argv[at + 1], "-l") == 0);
+	else if (strcmp(cmd, "logcat" ) == 0) return cmd_logcat (argc - at - 1, argv + at + 1);
+	else if (strcmp(cmd, "shell"  ) == 0) {
+		// adb passes a single argument to the device's shell as is, so it
+		// may be a whole quoted command
+		if (argc - at - 1 == 1) {
+			char *shell_argv[64];
+			int32_t shell_argc = split_command(argv[at + 1], shell_argv, 64);
+			return cmd_shell(shell_argc, shell_argv);
+		}
+		return cmd_shell(argc - at - 1, argv + at + 1);
+	}
+	else if (strcmp(cmd, "server"      ) == 0) return cmd_server(false);
+	else if (strcmp(cmd, "start-server") == 0) return cmd_server(true);
+	else if (strcmp(cmd, "kill-server" ) == 0) return cmd_kill_server();
+	else if (strcmp(cmd, "version") == 0) {
+		printf("Android Debug Bridge version 1.0.41\nfake-adb for log-panther load testing\n");
+		return 0;
+	}
+
+	fprintf(stderr, "fake-adb: unknown command %s\n", cmd);
+	return 1;
+}
+
+///////////////////////////////////////////
+
+double env_number(const char *name, double default_value) {
+	const char *value = getenv(name);
+	if (value == nullptr || value[0] == '\0') return default_value;
+	return atof(value);
+}
+
+///////////////////////////////////////////
+
+void fake_setup() {
+	config.rate            = env_number("FAKE_ADB_RATE",            1000);
+	config.burst_rate      = env_number("FAKE_ADB_BURST_RATE",      0);
+	config.burst_ms        = env_number("FAKE_ADB_BURST_MS",        200);
+	config.burst_period_ms = env_number("FAKE_ADB_BURST_PERIOD_MS", 5000);
+	config.tags            = (int32_t)env_number("FAKE_ADB_TAGS",    64);
+	config.pids            = (int32_t)env_number("FAKE_ADB_PIDS",    16);
+	config.churn           = env_number("FAKE_ADB_CHURN",           0.2);
+	config.len_mean        = env_number("FAKE_ADB_LEN",             80);
+	config.len_max         = (int32_t)env_number("FAKE_ADB_LEN_MAX", 1000);
+	config.history         = (int64_t)env_number("FAKE_ADB_HISTORY", 10000);
+	config.lines           = (int64_t)env_number("FAKE_ADB_LINES",   0);
+	config.devices         = (int32_t)env_number("FAKE_ADB_DEVICES", 1);
+	config.hotplug_ms      = env_number("FAKE_ADB_HOTPLUG_MS", 0);
+	config.seed            = (uint64_t)env_number("FAKE_ADB_SEED",   0);
+
+	if (config.rate     < 1)    config.rate     = 1;
+	if (config.tags     < 1)    config.tags     = 1;
+	if (config.pids     < 1)    config.pids     = 1;
+	if (config.len_max  < 16)   config.len_max  = 16;
+	if (config.len_max  > 4000) config.len_max  = 4000;
+	if (config.len_mean < 1)    config.len_mean = 1;
+	if (config.burst_period_ms < 1)                      config.burst_period_ms = 1;
+	if (config.burst_ms > config.burst_period_ms)        config.burst_ms        = config.burst_period_ms;
+	if (config.burst_rate <= 0 || config.burst_ms <= 0) { config.burst_rate = 0; config.burst_ms = 0; }
+
+	// Tag names, built from plausible looking Android component names
+	const char *heads[] = { "Activity", "Window", "Input", "Surface", "Audio", "Camera", "Bluetooth", "Wifi", "Network", "Package", "Power", "Display", "Sensor", "Media", "Location", "Telephony" };
+	const char *tails[] = { "Manager", "Service", "Flinger", "Controller", "Policy", "Tracker", "Monitor", "Helper" };
+	const int32_t head_count = sizeof(heads) / sizeof(heads[0]);
+	const int32_t tail_count = sizeof(tails) / sizeof(tails[0]);
+	tag_names = (char(*)[64])malloc(sizeof(tag_names[0]) * config.tags);
+	for (int32_t i = 0; i < config.tags; i++) {
+		uint64_t    h    = hash_u64(config.seed * 7919 + i);
+		const char *head = heads[(i + h) % head_count];
+		const char *tail = tails[(i / head_count + (h >> 8)) % tail_count];
+		if (i < head_count * tail_count) snprintf(tag_names[i], sizeof(tag_names[i]), "%s%s",   head, tail);
+		else                             snprintf(tag_names[i], sizeof(tag_names[i]), "%s%s%d", head, tail, i / (head_count * tail_count));
+	}
+
+	// A pool of word-ish text that messages are sliced out of, so making a
+	// line costs a memcpy rather than a pile of random numbers.
+	const char *words[] = { "onCreate", "binder", "transaction", "failed", "ok", "state", "changed", "to", "from", "user", "0x7f3a", "null", "surface", "buffer", "queued", "dropped", "frame", "took", "ms", "request", "pending", "resume", "pause", "config", "update", "id=", "uid", "slow", "operation", "completed", "with", "result" };
+	const int32_t word_count = sizeof(words) / sizeof(words[0]);
+	int32_t pos = 0;
+	for (uint64_t i = 0; pos < (int32_t)sizeof(text_pool) - 1; i++) {
+		uint64_t h = hash_u64(config.seed * 104729 + i);
+		const char *word = (h & 7) == 0 ? nullptr : words[(h >> 3) % word_count];
+		char number[24];
+		if (word == nullptr) { snprintf(number, sizeof(number), "%d", (int32_t)((h >> 8) % 100000)); word = number; }
+		int32_t len = (int32_t)strlen(word);
+		for (int32_t c = 0; c < len && pos < (int32_t)sizeof(text_pool) - 1; c++) text_pool[pos++] = word[c];
+		if (pos < (int32_t)sizeof(text_pool) - 1) text_pool[pos++] = ' ';
+	}
+	text_pool[sizeof(text_pool) - 1] = '\0';
+}
+
+///////////////////////////////////////////
+
+uint64_t hash_u64(uint64_t x) {
+	// splitmix64 finalizer
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+///////////////////////////////////////////
+
+// How many lines the device has logged by time_ms (unix time in ms), as a
+// fractional count. Line k is logged at the moment this reaches k.
+double lines_at(double time_ms) {
+	double period       = config.burst_period_ms;
+	double burst        = config.burst_ms;
+	double burst_lines  = config.burst_rate * burst / 1000.0;
+	double period_lines = burst_lines + config.rate * (period - burst) / 1000.0;
+
+	double periods = floor(time_ms / period);
+	double rem     = time_ms - periods * period;
+	double result  = periods * period_lines;
+	if (rem < burst) result += config.burst_rate * rem / 1000.0;
+	else             result += burst_lines + config.rate * (rem - burst) / 1000.0;
+	return result;
+}
+
+///////////////////////////////////////////
+
+// Inverse of lines_at, the time line k gets logged.
+double line_time(int64_t k) {
+	double period       = config.burst_period_ms;
+	double burst        = config.burst_ms;
+	double burst_lines  = config.burst_rate * burst / 1000.0;
+	double period_lines = burst_lines + config.rate * (period - burst) / 1000.0;
+
+	double periods = floor((double)k / period_lines);
+	double rem     = (double)k - periods * period_lines;
+	double result  = periods * period;
+	if (rem < burst_lines) result += rem / config.burst_rate * 1000.0;
+	else                   result += burst + (rem - burst_lines) / config.rate * 1000.0;
+	return result;
+}
+
+///////////////////////////////////////////
+
+// Each process slot restarts at its own staggered interval, and gets a new
+// pid each time it does.
+double slot_generation(int32_t slot, double time_ms) {
+	double per_slot = config.churn / config.pids;
+	return floor(time_ms / 1000.0 * per_slot + (double)slot / config.pids);
+}
+
+// Pids are spaced out so each process's threads (pid + 0..23) stay its own
+int32_t slot_pid(int32_t slot, double time_ms) {
+	if (config.churn <= 0) return 2000 + slot * 37;
+	int64_t generation = (int64_t)slot_generation(slot, time_ms);
+	return 2000 + (int32_t)((generation * config.pids + slot) % 800) * 37;
+}
+
+///////////////////////////////////////////
+
+void line_make(int64_t k, fake_line_t *out_line) {
+	uint64_t h = hash_u64(k ^ (config.seed << 48));
+	out_line->time_ms = line_time(k);
+
+	// Process restarts show up as the same ActivityManager lines a real
+	// device would print, so pid tracking can be tested too.
+	if (config.churn > 0) {
+		double prev_ms = line_time(k - 1);
+		double prev2_ms = line_time(k - 2);
+		for (int32_t s = 0; s < config.pids; s++) {
+			bool died    = slot_generation(s, prev_ms ) != slot_generation(s, out_line->time_ms);
+			bool started = slot_generation(s, prev2_ms) != slot_generation(s, prev_ms);
+			if (!died && !started) continue;
+
+			out_line->buffer   = fake_buffer_system;
+			out_line->pid      = 1500;
+			out_line->tid      = 1520;
+			out_line->severity = 'I';
+			out_line->tag      = "ActivityManager";
+			out_line->text_len = died
+				? snprintf(out_line->text, sizeof(out_line->text), "Process com.fake.app%02d (pid %d) has died #%lld", s, slot_pid(s, prev_ms), (long long)k)
+				: snprintf(out_line->text, sizeof(out_line->text), "Start proc %d:com.fake.app%02d/u0a%d for activity {com.fake.app%02d/.MainActivity} #%lld", slot_pid(s, out_line->time_ms), s, 100 + s, s, (long long)k);
+			return;
+		}
+	}
+
+	int32_t slot = (int32_t)(h % config.pids);
+	out_line->pid = slot_pid(slot, out_line->time_ms);
+	out_line->tid = out_line->pid + (int32_t)((h >> 16) % 4 == 0 ? 0 : (h >> 20) % 24);
+
+	// Skew towards a handful of chatty tags, like a real device
+	double u_tag = (double)((h >> 24) & 0xFFFF) / 65536.0;
+	out_line->tag = tag_names[(int32_t)(u_tag * u_tag * config.tags)];
+
+	int32_t sev = (int32_t)((h >> 40) % 1000);
+	out_line->severity = sev < 100 ? 'V' : sev < 500 ? 'D' : sev < 850 ? 'I' : sev < 950 ? 'W' : sev < 995 ? 'E' : 'F';
+
+	// Mostly main, fatal ones are crashes
+	int32_t buf = (int32_t)(hash_u64(h ^ 0xb0ffe7) % 16);
+	out_line->buffer = out_line->severity == 'F' ? fake_buffer_crash :
+	                   buf < 11 ? fake_buffer_main   :
+	                   buf < 13 ? fake_buffer_system :
+	                   buf < 14 ? fake_buffer_radio  :
+	                              fake_buffer_events;
+
+	// Events are all Info, with their own tag and payload. Times have a long
+	// tail, so there's something for a "time>100" filter to find.
+	if (out_line->buffer == fake_buffer_events) {
+		uint64_t e     = hash_u64(h ^ 0xe7e7);
+		int32_t  app   = (int32_t)(e % config.pids);
+		int32_t  ms    = (int32_t)(-log(((double)((e >> 8) & 0xFFFF) + 1) / 65537.0) * 30);
+		out_line->severity = 'I';
+		switch ((e >> 32) % 4) {
+		case 0:
+			out_line->tag      = "dvm_lock_sample";
+			out_line->text_len = snprintf(out_line->text, sizeof(out_line->text), "[com.fake.app%02d,1,main,%d,Looper.java,%d,-,%d,%d] #%lld",
+				app, ms, (int32_t)(e >> 40) % 300, (int32_t)(e >> 48) % 300, ms < 100 ? ms : 100, (long long)k);
+			break;
+		case 1:
+			out_line->tag      = "binder_sample";
+			out_line->text_len = snprintf(out_line->text, sizeof(out_line->text), "[android.app.IActivityManager,%d,%d,com.fake.app%02d,%d] #%lld",
+				(int32_t)(e >> 40) % 80, ms, app, ms < 100 ? ms : 100, (long long)k);
+			break;
+		case 2:
+			out_line->tag      = "battery_level";
+			out_line->text_len = snprintf(out_line->text, sizeof(out_line->text), "[%d,%d,%d] #%lld",
+				(int32_t)(e >> 40) % 101, 3600 + (int32_t)(e >> 48) % 700, 250 + (int32_t)(e >> 56) % 150, (long long)k);
+			break;
+		default:
+			out_line->tag      = "am_proc_start";
+			out_line->text_len = snprintf(out_line->text, sizeof(out_line->text), "[0,%d,%d,com.fake.app%02d,activity,{com.fake.app%02d/com.fake.app%02d.MainActivity}] #%lld",
+				out_line->pid, 10100 + app, app, app, app, (long long)k);
+			break;
+		}
+		return;
+	}
+
+	// Exponentially distributed message lengths
+	double  u_len = ((double)((h >> 44) & 0xFFFFF) + 1) / (double)0x100001;
+	int32_t len   = (int32_t)(-log(u_len) * config.len_mean);
+	if (len < 1)              len = 1;
+	if (len > config.len_max) len = config.len_max;
+
+	int32_t start = (int32_t)(hash_u64(h) % (sizeof(text_pool) - config.len_max - 1));
+	memcpy(out_line->text, text_pool + start, len);
+	out_line->text_len = len + snprintf(out_line->text + len, sizeof(out_line->text) - len, " #%lld", (long long)k);
+}
+
+///////////////////////////////////////////
+
+void out_write(const void *data, int32_t size) {
+	if (out_pos + size > (int32_t)sizeof(out_buffer)) out_flush();
+	memcpy(out_buffer + out_pos, data, size);
+	out_pos += size;
+}
+
+///////////////////////////////////////////
+
+void out_flush() {
+	int32_t at = 0;
+	while (at < out_pos) {
+		ssize_t written = write(STDOUT_FILENO, out_buffer + at, out_pos - at);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			exit(0); // Reader went away
+		}
+		at += (int32_t)written;
+	}
+	out_pos = 0;
+}
+
+///////////////////////////////////////////
+
+void out_line(const fake_line_t *line, bool binary) {
+	int64_t ms  = (int64_t)line->time_ms;
+	time_t  sec = (time_t)(ms / 1000);
+
+	if (binary) {
+		// struct logger_entry (v4) followed by prio, tag and message
+		int32_t tag_len = (int32_t)strlen(line->tag) + 1;
+		uint8_t prio;
+		switch (line->severity) {
+			case 'V': prio = 2; break;
+			case 'D': prio = 3; break;
+			case 'I': prio = 4; break;
+			case 'W': prio = 5; break;
+			case 'E': prio = 6; break;
+			default:  prio = 7; break;
+		}
+		struct {
+			uint16_t len;
+			uint16_t hdr_size;
+			int32_t  pid;
+			uint32_t tid;
+			uint32_t sec;
+			uint32_t nsec;
+			uint32_t lid;
+			uint32_t uid;
+		} header = {};
+		header.len      = (uint16_t)(1 + tag_len + line->text_len + 1);
+		header.hdr_size = sizeof(header);
+		header.pid      = line->pid;
+		header.tid      = (uint32_t)line->tid;
+		header.sec      = (uint32_t)sec;
+		header.nsec     = (uint32_t)(ms % 1000) * 1000000;
+		header.lid      = (uint32_t)line->buffer;
+		header.uid      = 10000 + (uint32_t)line->pid % 1000;
+		out_write(&header, sizeof(header));
+		out_write(&prio, 1);
+		out_write(line->tag, tag_len);
+		out_write(line->text, line->text_len);
+		out_write("", 1);
+		return;
+	}
+
+	// Only hit localtime once per second, it's not cheap
+	static time_t    cached_sec = -1;
+	static struct tm cached_tm  = {};
+	if (sec != cached_sec) {
+		cached_sec = sec;
+		localtime_r(&sec, &cached_tm);
+	}
+
+	char header[128];
+	int32_t len = snprintf(header, sizeof(header), "%02d-%02d %02d:%02d:%02d.%03d %5d %5d %c %-8s: ",
+		cached_tm.tm_mon + 1, cached_tm.tm_mday, cached_tm.tm_hour, cached_tm.tm_min, cached_tm.tm_sec, (int32_t)(ms % 1000),
+		line->pid, line->tid, line->severity, line->tag);
+	out_write(header, len);
+	out_write(line->text, line->text_len);
+	out_write("\n", 1);
+}
+
+///////////////////////////////////////////
+
+double now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+}
+
+///////////////////////////////////////////
+
+void sleep_ms(double ms) {
+	struct timespec ts;
+	ts.tv_sec  = (time_t)(ms / 1000);
+	ts.tv_nsec = (long)((ms - ts.tv_sec * 1000.0) * 1000000.0);
+	nanosleep(&ts, nullptr);
+}
+
+///////////////////////////////////////////
+
+// How many devices are plugged in right now. With hotplug on, the last one
+// spends every other period unplugged.
+int32_t devices_now() {
+	if (config.hotplug_ms <= 0 || config.devices <= 0) return config.devices;
+	bool unplugged = (int64_t)(now_ms() / config.hotplug_ms) % 2 == 1;
+	return unplugged ? config.devices - 1 : config.devices;
+}
+
+///////////////////////////////////////////
+
+// The device list as the server sends it, without adb's header and footer
+int32_t devices_text(bool long_format, char *out_text, int32_t text_size) {
+	int32_t at    = 0;
+	int32_t count = devices_now();
+	out_text[0] = '\0';
+	for (int32_t i = 0; i < count && at < text_size; i++) {
+		if (long_format) at += snprintf(out_text + at, text_size - at, "FAKE%04d               device product:fake_panther model:Fake_Panther_%d device:fake transport_id:%d\n", i + 1, i + 1, i + 1);
+		else             at += snprintf(out_text + at, text_size - at, "FAKE%04d\tdevice\n", i + 1);
+	}
+	return at < text_size ? at : text_size - 1;
+}
+
+///////////////////////////////////////////
+
+int cmd_devices(bool long_format) {
+	char text[1 << 16];
+	devices_text(long_format, text, sizeof(text));
+	printf("List of devices attached\n%s\n", text);
+	return 0;
+}
+
+///////////////////////////////////////////
+
+// Parses the 'MM-DD hh:mm:ss.mmm' form of logcat's -T, in local time of the
+// current year.
+bool parse_time(const char *str, double *out_ms) {
+	int32_t month, day, hour, minute, second, ms = 0;
+	if (sscanf(str, "%d-%d %d:%d:%d.%d", &month, &day, &hour, &minute, &second, &ms) < 5)
+		return false;
+
+	time_t    now    = time(nullptr);
+	struct tm now_tm = {};
+	localtime_r(&now, &now_tm);
+
+	struct tm t = {};
+	t.tm_year  = now_tm.tm_year;
+	t.tm_mon   = month - 1;
+	t.tm_mday  = day;
+	t.tm_hour  = hour;
+	t.tm_min   = minute;
+	t.tm_sec   = second;
+	t.tm_isdst = -1;
+	*out_ms = (double)mktime(&t) * 1000.0 + ms;
+	return true;
+}
+
+///////////////////////////////////////////
+
+// Position in logcat's V D I W E F S order, so filterspecs can compare them
+int32_t severity_rank(char severity) {
+	const char *order = "VDIWEFS";
+	const char *at    = severity != '\0' ? strchr(order, severity) : nullptr;
+	return at != nullptr ? (int32_t)(at - order) : 0;
+}
+
+///////////////////////////////////////////
+
+// Whether -b, --pid and TAG:L filterspecs let a line through. "*" covers tags
+// without a spec of their own.
+bool logcat_passes(const fake_line_t *line, uint32_t buffers, int32_t pid, char **specs, int32_t spec_count) {
+	if ((buffers & (1u << line->buffer)) == 0) return false;
+	if (pid != 0 && line->pid != pid) return false;
+
+	int32_t min_rank = 0;
+	size_t  tag_len  = strlen(line->tag);
+	bool    tag_spec = false;
+	for (int32_t i = 0; i < spec_count; i++) {
+		const char *colon = strrchr(specs[i], ':');
+		size_t      len   = colon - specs[i];
+		if (len == tag_len && strncmp(specs[i], line->tag, len) == 0) {
+			min_rank = severity_rank(colon[1]);
+			tag_spec = true;
+		} else if (!tag_spec && len == 1 && specs[i][0] == '*') {
+			min_rank = severity_rank(colon[1]);
+		}
+	}
+	return min_rank < severity_rank('S') && severity_rank(line->severity) >= min_rank;
+}
+
+///////////////////////////////////////////
+
+int cmd_logcat(int argc, char **argv) {
+	bool        dump       = false;
+	bool        binary     = false;
+	bool        dividers   = false;
+	uint32_t    buffers    = 0;
+	const char *since      = nullptr;
+	int32_t     pid        = 0;
+	char       *specs[64];
+	int32_t     spec_count = 0;
+	for (int32_t i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "-g") == 0) {
+			// Roughly what the ring buffer would hold in binary form
+			int64_t consumed_kb = (int64_t)(config.history * (config.len_mean + 32)) / 1024;
+			printf("main: ring buffer is %lld KiB (%lld KiB consumed), max entry is 5120 B, max payload is 4068 B\n", (long long)consumed_kb, (long long)consumed_kb);
+			return 0;
+		}
+		if      (strcmp(argv[i], "-d") == 0) dump     = true;
+		else if (strcmp(argv[i], "-D") == 0 || strcmp(argv[i], "--dividers") == 0) dividers = true;
+		else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+			char list[256];
+			snprintf(list, sizeof(list), "%s", argv[++i]);
+			for (char *name = strtok(list, ","); name != nullptr; name = strtok(nullptr, ",")) {
+				if      (strcmp(name, "all")     == 0) buffers |= (1u << fake_buffer_count) - 1;
+				else if (strcmp(name, "default") == 0) buffers |= (1u << fake_buffer_main) | (1u << fake_buffer_system) | (1u << fake_buffer_crash);
+				for (int32_t b = 0; b < fake_buffer_count; b++)
+					if (strcmp(name, buffer_names[b]) == 0) buffers |= 1u << b;
+			}
+		}
+		else if (strcmp(argv[i], "-B") == 0 || strcmp(argv[i], "--binary") == 0) binary   = true;
+		else if ((strcmp(argv[i], "-T") == 0 || strcmp(argv[i], "-t") == 0) && i + 1 < argc) since = argv[++i];
+		else if (strncmp(argv[i], "--pid=", 6) == 0) pid = atoi(argv[i] + 6);
+		else if (argv[i][0] != '-' && strchr(argv[i], ':') != nullptr && spec_count < 64) specs[spec_count++] = argv[i];
+	}
+
+	if (buffers == 0) buffers = (1u << fake_buffer_main) | (1u << fake_buffer_system) | (1u << fake_buffer_crash);
+	bool     banners = !binary && (buffers & (buffers - 1)) != 0;
+	uint32_t printed = 0;
+	int32_t  current = -1;
+
+	// Work out the range of lines the device still has in its ring buffer
+	double  now   = now_ms();
+	int64_t last  = (int64_t)floor(lines_at(now));
+	int64_t first = last - config.history + 1;
+	int64_t next  = first;
+	if (since != nullptr) {
+		double since_ms;
+		if (strchr(since, ':') != nullptr && parse_time(since, &since_ms)) next = (int64_t)ceil(lines_at(since_ms));
+		else                                                               next = last - atoll(since) + 1;
+		if (next < first) next = first;
+	}
+
+	fake_line_t line    = {};
+	int64_t     emitted = 0;
+	while (true) {
+		for (; next <= last; next++) {
+			line_make(next, &line);
+			if (!logcat_passes(&line, buffers, pid, specs, spec_count)) continue;
+			if (banners && (printed & (1u << line.buffer)) == 0) {
+				char banner[64];
+				out_write(banner, snprintf(banner, sizeof(banner), "--------- beginning of %s\n", buffer_names[line.buffer]));
+			} else if (banners && dividers && line.buffer != current) {
+				char banner[64];
+				out_write(banner, snprintf(banner, sizeof(banner), "--------- switch to %s\n", buffer_names[line.buffer]));
+			}
+			printed |= 1u << line.buffer;
+			current  = line.buffer;
+			out_line(&line, binary);
+			emitted += 1;
+			if (config.lines > 0 && emitted >= config.lines) {
+				out_flush();
+				return 0;
+			}
+		}
+		out_flush();
+		if (dump) return 0;
+
+		// The device got unplugged, so its logcat connection drops
+		if (serving > devices_now()) return 0;
+
+		sleep_ms(1);
+		last = (int64_t)floor(lines_at(now_ms()));
+
+		// The device's ring buffer wrapped before we could read it
+		if (last - next >= config.history)
+			next = last - config.history + 1;
+	}
+}
+
+///////////////////////////////////////////
+
+int cmd_shell(int argc, char **argv) {
+	if (argc <= 0) return 1;
+	if (strcmp(argv[0], "logcat") == 0)
+		return cmd_logcat(argc - 1, argv + 1);
+
+	// adb shell can take the whole command as one argument
+	char command[1024] = {};
+	for (int32_t i = 0; i < argc; i++) {
+		if (i > 0) strncat(command, " ", sizeof(command) - strlen(command) - 1);
+		strncat(command, argv[i], sizeof(command) - strlen(command) - 1);
+	}
+
+	if (strncmp(command, "pm list packages", 16) == 0) {
+		for (int32_t i = 0; i < config.pids; i++)
+			printf("package:com.fake.app%02d\n", i);
+		printf("package:com.android.systemui\npackage:com.android.settings\n");
+		return 0;
+	}
+	if (strcmp(command, "ps -A -T -o PID,TID,NAME,CMD") == 0) {
+		// Every thread line_make can log from, plus system_server's
+		const char *names[] = { "RenderThread", "HeapTaskDaemon", "Jit thread pool", "FinalizerDaemon", "OkHttp Dispatch", "AsyncTask #1" };
+		double      now     = now_ms();
+		printf("  PID   TID NAME                     CMD\n");
+		printf("%5d %5d %-24s %s\n", 1500, 1500, "system_server", "system_server");
+		printf("%5d %5d %-24s %s\n", 1500, 1520, "system_server", "ActivityManager");
+		for (int32_t slot = 0; slot < config.pids; slot++) {
+			int32_t pid = slot_pid(slot, now);
+			char    package[64];
+			snprintf(package, sizeof(package), "com.fake.app%02d", slot);
+			printf("%5d %5d %-24s %s\n", pid, pid, package, package);
+			for (int32_t t = 1; t < 24; t++) {
+				char binder[32];
+				snprintf(binder, sizeof(binder), "binder:%d_%d", pid, t);
+				printf("%5d %5d %-24s %s\n", pid, pid + t, package, t < 6 ? names[t] : binder);
+			}
+		}
+		return 0;
+	}
+	if (strcmp(command, "cat /system/etc/event-log-tags") == 0) {
+		printf("%s", event_log_tags);
+		return 0;
+	}
+	if (strncmp(command, "pidof ", 6) == 0) {
+		int32_t slot;
+		if (sscanf(command + 6, "com.fake.app%d", &slot) == 1 && slot >= 0 && slot < config.pids) {
+			printf("%d\n", slot_pid(slot, now_ms()));
+			return 0;
+		}
+		return 1;
+	}
+	if (strncmp(command, "monkey ", 7) == 0) {
+		printf("  bash arg: -p\n  bash arg: 1\nEvents injected: 1\n## Network stats: elapsed time=5ms (0ms mobile, 0ms wifi, 5ms not connected)\n");
+		return 0;
+	}
+
+	fprintf(stderr, "fake-adb: unsupported shell command: %s\n", command);
+	return 1;
+}
+
+///////////////////////////////////////////
+
+// Splits a shell command into arguments in place, understanding just enough
+// quoting for the commands log-panther sends.
+int32_t split_command(char *command, char **out_argv, int32_t max_args) {
+	int32_t argc  = 0;
+	char   *read  = command;
+	char   *write = command;
+	while (*read != '\0' && argc < max_args - 1) {
+		while (*read == ' ') read++;
+		if (*read == '\0') break;
+
+		out_argv[argc++] = write;
+		char quote = 0;
+		while (*read != '\0' && (quote != 0 || *read != ' ')) {
+			if      (quote == 0 && (*read == '\'' || *read == '"')) quote = *read;
+			else if (quote != 0 && *read == quote)                 quote = 0;
+			else if (quote == 0 && *read == '\\' && read[1] != '\0') *write++ = *++read;
+			else                                                   *write++ = *read;
+			read++;
+		}
+		if (*read != '\0') read++;
+		*write++ = '\0';
+	}
+	out_argv[argc] = nullptr;
+	return argc;
+}
+
+///////////////////////////////////////////
+
+int32_t server_port() {
+	int32_t port = (int32_t)env_number("ANDROID_ADB_SERVER_PORT", 5037);
+	return port > 0 ? port : 5037;
+}
+
+///////////////////////////////////////////
+
+int server_connect() {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in addr = {};
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons((uint16_t)server_port());
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+///////////////////////////////////////////
+
+int cmd_server(bool background) {
+	// Like adb, starting a server that's already running is fine
+	if (background) {
+		int fd = server_connect();
+		if (fd != -1) { close(fd); return 0; }
+	}
+
+	int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	int one       = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	sockaddr_in addr = {};
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons((uint16_t)server_port());
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, 64) != 0) {
+		fprintf(stderr, "fake-adb: can't listen on port %d: %s\n", server_port(), strerror(errno));
+		return 1;
+	}
+
+	if (background) {
+		// Hand the listening socket to a daemon, and return once it's ready
+		pid_t pid = fork();
+		if (pid < 0) return 1;
+		if (pid > 0) return 0;
+		setsid();
+		int null_fd = open("/dev/null", O_RDWR);
+		dup2(null_fd, STDIN_FILENO);
+		dup2(null_fd, STDOUT_FILENO);
+		dup2(null_fd, STDERR_FILENO);
+		close(null_fd);
+	}
+
+	// Connections get a process each, and nobody waits on them
+	signal(SIGCHLD, SIG_IGN);
+	while (true) {
+		int fd = accept(listen_fd, nullptr, nullptr);
+		if (fd < 0) {
+			if (errno == EINTR) continue;
+			return 1;
+		}
+		pid_t pid = fork();
+		if (pid == 0) {
+			// Long running connections (logcat, track-devices) go when the
+			// server does, like they would with adb
+			prctl(PR_SET_PDEATHSIG, SIGTERM);
+			close(listen_fd);
+			server_connection(fd);
+			_exit(0);
+		}
+		close(fd);
+	}
+}
+
+///////////////////////////////////////////
+
+int cmd_kill_server() {
+	int fd = server_connect();
+	if (fd == -1) return 0;
+	const char request[] = "0009host:kill";
+	ssize_t written = write(fd, request, sizeof(request) - 1);
+	close(fd);
+	return written > 0 ? 0 : 1;
+}
+
+///////////////////////////////////////////
+
+bool read_exact(int fd, char *buffer, int32_t size) {
+	int32_t at = 0;
+	while (at < size) {
+		ssize_t result = read(fd, buffer + at, size - at);
+		if (result < 0 && errno == EINTR) continue;
+		if (result <= 0) return false;
+		at += (int32_t)result;
+	}
+	return true;
+}
+
+///////////////////////////////////////////
+
+bool write_all(int fd, const char *data, int32_t size) {
+	int32_t at = 0;
+	while (at < size) {
+		ssize_t result = write(fd, data + at, size - at);
+		if (result < 0 && errno == EINTR) continue;
+		if (result <= 0) return false;
+		at += (int32_t)result;
+	}
+	return true;
+}
+
+///////////////////////////////////////////
+
+void reply(int fd, const char *status, const char *opt_payload) {
+	write_all(fd, status, 4);
+	if (opt_payload == nullptr) return;
+	char header[5];
+	int32_t len = (int32_t)strlen(opt_payload);
+	snprintf(header, sizeof(header), "%04x", len);
+	write_all(fd, header, 4);
+	write_all(fd, opt_payload, len);
+}
+
+///////////////////////////////////////////
+
+void server_connection(int fd) {
+	bool on_device = false;
+	char service[4096 + 1];
+	while (true) {
+		char header[5] = {};
+		if (!read_exact(fd, header, 4)) return;
+		int32_t len = (int32_t)strtol(header, nullptr, 16);
+		if (len <= 0 || len > 4096 || !read_exact(fd, service, len)) return;
+		service[len] = '\0';
+
+		if (strcmp(service, "host:version") == 0) {
+			reply(fd, "OKAY", "0029");
+			return;
+		}
+		if (strcmp(service, "host:devices") == 0 || strcmp(service, "host:devices-l") == 0) {
+			char text[1 << 16];
+			devices_text(strcmp(service, "host:devices-l") == 0, text, sizeof(text));
+			reply(fd, "OKAY", text);
+			return;
+		}
+		if (strcmp(service, "host:track-devices") == 0 || strcmp(service, "host:track-devices-l") == 0) {
+			reply(fd, "OKAY", nullptr);
+			cmd_track_devices(fd, strcmp(service, "host:track-devices-l") == 0);
+			return;
+		}
+		if (strcmp(service, "host:kill") == 0) {
+			reply(fd, "OKAY", nullptr);
+			kill(getppid(), SIGTERM);
+			return;
+		}
+		if (strcmp(service, "host:transport-any") == 0) {
+			on_device = devices_now() > 0;
+			serving   = 1;
+			if (!on_device) { reply(fd, "FAIL", "no devices/emulators found"); return; }
+			reply(fd, "OKAY", nullptr);
+			continue;
+		}
+		if (strncmp(service, "host:transport:", 15) == 0) {
+			int32_t device = 0;
+			on_device = sscanf(service + 15, "FAKE%d", &device) == 1 && device >= 1 && device <= devices_now();
+			serving   = device;
+			if (!on_device) { reply(fd, "FAIL", "device not found"); return; }
+			reply(fd, "OKAY", nullptr);
+			continue;
+		}
+		if (on_device && strncmp(service, "shell:", 6) == 0) {
+			reply(fd, "OKAY", nullptr);
+
+			// Run it like the command line version would, writing to the socket
+			dup2(fd, STDOUT_FILENO);
+			close(fd);
+			char   *shell_argv[64];
+			int32_t shell_argc = split_command(service + 6, shell_argv, 64);
+			cmd_shell(shell_argc, shell_argv);
+			out_flush();
+			fflush(stdout);
+			return;
+		}
+
+		reply(fd, "FAIL", "unknown service");
+		return;
+	}
+}
+
+///////////////////////////////////////////
+
+// Sends the length prefixed device list every time it changes, until the
+// reader goes away
+int cmd_track_devices(int fd, bool long_format) {
+	char sent[1 << 16] = {};
+	bool first         = true;
+	while (true) {
+		char text[1 << 16];
+		devices_text(long_format, text, sizeof(text));
+		if (first || strcmp(text, sent) != 0) {
+			char header[5];
+			snprintf(header, sizeof(header), "%04x", (int32_t)strlen(text));
+			if (!write_all(fd, header, 4) || !write_all(fd, text, (int32_t)strlen(text)))
+				return 0;
+			strcpy(sent, text);
+			first = false;
+		}
+		sleep_ms(5);
+	}
+}
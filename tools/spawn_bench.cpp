@@ -0,0 +1,71 @@
+/* spawn-bench
+
+	Measures how long starting a child process takes as our own resident set
+	grows, comparing platform_process_start against the fork() + sh -c it
+	replaced. fork has to copy page tables for everything we have mapped, so
+	its cost climbs with RSS, while posix_spawn's shouldn't.
+
+		spawn-bench [max_rss_mb] [spawns_per_size]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../src/platform.h"
+
+///////////////////////////////////////////
+
+double bench_platform_spawn(int32_t count) {
+	const char *args[] = { "true", nullptr };
+	uint64_t start = platform_time_ns();
+	for (int32_t i = 0; i < count; i++) {
+		platform_process_result_t proc = platform_process_start(args);
+		if (!proc.success) return -1;
+		platform_process_cleanup(proc.process);
+	}
+	return (platform_time_ns() - start) / 1000.0 / count;
+}
+
+///////////////////////////////////////////
+
+double bench_fork_shell(int32_t count) {
+	uint64_t start = platform_time_ns();
+	for (int32_t i = 0; i < count; i++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			execl("/bin/sh", "sh", "-c", "true", (char*)nullptr);
+			_exit(1);
+		}
+		if (pid < 0) return -1;
+		int status;
+		waitpid(pid, &status, 0);
+	}
+	return (platform_time_ns() - start) / 1000.0 / count;
+}
+
+///////////////////////////////////////////
+
+int main(int argc, char **argv) {
+	int32_t max_mb = argc > 1 ? atoi(argv[1]) : 4096;
+	int32_t count  = argc > 2 ? atoi(argv[2]) : 50;
+
+	printf("%10s %18s %18s\n", "rss (MiB)", "posix_spawn (us)", "fork+sh (us)");
+
+	const size_t chunk_size = 256 * 1024 * 1024;
+	size_t       rss        = 0;
+	for (int32_t mb = 0; mb <= max_mb; mb = mb == 0 ? 256 : mb * 2) {
+		// Grow and touch memory until we're at the target size
+		while (rss < (size_t)mb * 1024 * 1024) {
+			char *chunk = (char*)malloc(chunk_size);
+			if (chunk == nullptr) { printf("out of memory at %zu MiB\n", rss / (1024 * 1024)); return 0; }
+			memset(chunk, 1, chunk_size);
+			rss += chunk_size;
+		}
+
+		printf("%10d %18.1f %18.1f\n", mb, bench_platform_spawn(count), bench_fork_shell(count));
+	}
+	return 0;
+}